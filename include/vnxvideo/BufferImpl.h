@@ -6,6 +6,7 @@
 class CNalBuffer : public VnxVideo::IBuffer {
     std::shared_ptr<uint8_t> m_data;
     size_t m_size;
+    VnxVideo::SFrameTrace m_trace;
 public:
     CNalBuffer(uint8_t *data, size_t size)
         : m_data((uint8_t*)malloc(size), free)
@@ -22,10 +23,18 @@ public:
     VnxVideo::IBuffer* Dup() {
         return new CNalBuffer(*this);
     }
+    bool GetTrace(VnxVideo::SFrameTrace& trace) {
+        trace = m_trace;
+        return m_trace.ingestNs != 0;
+    }
+    void SetTrace(const VnxVideo::SFrameTrace& trace) {
+        m_trace = trace;
+    }
 };
 class CNoOwnershipNalBuffer : public VnxVideo::IBuffer {
     uint8_t* m_data;
     size_t m_size;
+    VnxVideo::SFrameTrace m_trace;
 public:
     CNoOwnershipNalBuffer(uint8_t *data, size_t size)
         : m_data(data)
@@ -37,6 +46,15 @@ public:
         size = (int)m_size;
     }
     VnxVideo::IBuffer* Dup() {
-        return new CNalBuffer(m_data, m_size);
+        CNalBuffer* res = new CNalBuffer(m_data, m_size);
+        res->SetTrace(m_trace);
+        return res;
+    }
+    bool GetTrace(VnxVideo::SFrameTrace& trace) {
+        trace = m_trace;
+        return m_trace.ingestNs != 0;
+    }
+    void SetTrace(const VnxVideo::SFrameTrace& trace) {
+        m_trace = trace;
     }
 };
@@ -42,6 +42,7 @@ extern "C" {
     typedef struct { void* ptr; } vnxvideo_decoder_t;
     typedef struct { void* ptr; } vnxvideo_renderer_t;
     typedef struct { void* ptr; } vnxvideo_transcoder_t;
+    typedef struct { void* ptr; } vnxvideo_pipeline_t;
 
     typedef struct { void* ptr; } vnxvideo_vmsplugin_t;
 #pragma pack(pop)
@@ -104,6 +105,40 @@ extern "C" {
     // call only once. second call will be ignored with invalid paramteter error code
     VNXVIDEO_DECLSPEC int vnxvideo_init(vnxvideo_log_t log_handler, void* usrptr, ELogLevel max_level);
 
+    // counters of the cache of scaling contexts used for format conversions and resizing. Any pointer may be null
+    VNXVIDEO_DECLSPEC int vnxvideo_get_sws_cache_stats(uint64_t* hits, uint64_t* misses, uint64_t* evictions);
+
+    // JSON snapshot of frame memory usage: per-allocator live/peak bytes and alloc/free rates
+    // (per second since the previous call), frame pool counters, samples which could not be allocated because
+    // the preferred shm allocator was exhausted, and frames pinned by local transport clients along with frames
+    // rejected or reclaimed from them because of their lease limits.
+    // Returns required buffer size if json_buffer is null or buffer_size is 0.
+    VNXVIDEO_DECLSPEC int vnxvideo_get_memory_stats(char* json_buffer, int buffer_size);
+
+    // sets up the pool of threads shared by async transforms and encoders: number of workers
+    // (0 to keep VNX_EXECUTOR_THREADS or the number of cpus), and cpus they may run on, like "0-3,8-11" (null or empty for any). Overrides VNX_EXECUTOR_THREADS
+    // and VNX_EXECUTOR_AFFINITY; should be called before any async processing starts, fails afterwards.
+    VNXVIDEO_DECLSPEC int vnxvideo_configure_executor(int workers, const char* cpu_affinity);
+
+    // JSON snapshot of frame latency per processing stage ("decoder", "transform", "async", "encoder",
+    // "renderer_input", "renderer"): the number of frames and p50/p99/max of the time in microseconds since
+    // a frame entered the process, from a capture device, a file or a local transport client, until it
+    // reached the stage. Returns required buffer size if json_buffer is null or buffer_size is 0.
+    VNXVIDEO_DECLSPEC int vnxvideo_get_latency_stats(char* json_buffer, int buffer_size);
+    VNXVIDEO_DECLSPEC int vnxvideo_reset_latency_stats();
+
+    // timeline of decoding, encoding, rendering, async processing, analytics and local transport, per thread,
+    // in Chrome trace event format (chrome://tracing, Perfetto). Recording is off unless enabled here or by
+    // VNX_EVENT_TRACE=1; each thread keeps its latest VNX_EVENT_TRACE_RING events (16384 by default).
+    VNXVIDEO_DECLSPEC int vnxvideo_event_trace_enable(int enable);
+    // Returns required buffer size if json_buffer is null or buffer_size is 0, and keeps that very trace
+    // for the next call, which fills the buffer; a call without a size query dumps the current trace.
+    VNXVIDEO_DECLSPEC int vnxvideo_event_trace_dump(char* json_buffer, int buffer_size);
+    VNXVIDEO_DECLSPEC int vnxvideo_event_trace_dump_to_file(const char* path);
+    // writes the trace to the file on every signal signum; not implemented on Windows.
+    // Setting VNX_EVENT_TRACE_FILE does the same for SIGUSR2.
+    VNXVIDEO_DECLSPEC int vnxvideo_event_trace_dump_on_signal(int signum, const char* path);
+
     VNXVIDEO_DECLSPEC int vnxvideo_manager_dshow_create(vnxvideo_manager_t* mgr);
     VNXVIDEO_DECLSPEC int vnxvideo_manager_v4l_create(vnxvideo_manager_t* mgr);
     VNXVIDEO_DECLSPEC void vnxvideo_manager_free(vnxvideo_manager_t);
@@ -159,18 +194,30 @@ extern "C" {
         int roi_left, int roi_top, int roi_width, int roi_height, 
         int target_width, int target_height, 
         vnxvideo_raw_sample_t* out);
+    // shallow copy of a sample which converts to other formats on demand. Conversions made by
+    // vnxvideo_raw_sample_convert are memoized and shared with all dups of the resulting sample
+    VNXVIDEO_DECLSPEC int vnxvideo_raw_sample_convert_on_demand(vnxvideo_raw_sample_t in, vnxvideo_raw_sample_t* out);
+    // get a sample in given video format. Data is shared if the sample is already in that format
+    VNXVIDEO_DECLSPEC int vnxvideo_raw_sample_convert(vnxvideo_raw_sample_t in, EColorspace csp, vnxvideo_raw_sample_t* out);
 
 
     VNXVIDEO_DECLSPEC void vnxvideo_rawproc_free(vnxvideo_rawproc_t proc);
     VNXVIDEO_DECLSPEC int vnxvideo_rawproc_set_format(vnxvideo_rawproc_t proc, EColorspace csp, int width, int height);
     VNXVIDEO_DECLSPEC int vnxvideo_rawproc_process(vnxvideo_rawproc_t proc, vnxvideo_raw_sample_t sample, uint64_t timestamp);
     VNXVIDEO_DECLSPEC int vnxvideo_rawproc_flush(vnxvideo_rawproc_t proc);
+    // JSON counters of the queue of an async processor, like a cpu video encoder: depth, queued, max_queued,
+    // processed, dropped, blocked, expired (skipped for being older than "max_age_ms" of the queue config).
+    // Returns required buffer size if json_buffer is null or buffer_size is 0;
+    // invalid parameter if proc has no such queue.
+    VNXVIDEO_DECLSPEC int vnxvideo_rawproc_get_queue_stats(vnxvideo_rawproc_t proc, char* json_buffer, int buffer_size);
 
     VNXVIDEO_DECLSPEC int vnxvideo_rawproc_create_from_callbacks(
         vnxvideo_on_frame_format_t onFormat, void* usrptrOnFormat,
         vnxvideo_on_raw_sample_t onSample, void* usrptrOnSample,
         vnxvideo_rawproc_t* proc);
 
+    // json_config may have a "queue" object for cpu encoders, which run asynchronously on the shared executor;
+    // see ParseAsyncQueueConfig in vnxvideoimpl.h. By default the latest frame waits for the encoder.
     VNXVIDEO_DECLSPEC int vnxvideo_h264_encoder_create(const char* json_config, vnxvideo_encoder_t* encoder);
     VNXVIDEO_DECLSPEC int vnxvideo_audio_encoder_create(EMediaSubtype output, const char* json_config, 
         vnxvideo_encoder_t* encoder);
@@ -183,6 +230,7 @@ extern "C" {
     VNXVIDEO_DECLSPEC vnxvideo_rawproc_t vnxvideo_composer_to_rawproc(vnxvideo_composer_t); // cast, not duplication
     VNXVIDEO_DECLSPEC int vnxvideo_composer_set_overlay(vnxvideo_composer_t composer, vnxvideo_raw_sample_t image);
 
+    // json_config may have "max_age_ms": frames older than that by the time they reach the analytics are skipped
     VNXVIDEO_DECLSPEC int vnxvideo_analytics_create(const char* json_config, vnxvideo_analytics_t* analytics);
     VNXVIDEO_DECLSPEC vnxvideo_rawproc_t vnxvideo_analytics_to_rawproc(vnxvideo_analytics_t); // cast, not duplication
     VNXVIDEO_DECLSPEC int vnxvideo_analytics_subscribe(vnxvideo_analytics_t analytics, 
@@ -191,7 +239,16 @@ extern "C" {
 
     VNXVIDEO_DECLSPEC int vnxvideo_rawproc_chain_create(vnxvideo_rawproc_chain_t* chain);
     VNXVIDEO_DECLSPEC vnxvideo_rawproc_t vnxvideo_rawproc_chain_to_rawproc(vnxvideo_rawproc_chain_t); // cast, not duplication
+    // json_config is {"mode": "sequential"|"parallel"|"detached", "queue": {...}, "max_age_ms": 0}: links process a sample
+    // one after another (the default), concurrently with Process waiting for all of them, or on queues of their own without
+    // waiting. "queue" is like that of vnxvideo_h264_encoder_create, for the detached links. Links skip samples which
+    // are older than max_age_ms by the time they get them, if it is not 0.
+    VNXVIDEO_DECLSPEC int vnxvideo_rawproc_chain_create_with_config(const char* json_config, vnxvideo_rawproc_chain_t* chain);
     VNXVIDEO_DECLSPEC int vnxvideo_rawproc_chain_link(vnxvideo_rawproc_chain_t chain, vnxvideo_rawproc_t link);
+    // JSON array of link counters, in the order of linking: processed, total_us, max_us, last_us spent in their Process,
+    // expired samples they skipped, and "queue" counters (see vnxvideo_rawproc_get_queue_stats) for detached links.
+    // Returns required buffer size if json_buffer is null or buffer_size is 0.
+    VNXVIDEO_DECLSPEC int vnxvideo_rawproc_chain_get_stats(vnxvideo_rawproc_chain_t chain, char* json_buffer, int buffer_size);
 
     VNXVIDEO_DECLSPEC int vnxvideo_imganalytics_create(const char* json_config, vnxvideo_imganalytics_t *ian);
     VNXVIDEO_DECLSPEC void vnxvideo_imganalytics_free(vnxvideo_imganalytics_t ian);
@@ -239,6 +296,12 @@ extern "C" {
     VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_nosignal(vnxvideo_renderer_t renderer, vnxvideo_raw_sample_t nosignalImage);
     VNXVIDEO_DECLSPEC int vnxvideo_renderer_update_audio_layout(vnxvideo_renderer_t renderer,
         int sample_rate, int channels, const char* layout);
+    // video frames of inputs which are older than max_age_ms when they arrive are held back, before the input's
+    // transform, and skipped if a newer frame of the input arrives by the next refresh; 0, the default, for no limit
+    VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_max_frame_age(vnxvideo_renderer_t renderer, int max_age_ms);
+    // viewports of a frame, or bands of large ones, are scaled by up to that many threads at once (1 to 64): the renderer's
+    // own and those of the shared executor. 1, the default, renders on the renderer's thread only
+    VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_workers(vnxvideo_renderer_t renderer, int workers);
 
     VNXVIDEO_DECLSPEC int vnxvideo_with_shm_allocator_str(const char* name, int maxSizeMB, vnxvideo_action_t action, void* usrptr);
     VNXVIDEO_DECLSPEC int vnxvideo_with_shm_allocator_ptr(vnxvideo_allocator_t allocator, vnxvideo_action_t action, void* usrptr);
@@ -246,8 +309,37 @@ extern "C" {
     VNXVIDEO_DECLSPEC void vnxvideo_shm_allocator_free(vnxvideo_allocator_t allocator);
 
     VNXVIDEO_DECLSPEC int vnxvideo_local_client_create(const char* name, vnxvideo_videosource_t* out);
+    // client which only needs a reduced frame rate; the provider does not send it other frames at all.
+    // max_fps and min_interval_ms of 0 mean no limit
+    VNXVIDEO_DECLSPEC int vnxvideo_local_client_create_decimated(const char* name, double max_fps, int min_interval_ms,
+        vnxvideo_videosource_t* out);
     VNXVIDEO_DECLSPEC int vnxvideo_local_server_create(const char* name, int maxSizeMB, vnxvideo_rawproc_t* out);
 
+    // Builds and connects a graph of nodes in one call. json_config is
+    // {"executor": {"threads": 4, "affinity": "0-3"}, "groups": {"<name>": {"queue": {...}}}, "nodes": [...]}, where every node
+    // has an "id", a "type" and, unless it is a source, an "input" node declared before it. Node types and their settings:
+    //   local_client {name, max_fps, min_interval_ms}, media_client {name, join_at_keyframe}, renderer {refresh_rate, max_age_ms, workers} are sources;
+    //   decoder {codec, cpu_only} takes coded video; transform {config}, analytics {config}, encoder {config}
+    //   (configs as for vnxvideo_rawtransform_create, vnxvideo_analytics_create, vnxvideo_h264_encoder_create),
+    //   renderer_input {renderer, index, transform}, local_provider {name, max_size_mb} take raw video;
+    //   media_provider {name, max_size_mb, subtype} takes coded media.
+    // Nodes producing raw video may have a "fanout" like vnxvideo_rawproc_chain_create_with_config for their outputs.
+    // A node runs on the thread of its input, unless it has a "queue" (see vnxvideo_h264_encoder_create) served by
+    // the shared executor. Nodes of a "group" run on the thread of the group's only entry node, with the group's queue
+    // in front of it if any, so that hot stages share a thread and have no handoffs between them.
+    VNXVIDEO_DECLSPEC int vnxvideo_pipeline_create(const char* json_config, vnxvideo_pipeline_t* pipeline);
+    VNXVIDEO_DECLSPEC void vnxvideo_pipeline_free(vnxvideo_pipeline_t pipeline);
+    VNXVIDEO_DECLSPEC int vnxvideo_pipeline_start(vnxvideo_pipeline_t pipeline);
+    VNXVIDEO_DECLSPEC int vnxvideo_pipeline_stop(vnxvideo_pipeline_t pipeline);
+    // the renderer of a renderer node, to set its layout; owned by the pipeline
+    VNXVIDEO_DECLSPEC int vnxvideo_pipeline_get_renderer(vnxvideo_pipeline_t pipeline, const char* id, vnxvideo_renderer_t* renderer);
+    // the analytics of an analytics node, owned by the pipeline. Its results are dropped unless
+    // vnxvideo_analytics_subscribe is called for it, which should be done before vnxvideo_pipeline_start
+    VNXVIDEO_DECLSPEC int vnxvideo_pipeline_get_analytics(vnxvideo_pipeline_t pipeline, const char* id, vnxvideo_analytics_t* analytics);
+    // JSON counters of the nodes: {"nodes": [{id, type, group, processed, total_us, max_us, last_us, queue}]}.
+    // Returns required buffer size if json_buffer is null or buffer_size is 0.
+    VNXVIDEO_DECLSPEC int vnxvideo_pipeline_get_stats(vnxvideo_pipeline_t pipeline, char* json_buffer, int buffer_size);
+
     // to be deprecated {{
     typedef int (*vnxvideo_h264_source_create_t)(const char* json_config, vnxvideo_h264_source_t* source);
     VNXVIDEO_DECLSPEC int vnxvideo_h264_source_subscribe(vnxvideo_h264_source_t source,
@@ -13,11 +13,27 @@
 
 namespace VnxVideo
 {
+    // where a frame entered the process: steady clock time in nanoseconds when a source delivered it,
+    // and a process-wide sequence number. Decoders, transforms, async processors, encoders and the renderer
+    // pass it on to whatever they make of the frame, so that every stage can tell how late the frame is.
+    struct SFrameTrace {
+        uint64_t ingestNs; // 0 if the frame is not traced
+        uint64_t sequence;
+        SFrameTrace()
+            : ingestNs(0)
+            , sequence(0)
+        {
+        }
+    };
+
     class IBuffer {
     public:
         virtual ~IBuffer() {}
         virtual void GetData(uint8_t* &data, int& size) = 0;
         virtual IBuffer* Dup() = 0; // make a shallow copy, ie share the same underlying raw buffer
+        // buffers which do not keep a trace have none
+        virtual bool GetTrace(SFrameTrace& /*trace*/) { return false; }
+        virtual void SetTrace(const SFrameTrace& /*trace*/) {}
     };
 
     class IRawSample {
@@ -29,6 +45,9 @@ namespace VnxVideo
         // See also comment for TOnFormatCallback.
         virtual void GetData(int* strides, uint8_t** planes) = 0;
         virtual IRawSample* Dup() = 0; // make a shallow copy, ie share the same underlying raw buffer
+        // samples which do not keep a trace have none
+        virtual bool GetTrace(SFrameTrace& /*trace*/) { return false; }
+        virtual void SetTrace(const SFrameTrace& /*trace*/) {}
     };
     typedef std::shared_ptr<IRawSample> PRawSample;
 
@@ -43,6 +62,14 @@ namespace VnxVideo
     // same as vnxvideo_raw_sample_allocate
     VNXVIDEO_DECLSPEC IRawSample* AllocateRawSample(EColorspace csp, int width, int height);
 
+    // shallow copy of a video sample which converts to other formats lazily, see ConvertRawSample.
+    // Converted images are kept with the sample and shared by all its Dup()-s,
+    // so a frame passed to several consumers is converted at most once per format.
+    VNXVIDEO_DECLSPEC IRawSample* ConvertOnDemand(IRawSample*);
+    // the sample in the requested video format: shares the data if the sample already is in that format,
+    // takes the memoized conversion if the sample comes from ConvertOnDemand, or converts it otherwise.
+    VNXVIDEO_DECLSPEC PRawSample ConvertRawSample(IRawSample*, ERawMediaFormat);
+
     typedef typename std::function<void(ERawMediaFormat emf, int, int)> TOnFormatCallback;
     // ^^ A (new, as of 2022-10-01) convention on TOnFormatCallback.
     // For video media formats, arguments represent width and height of image,
@@ -107,6 +134,8 @@ namespace VnxVideo
     VNXVIDEO_DECLSPEC IMediaDecoder* CreateVideoDecoder_FFmpegH264(bool cpuOnly);
     VNXVIDEO_DECLSPEC IMediaDecoder* CreateVideoDecoder_FFmpegHEVC(bool cpuOnly);
     VNXVIDEO_DECLSPEC IMediaDecoder* CreateVideoDecoder_OpenH264();
+    // H.264 or HEVC decoder chosen like vnxvideo_h264_decoder_create does, that is honoring VNX_HW_DECODER and VNX_SW_DECODER
+    VNXVIDEO_DECLSPEC IMediaDecoder* CreateVideoDecoder(EMediaSubtype subtype, bool cpuOnly);
 
     class IRawProc {
     public:
@@ -130,6 +159,55 @@ namespace VnxVideo
     VNXVIDEO_DECLSPEC IMediaEncoder* CreateVideoEncoder_FFmpeg_Auto(const char* profile, const char* preset, int fps, const TEncoderQuality& quality);
     VNXVIDEO_DECLSPEC IMediaEncoder* CreateAsyncVideoEncoder(PMediaEncoder enc);
 
+    // what an async processor does with a new sample when its queue is full
+    enum EAsyncDropPolicy {
+        EADP_DROP_OLDEST,        // the oldest queued sample is dropped
+        EADP_DROP_NEWEST,        // the new sample is dropped
+        EADP_DROP_NON_REFERENCE, // a non-reference sample is dropped, the newest first; the oldest one if all are references
+        EADP_BLOCK               // the caller waits for a free slot, for blockTimeoutMs at most (0 for no limit), then the new sample is dropped
+    };
+    struct SAsyncQueueConfig {
+        int depth; // number of samples waiting for processing
+        EAsyncDropPolicy policy;
+        int blockTimeoutMs;
+        // every referenceInterval-th sample delivered to the processor is a reference one, like those becoming keyframes
+        // of a GOP; 0 for none. Samples are flagged by their places in the queue, and reflagged when a queued sample
+        // is dropped or skipped, so this only matches an encoder with a fixed GOP of referenceInterval frames,
+        // and does not follow the keyframes it inserts on its own, e.g. on scene cuts.
+        int referenceInterval;
+        int maxAgeMs; // samples which are older than that when their turn comes are skipped; 0 for no limit
+        SAsyncQueueConfig()
+            : depth(1)
+            , policy(EADP_DROP_OLDEST)
+            , blockTimeoutMs(0)
+            , referenceInterval(0)
+            , maxAgeMs(0)
+        {
+        }
+    };
+    // {"depth": 4, "policy": "drop_oldest"|"drop_newest"|"drop_non_reference"|"block", "block_timeout_ms": 0, "reference_interval": 25,
+    //  "max_age_ms": 200};
+    // fields which are not given are taken from defaults
+    VNXVIDEO_DECLSPEC SAsyncQueueConfig ParseAsyncQueueConfig(const nlohmann::json& config, const SAsyncQueueConfig& defaults = SAsyncQueueConfig());
+    struct SAsyncQueueStats {
+        int depth;
+        int queued;        // samples waiting for processing now
+        int maxQueued;     // since creation
+        uint64_t processed;
+        uint64_t dropped;
+        uint64_t blocked;  // calls to Process which waited for a free slot
+        uint64_t expired;  // samples skipped for being older than maxAgeMs
+    };
+    // implemented by async processors, in addition to their main interface
+    class IAsyncQueue {
+    public:
+        virtual ~IAsyncQueue() {}
+        virtual SAsyncQueueStats GetQueueStats() = 0;
+    };
+    VNXVIDEO_DECLSPEC IMediaEncoder* CreateAsyncVideoEncoder(PMediaEncoder enc, const SAsyncQueueConfig& config);
+    // json config of vnxvideo_h264_encoder_create
+    VNXVIDEO_DECLSPEC IMediaEncoder* CreateVideoEncoder(const nlohmann::json& config);
+
     class ITranscoder {
     public:
         virtual ~ITranscoder() {}
@@ -176,6 +254,8 @@ namespace VnxVideo
     VNXVIDEO_DECLSPEC IRawTransform* CreateRawTransform_DewarpProjective(const std::vector<double>& tform);
     VNXVIDEO_DECLSPEC IRawTransform* CreateRawTransform(const nlohmann::json& config);
     VNXVIDEO_DECLSPEC IRawTransform* CreateAsyncTransform(PRawTransform);
+    VNXVIDEO_DECLSPEC IRawTransform* CreateAsyncTransform(PRawTransform, const SAsyncQueueConfig& config);
+    VNXVIDEO_DECLSPEC IRawProc* CreateAsyncProc(PRawProc, const SAsyncQueueConfig& config);
 
 
 
@@ -192,15 +272,49 @@ namespace VnxVideo
     class IAnalytics : public IRawProc {
     public:
         virtual void Subscribe(TOnJsonCallback onJson, TOnBufferCallback onBinary) = 0;
+        // frames older than that are not analysed; 0 for no limit. Analytics which do not check the age take all frames
+        virtual void SetMaxFrameAge(int /*maxAgeMs*/) {}
     };
     VNXVIDEO_DECLSPEC IAnalytics* CreateAnalytics_Basic(const std::vector<float>& roi, float framerate, 
         bool too_bright, bool too_dark, bool too_blurry, float motion, bool scene_change);
+    // json config of vnxvideo_analytics_create
+    VNXVIDEO_DECLSPEC IAnalytics* CreateAnalytics(const nlohmann::json& config);
+
+    enum ERawProcChainMode {
+        ERPCM_SEQUENTIAL, // links process a sample one after another on the caller's thread
+        ERPCM_PARALLEL,   // links process a sample concurrently on the executor; Process returns when all of them are done
+        ERPCM_DETACHED    // every link has a queue of its own served by the executor; Process returns at once
+    };
+    struct SRawProcChainConfig {
+        ERawProcChainMode mode;
+        SAsyncQueueConfig queue; // for the links in detached mode
+        int maxAgeMs; // links skip samples which are older than that by the time they get them; 0 for no limit
+        SRawProcChainConfig()
+            : mode(ERPCM_SEQUENTIAL)
+            , maxAgeMs(0)
+        {
+        }
+    };
+    // {"mode": "sequential"|"parallel"|"detached", "queue": {...}, "max_age_ms": 0}, see ParseAsyncQueueConfig for the queue
+    VNXVIDEO_DECLSPEC SRawProcChainConfig ParseRawProcChainConfig(const nlohmann::json& config);
+    struct SRawProcLinkStats {
+        uint64_t processed;
+        uint64_t totalUs; // time spent in Process of the link
+        uint64_t maxUs;
+        uint64_t lastUs;
+        uint64_t expired; // samples skipped for being older than maxAgeMs
+        bool queued;      // the link has a queue, that is the chain is detached
+        SAsyncQueueStats queue;
+    };
 
     class IRawProcChain : public IRawProc {
     public:
         virtual void Link(IRawProc*) = 0;
+        // in the order of linking; chains which do not measure their links have none
+        virtual std::vector<SRawProcLinkStats> GetLinkStats() { return std::vector<SRawProcLinkStats>(); }
     };
     VNXVIDEO_DECLSPEC IRawProcChain* CreateRawProcChain();
+    VNXVIDEO_DECLSPEC IRawProcChain* CreateRawProcChain(const SRawProcChainConfig& config);
 
 
     class IImageAnalytics {
@@ -242,16 +356,47 @@ namespace VnxVideo
         virtual void SetBackground(uint8_t* backgroundColor, VnxVideo::IRawSample* backgroundImage) =0;
         virtual void SetNosignal(VnxVideo::IRawSample* backgroundImage) = 0;
         virtual void UpdateAudioLayout(int sample_rate, int channels, const TAudioLayout& layout) = 0;
+        // video frames of inputs which are older than that are skipped if a newer one comes by the next refresh;
+        // 0 for no limit. Renderers which do not check the age take all frames
+        virtual void SetMaxFrameAge(int /*maxAgeMs*/) {}
+        // number of threads scaling the viewports of a frame, the renderer's own and those of the shared executor;
+        // 1, the default, for the renderer's thread only. Renderers which do not spread the scaling ignore it
+        virtual void SetRenderWorkers(int /*workers*/) {}
     };
     VNXVIDEO_DECLSPEC IRenderer* CreateRenderer(int refresh_rate);
 
     VNXVIDEO_DECLSPEC IVideoSource *CreateLocalVideoClient(const char* name);
+    // the provider sends frames to this client not faster than maxFps and not closer than minIntervalMs; 0 means no limit
+    VNXVIDEO_DECLSPEC IVideoSource *CreateLocalVideoClient(const char* name, double maxFps, int minIntervalMs);
     VNXVIDEO_DECLSPEC IRawProc *CreateLocalVideoProvider(const char* name, int maxSizeMB);
 
+    // publishes coded media (H.264/HEVC access units in Annex B format, audio frames) to local media clients
+    class ILocalMediaProvider {
+    public:
+        virtual ~ILocalMediaProvider() {}
+        virtual void Process(EMediaSubtype subtype, IBuffer* buffer, uint64_t timestamp) = 0;
+    };
+    VNXVIDEO_DECLSPEC ILocalMediaProvider *CreateLocalMediaProvider(const char* name, int maxSizeMB);
+    // if joinAtKeyframe is set, the client gets no video until the next IDR/IRAP access unit
+    VNXVIDEO_DECLSPEC IMediaSource *CreateLocalMediaClient(const char* name, bool joinAtKeyframe);
+
     VNXVIDEO_DECLSPEC IRawProc *CreateDisplay(int width, int height, const char* name, std::function<void(void)> onClose);
 
     VNXVIDEO_DECLSPEC void WithPreferredShmAllocator(const char* name, int maxSizeMB, std::function<void(void)> action);
 
+    // a graph of sources, decoders, transforms, analytics, encoders, renderers and local transport sinks
+    // built from a json description, see vnxvideo_pipeline_create
+    class IPipeline {
+    public:
+        virtual ~IPipeline() {}
+        virtual void Run() = 0;
+        virtual void Stop() = 0;
+        virtual IRenderer* GetRenderer(const std::string& id) = 0; // nullptr if there's no such renderer node
+        virtual IAnalytics* GetAnalytics(const std::string& id) = 0; // nullptr if there's no such analytics node
+        virtual nlohmann::json GetStats() = 0;
+    };
+    VNXVIDEO_DECLSPEC IPipeline* CreatePipeline(const nlohmann::json& config);
+
     class CVmsChannelSelector;
 
     class IVmsPlugin {
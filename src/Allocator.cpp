@@ -6,6 +6,12 @@
 #include <boost/interprocess/managed_shared_memory.hpp>
 #endif
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 
 #include "RawSample.h"
 #include "vnxvideologimpl.h"
@@ -16,21 +22,590 @@
 #include <aclapi.h>
 #endif
 
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> g_hugePages(false);
+std::atomic<int> g_numaPolicy(ENP_DEFAULT);
+std::atomic<int> g_numaNode(0);
+
+void SetFrameMemoryMode(const SFrameMemoryMode& mode) {
+    g_hugePages = mode.hugePages;
+    g_numaPolicy = mode.numaPolicy;
+    g_numaNode = mode.numaNode;
+}
+SFrameMemoryMode GetFrameMemoryMode() {
+    SFrameMemoryMode mode;
+    mode.hugePages = g_hugePages;
+    mode.numaPolicy = (ENumaPolicy)g_numaPolicy.load();
+    mode.numaNode = g_numaNode;
+    return mode;
+}
+
+std::mutex g_frameLayoutMutex;
+SFrameLayout g_frameLayout = { 64, 0, 0 };
+
+void SetFrameLayout(const SFrameLayout& layout) {
+    if (layout.alignment < 16 || layout.alignment > 4096 || (layout.alignment & (layout.alignment - 1)) != 0)
+        throw std::invalid_argument("SetFrameLayout: alignment should be a power of two from 16 to 4096");
+    if (layout.paddingRight < 0 || layout.paddingBottom < 0)
+        throw std::invalid_argument("SetFrameLayout: padding cannot be negative");
+    std::unique_lock<std::mutex> lock(g_frameLayoutMutex);
+    g_frameLayout = layout;
+}
+SFrameLayout GetFrameLayout() {
+    std::unique_lock<std::mutex> lock(g_frameLayoutMutex);
+    return g_frameLayout;
+}
+void InitFrameMemoryModeFromEnvironment() {
+    SFrameMemoryMode mode = GetFrameMemoryMode();
+    const char* const hugePagesEnv = getenv("VNX_HUGEPAGES");
+    if (hugePagesEnv != nullptr)
+        mode.hugePages = atoi(hugePagesEnv) != 0;
+    const char* const numaPolicyEnv = getenv("VNX_NUMA_POLICY");
+    if (numaPolicyEnv != nullptr) {
+        if (std::string("interleave") == numaPolicyEnv)
+            mode.numaPolicy = ENP_INTERLEAVE;
+        else if (numaPolicyEnv[0] >= '0' && numaPolicyEnv[0] <= '9') {
+            mode.numaPolicy = ENP_PREFERRED_NODE;
+            mode.numaNode = atoi(numaPolicyEnv);
+        }
+        else
+            mode.numaPolicy = ENP_DEFAULT;
+    }
+    SetFrameMemoryMode(mode);
+    if (mode.hugePages || mode.numaPolicy != ENP_DEFAULT) {
+        VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "Frame memory mode: huge pages " << (mode.hugePages ? "on" : "off")
+            << ", NUMA policy " << (mode.numaPolicy == ENP_INTERLEAVE ? "interleave" :
+                mode.numaPolicy == ENP_PREFERRED_NODE ? ("node " + std::to_string(mode.numaNode)) : "default");
+    }
+
+    SFrameLayout layout = GetFrameLayout();
+    const char* const alignmentEnv = getenv("VNX_FRAME_ALIGNMENT");
+    if (alignmentEnv != nullptr)
+        layout.alignment = atoi(alignmentEnv);
+    const char* const paddingRightEnv = getenv("VNX_FRAME_PADDING_RIGHT");
+    if (paddingRightEnv != nullptr)
+        layout.paddingRight = atoi(paddingRightEnv);
+    const char* const paddingBottomEnv = getenv("VNX_FRAME_PADDING_BOTTOM");
+    if (paddingBottomEnv != nullptr)
+        layout.paddingBottom = atoi(paddingBottomEnv);
+    try {
+        SetFrameLayout(layout);
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "Frame layout from environment is ignored: " << e.what();
+    }
+}
+
+#ifdef __linux__
+// Apply huge pages and NUMA policy to a page aligned memory range.
+// Failures are not critical, memory just stays with default policy.
+static void applyFrameMemoryMode(void* addr, size_t size, bool hugePages) {
+    if (hugePages)
+        madvise(addr, size, MADV_HUGEPAGE);
+    const int policy = g_numaPolicy;
+    if (policy == ENP_DEFAULT)
+        return;
+    const int MPOL_PREFERRED_ = 1;
+    const int MPOL_INTERLEAVE_ = 3;
+    const unsigned long MPOL_F_MEMS_ALLOWED_ = 1 << 2;
+    unsigned long nodemask = 0;
+    if (policy == ENP_INTERLEAVE) {
+        int mode = 0;
+        if (syscall(SYS_get_mempolicy, &mode, &nodemask, sizeof(nodemask) * 8, nullptr, MPOL_F_MEMS_ALLOWED_) != 0)
+            return;
+    }
+    else
+        nodemask = 1ul << (g_numaNode & 63);
+    syscall(SYS_mbind, addr, size, (policy == ENP_INTERLEAVE) ? MPOL_INTERLEAVE_ : MPOL_PREFERRED_,
+        &nodemask, sizeof(nodemask) * 8, 0);
+}
+#endif
+
+// Memory for a frame buffer. Large buffers are mapped separately when a frame memory mode is set,
+// so that huge pages and NUMA policy apply to the pages of that buffer only. Huge pages are only used
+// for buffers of 2MB and more: a smaller buffer would take a whole huge page.
+struct SFrameMemory {
+    uint8_t* ptr;
+    size_t mapped; // size of the mapping, or 0 for heap memory
+};
+// memory actually taken by a buffer of the given size
+static size_t frameMemoryBytes(const SFrameMemory& mem, size_t size) {
+    return mem.mapped != 0 ? mem.mapped : size;
+}
+static SFrameMemory allocFrameMemory(size_t size) {
+    SFrameMemory mem = { nullptr, 0 };
+#ifdef __linux__
+    const size_t HugePageSize = 2 * 1024 * 1024;
+    const size_t MinMappedSize = 256 * 1024;
+    if (size >= MinMappedSize && (g_hugePages || g_numaPolicy != ENP_DEFAULT)) {
+        const size_t mappedSize = (size + 4095) & ~size_t(4095);
+        if (g_hugePages && size >= HugePageSize) {
+            // explicitly reserved huge pages first, unless rounding up to them wastes more than 1/8
+            const size_t hugeSize = (size + HugePageSize - 1) & ~(HugePageSize - 1);
+            if (hugeSize - size <= size / 8) {
+                void* ptr = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (ptr != MAP_FAILED) {
+                    mem.ptr = (uint8_t*)ptr;
+                    mem.mapped = hugeSize;
+                    applyFrameMemoryMode(ptr, hugeSize, true);
+                    return mem;
+                }
+            }
+            // then transparent ones, which need the mapping to be aligned to a huge page; the tail
+            // which does not fill a huge page stays in small pages
+            void* ptr = mmap(nullptr, mappedSize + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED)
+                return mem;
+            uint8_t* aligned = (uint8_t*)(((uintptr_t)ptr + HugePageSize - 1) & ~(uintptr_t)(HugePageSize - 1));
+            if (aligned != ptr)
+                munmap(ptr, aligned - (uint8_t*)ptr);
+            if (aligned + mappedSize != (uint8_t*)ptr + mappedSize + HugePageSize)
+                munmap(aligned + mappedSize, (uint8_t*)ptr + HugePageSize - aligned);
+            mem.ptr = aligned;
+            mem.mapped = mappedSize;
+            applyFrameMemoryMode(aligned, mappedSize, true);
+            return mem;
+        }
+        void* ptr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr != MAP_FAILED) {
+            mem.ptr = (uint8_t*)ptr;
+            mem.mapped = mappedSize;
+            applyFrameMemoryMode(ptr, mappedSize, false);
+        }
+        return mem;
+    }
+#endif
+#ifdef _MSC_VER
+    mem.ptr = (uint8_t*)_aligned_malloc(size, 64);
+#else
+    mem.ptr = (uint8_t*)aligned_alloc(64, (size + 63) & ~size_t(63)); // LOL. spent two days on this: args swapped WRT MS impl
+#endif
+    return mem;
+}
+static void freeFrameMemory(const SFrameMemory& mem) {
+#ifdef __linux__
+    if (mem.mapped != 0) {
+        munmap(mem.ptr, mem.mapped);
+        return;
+    }
+#endif
+#ifdef _MSC_VER
+    _aligned_free(mem.ptr);
+#else
+    free(mem.ptr);
+#endif
+}
+
+class CAllocatorCounters {
+public:
+    CAllocatorCounters(const std::string& name)
+        : m_name(name)
+        , m_live(0)
+        , m_peak(0)
+        , m_allocs(0)
+        , m_frees(0)
+        , m_failures(0)
+    {
+    }
+    void Alloc(int64_t size) {
+        ++m_allocs;
+        const int64_t live = m_live += size;
+        int64_t peak = m_peak.load(std::memory_order_relaxed);
+        while (live > peak && !m_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+            ;
+    }
+    void Free(int64_t size) {
+        ++m_frees;
+        m_live -= size;
+    }
+    void Failure() {
+        ++m_failures;
+    }
+    SAllocatorStats Get() const {
+        SAllocatorStats res;
+        res.name = m_name;
+        res.liveBytes = m_live;
+        res.peakBytes = m_peak;
+        res.allocs = m_allocs;
+        res.frees = m_frees;
+        res.failures = m_failures;
+        return res;
+    }
+private:
+    const std::string m_name;
+    std::atomic<int64_t> m_live;
+    std::atomic<int64_t> m_peak;
+    std::atomic<uint64_t> m_allocs;
+    std::atomic<uint64_t> m_frees;
+    std::atomic<uint64_t> m_failures;
+};
+typedef std::shared_ptr<CAllocatorCounters> PAllocatorCounters;
+
+// Counters are owned by allocators and by the memory they gave away; the registry only observes them.
+struct SAllocatorRegistry {
+    std::mutex mutex;
+    std::vector<std::weak_ptr<CAllocatorCounters>> counters;
+};
+static SAllocatorRegistry& allocatorRegistry() {
+    static SAllocatorRegistry* registry = new SAllocatorRegistry; // never destroyed, frames may be released after statics are gone
+    return *registry;
+}
+static PAllocatorCounters registerAllocatorCounters(const std::string& name) {
+    auto counters(std::make_shared<CAllocatorCounters>(name));
+    SAllocatorRegistry& registry = allocatorRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    registry.counters.erase(std::remove_if(registry.counters.begin(), registry.counters.end(),
+        [](const std::weak_ptr<CAllocatorCounters>& c) { return c.expired(); }), registry.counters.end());
+    registry.counters.push_back(counters);
+    return counters;
+}
+
+std::vector<SAllocatorStats> GetAllocatorStats() {
+    std::vector<SAllocatorStats> res;
+    SAllocatorRegistry& registry = allocatorRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    for (auto& c : registry.counters) {
+        auto counters(c.lock());
+        if (counters)
+            res.push_back(counters->Get());
+    }
+    return res;
+}
+
+std::atomic<uint64_t> g_preferredAllocatorFailures(0);
+uint64_t GetPreferredAllocatorFailures() {
+    return g_preferredAllocatorFailures;
+}
+void CountPreferredAllocatorFailure() {
+    ++g_preferredAllocatorFailures;
+}
+
 class CPrivateAllocator : public IAllocator {
 public:
+    CPrivateAllocator()
+        : m_counters(registerAllocatorCounters("private"))
+    {
+    }
     virtual std::shared_ptr<uint8_t> Alloc(int size) {
         std::shared_ptr<uint8_t> res;
-#ifdef _MSC_VER
-        res.reset((uint8_t*)_aligned_malloc(size, 16), _aligned_free);
-#else
-        res.reset((uint8_t*)aligned_alloc(16, size), free); // LOL. spent two days on this: args swapped WRT MS impl
-#endif
+        SFrameMemory mem = allocFrameMemory(size);
+        if (mem.ptr != nullptr) {
+            const size_t bytes = frameMemoryBytes(mem, size);
+            m_counters->Alloc(bytes);
+            auto counters(m_counters);
+            res.reset(mem.ptr, [mem, counters, bytes](uint8_t*) { freeFrameMemory(mem); counters->Free(bytes); });
+        }
+        else
+            m_counters->Failure();
         return res;
     }
+private:
+    PAllocatorCounters m_counters;
 } g_privateAllocatorImpl;
 
 IAllocator* const g_privateAllocator(&g_privateAllocatorImpl);
 
+// Size classes for frame buffers are m*2^k with 16 <= m < 32, rounded up to a page,
+// so the overhead is under 1/16. Class 0 is a single page.
+const int NumSizeClasses = 512;
+static int sizeClassIndex(size_t size) {
+    if (size <= 4096)
+        return 0;
+    const size_t s = size - 1;
+    int k = 0;
+    while ((s >> k) >= 32)
+        ++k;
+    return 1 + k * 16 + int((s >> k) - 16);
+}
+static size_t sizeClassBytes(int index) {
+    const size_t page = 4096;
+    if (index == 0)
+        return page;
+    const int k = (index - 1) / 16;
+    const size_t m = (index - 1) % 16 + 16;
+    return (((m + 1) << k) + page - 1) & ~(page - 1);
+}
+
+// Recycles private buffers instead of returning them to the heap. Requested sizes are rounded up
+// to a size class, so that buffers for frames of the same format are interchangeable. Released
+// buffers are kept in the free list of their class while the total amount of idle memory stays
+// under the cap, which is set by VNX_FRAME_POOL_MB environment variable (0 disables pooling).
+class CFramePoolAllocator : public IAllocator {
+public:
+    CFramePoolAllocator()
+        : m_state(std::make_shared<SState>())
+        , m_counters(registerAllocatorCounters("frame_pool"))
+    {
+        int capacityMB = DefaultCapacityMB;
+        const char* const capacityStr = getenv("VNX_FRAME_POOL_MB");
+        if (capacityStr != nullptr)
+            capacityMB = std::max(0, atoi(capacityStr));
+        m_state->capacity = size_t(capacityMB) * 1024 * 1024;
+    }
+    virtual std::shared_ptr<uint8_t> Alloc(int size) {
+        if (size <= 0 || m_state->capacity == 0)
+            return g_privateAllocatorImpl.Alloc(size);
+        const size_t sc = sizeClass(size);
+        SFrameMemory mem = m_state->take(sc);
+        if (mem.ptr != nullptr) {
+            ++m_state->hits;
+        }
+        else {
+            ++m_state->misses;
+            mem = allocFrameMemory(sc);
+            if (mem.ptr == nullptr) {
+                m_counters->Failure();
+                return std::shared_ptr<uint8_t>();
+            }
+        }
+        const size_t bytes = frameMemoryBytes(mem, sc);
+        m_counters->Alloc(bytes);
+        auto state(m_state);
+        auto counters(m_counters);
+        return std::shared_ptr<uint8_t>(mem.ptr, [state, counters, sc, mem, bytes](uint8_t*) { state->give(mem, sc); counters->Free(bytes); });
+    }
+    void Prewarm(int size, int count) {
+        if (size <= 0 || m_state->capacity == 0)
+            return;
+        const size_t sc = sizeClass(size);
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        auto& list = m_state->free[sc];
+        while (list.size() < size_t(count)) {
+            // buffers of other classes are most likely left over from a previous format
+            while (m_state->idle + sc > m_state->capacity && m_state->evictOtherThan(sc))
+                ;
+            if (m_state->idle + sc > m_state->capacity)
+                break;
+            SFrameMemory mem = allocFrameMemory(sc);
+            if (mem.ptr == nullptr)
+                break;
+            const size_t bytes = frameMemoryBytes(mem, sc);
+            if (m_state->idle + bytes > m_state->capacity) {
+                freeFrameMemory(mem);
+                break;
+            }
+            list.push_back(mem);
+            m_state->idle += bytes;
+        }
+    }
+    SFramePoolStats GetStats() {
+        SFramePoolStats res;
+        res.hits = m_state->hits;
+        res.misses = m_state->misses;
+        res.capacityBytes = m_state->capacity;
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        res.idleBytes = m_state->idle;
+        return res;
+    }
+private:
+    static const int DefaultCapacityMB = 256;
+
+    static size_t sizeClass(size_t size) {
+        return sizeClassBytes(sizeClassIndex(size));
+    }
+
+    // shared with deleters of the buffers given away, so it outlives the allocator if needed.
+    // Idle memory is accounted by the memory buffers actually take, which is more than the size class
+    // for buffers mapped separately.
+    struct SState {
+        std::mutex mutex;
+        std::map<size_t, std::vector<SFrameMemory>> free;
+        size_t idle = 0;
+        size_t capacity = 0;
+        std::atomic<uint64_t> hits{ 0 };
+        std::atomic<uint64_t> misses{ 0 };
+
+        ~SState() {
+            for (auto& l : free)
+                for (const SFrameMemory& mem : l.second)
+                    freeFrameMemory(mem);
+        }
+        SFrameMemory take(size_t sc) {
+            SFrameMemory mem = { nullptr, 0 };
+            std::unique_lock<std::mutex> lock(mutex);
+            auto it = free.find(sc);
+            if (it == free.end() || it->second.empty())
+                return mem;
+            mem = it->second.back();
+            it->second.pop_back();
+            idle -= frameMemoryBytes(mem, sc);
+            return mem;
+        }
+        void give(const SFrameMemory& mem, size_t sc) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                const size_t bytes = frameMemoryBytes(mem, sc);
+                if (idle + bytes <= capacity) {
+                    free[sc].push_back(mem);
+                    idle += bytes;
+                    return;
+                }
+            }
+            freeFrameMemory(mem);
+        }
+        // called with the mutex held
+        bool evictOtherThan(size_t sc) {
+            for (auto& l : free) {
+                if (l.first != sc && !l.second.empty()) {
+                    idle -= frameMemoryBytes(l.second.back(), l.first);
+                    freeFrameMemory(l.second.back());
+                    l.second.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+    std::shared_ptr<SState> m_state;
+    PAllocatorCounters m_counters;
+} g_framePoolAllocatorImpl;
+
+IAllocator* const g_framePoolAllocator(&g_framePoolAllocatorImpl);
+
+SFramePoolStats GetFramePoolStats() {
+    return g_framePoolAllocatorImpl.GetStats();
+}
+
+// Small objects are rounded up to 16 bytes. Every thread keeps free blocks of each size
+// in an intrusive list; the surplus goes to a global depot in batches, where other threads
+// take it from. Producer and consumer threads exchange samples at frame rate,
+// so the batches circulate between them instead of going through the heap.
+const size_t SmallObjectGranularity = 16;
+const size_t SmallObjectMaxSize = 256;
+const int NumSmallObjectClasses = SmallObjectMaxSize / SmallObjectGranularity;
+const int SmallObjectBatch = 64;
+const size_t SmallObjectMaxDepotBatches = 64;
+
+struct SSmallBlock {
+    SSmallBlock* next;
+};
+
+struct SSmallObjectDepot {
+    std::mutex mutex;
+    std::vector<SSmallBlock*> batches[NumSmallObjectClasses];
+};
+static SSmallObjectDepot& smallObjectDepot() {
+    static SSmallObjectDepot* depot = new SSmallObjectDepot; // never destroyed, threads may outlive statics
+    return *depot;
+}
+
+static void freeSmallBlocks(SSmallBlock* b) {
+    while (b) {
+        SSmallBlock* next = b->next;
+        ::operator delete(b);
+        b = next;
+    }
+}
+
+thread_local bool t_smallObjectCacheDestroyed = false;
+
+class CSmallObjectCache {
+public:
+    CSmallObjectCache() {
+        for (auto& l : m_lists) {
+            l.head = nullptr;
+            l.count = 0;
+        }
+    }
+    ~CSmallObjectCache() {
+        t_smallObjectCacheDestroyed = true;
+        for (int c = 0; c < NumSmallObjectClasses; ++c) {
+            while (m_lists[c].count > 0)
+                toDepot(c, m_lists[c].count);
+        }
+    }
+    void* Alloc(int c) {
+        SList& l = m_lists[c];
+        if (!l.head)
+            fromDepot(c);
+        if (!l.head)
+            return ::operator new((c + 1) * SmallObjectGranularity);
+        SSmallBlock* b = l.head;
+        l.head = b->next;
+        --l.count;
+        return b;
+    }
+    void Free(int c, void* ptr) {
+        SList& l = m_lists[c];
+        SSmallBlock* b = static_cast<SSmallBlock*>(ptr);
+        b->next = l.head;
+        l.head = b;
+        if (++l.count >= 2 * SmallObjectBatch)
+            toDepot(c, SmallObjectBatch);
+    }
+private:
+    void toDepot(int c, int n) {
+        SList& l = m_lists[c];
+        SSmallBlock* first = l.head;
+        SSmallBlock* last = first;
+        for (int k = 1; k < n; ++k)
+            last = last->next;
+        l.head = last->next;
+        l.count -= n;
+        last->next = nullptr;
+
+        SSmallObjectDepot& depot = smallObjectDepot();
+        {
+            std::unique_lock<std::mutex> lock(depot.mutex);
+            if (depot.batches[c].size() < SmallObjectMaxDepotBatches) {
+                depot.batches[c].push_back(first);
+                first = nullptr;
+            }
+        }
+        freeSmallBlocks(first);
+    }
+    void fromDepot(int c) {
+        SSmallObjectDepot& depot = smallObjectDepot();
+        SSmallBlock* batch = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(depot.mutex);
+            if (depot.batches[c].empty())
+                return;
+            batch = depot.batches[c].back();
+            depot.batches[c].pop_back();
+        }
+        SList& l = m_lists[c];
+        for (SSmallBlock* b = batch; b; b = b->next)
+            ++l.count;
+        l.head = batch;
+    }
+
+    struct SList {
+        SSmallBlock* head;
+        int count;
+    };
+    SList m_lists[NumSmallObjectClasses];
+};
+
+static CSmallObjectCache* smallObjectCache() {
+    if (t_smallObjectCacheDestroyed)
+        return nullptr;
+    thread_local CSmallObjectCache cache;
+    return &cache;
+}
+
+void* SmallObjectAlloc(size_t size) {
+    CSmallObjectCache* cache;
+    if (size == 0 || size > SmallObjectMaxSize || nullptr == (cache = smallObjectCache()))
+        return ::operator new(size);
+    return cache->Alloc(int((size - 1) / SmallObjectGranularity));
+}
+
+void SmallObjectFree(void* ptr, size_t size) {
+    CSmallObjectCache* cache;
+    if (nullptr == ptr)
+        return;
+    if (size == 0 || size > SmallObjectMaxSize || nullptr == (cache = smallObjectCache()))
+        ::operator delete(ptr); // cached blocks are plain operator new allocations too
+    else
+        cache->Free(int((size - 1) / SmallObjectGranularity), ptr);
+}
+
 #ifdef _WIN32
 typedef boost::interprocess::managed_windows_shared_memory TManagedSharedMemory;
 const std::string ShmNamePrefix("Global\\viinex_shm_");
@@ -39,22 +614,28 @@ typedef boost::interprocess::managed_shared_memory TManagedSharedMemory;
 const std::string ShmNamePrefix("viinex_shm_");
 #endif
 
+static std::shared_ptr<TManagedSharedMemory> createShmSegment(const std::string& mappingName, uint32_t maxSize) {
+#ifndef _WIN32
+    boost::interprocess::shared_memory_object::remove(mappingName.c_str());
+#endif
+    std::shared_ptr<TManagedSharedMemory> heap(new TManagedSharedMemory(boost::interprocess::open_or_create, mappingName.c_str(), maxSize));
+#ifdef __linux__
+    // shmem huge pages are used if /sys/kernel/mm/transparent_hugepage/shmem_enabled allows it
+    applyFrameMemoryMode(heap->get_address(), heap->get_size(), g_hugePages);
+#endif
+#ifdef _WIN32
+    DWORD res = SetNamedSecurityInfoA(const_cast<char*>(mappingName.c_str()),
+        SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION,
+        NULL, NULL, BuildDacl777().get(), NULL);
+#endif
+    return heap;
+}
 
 class CShmAllocator : public IShmAllocator {
 public:
     CShmAllocator(const char* name, int maxSizeMB)
+        : m_heap(createShmSegment(ShmNamePrefix + name, 1024 * 1024 * maxSizeMB))
     {
-        const uint32_t maxSize = 1024 * 1024 * maxSizeMB;
-        const std::string mappingName(ShmNamePrefix + name);
-#ifndef _WIN32
-		boost::interprocess::shared_memory_object::remove(mappingName.c_str());
-#endif
-        m_heap.reset(new TManagedSharedMemory(boost::interprocess::open_or_create, mappingName.c_str(), maxSize));
-#ifdef _WIN32
-        DWORD res = SetNamedSecurityInfoA(const_cast<char*>(mappingName.c_str()),
-            SE_KERNEL_OBJECT, DACL_SECURITY_INFORMATION,
-            NULL, NULL, BuildDacl777().get(), NULL);
-#endif
     }
     virtual std::shared_ptr<uint8_t> Alloc(int size) {
         std::shared_ptr<uint8_t> res;
@@ -72,6 +653,9 @@ public:
         :   m_heap(dup->m_heap)
     {
     }
+    virtual bool Contains(void* ptr) {
+        return m_heap->belongs_to_segment(ptr);
+    }
     virtual uint64_t FromPointer(void* ptr) {
         if (!m_heap->belongs_to_segment(ptr)) {
             throw std::runtime_error("CShmAllocator::FromPointer(): given pointer does not belong to this allocator");
@@ -81,6 +665,9 @@ public:
     virtual void* ToPointer(uint64_t offset) {
         return m_heap->get_address_from_handle((ptrdiff_t)offset);
     }
+    virtual std::shared_ptr<void> Retain(uint64_t offset) {
+        return m_heap;
+    }
     virtual IShmAllocator* Dup() {
         return new CShmAllocator(this);
     }
@@ -88,25 +675,508 @@ private:
     std::shared_ptr<TManagedSharedMemory> m_heap;
 };
 
+// Offsets given away by CShmArenaAllocator keep the number of a segment in upper bits.
+// Segment 0 is the primary segment, so for other allocators offsets are just segment handles.
+const int SegmentIndexShift = 40;
+const uint64_t SegmentOffsetMask = (uint64_t(1) << SegmentIndexShift) - 1;
+
+// how long a client keeps a spillover segment mapped after its last use, unless retained
+const std::chrono::seconds ShmSegmentKeepTime(5);
+// how long a spillover segment should have no allocated blocks to be released
+const std::chrono::seconds ShmSpillSegmentIdleTime(10);
+
+static std::string shmSegmentName(const std::string& mappingName, uint32_t index) {
+    return (index == 0) ? mappingName : (mappingName + "_" + std::to_string(index));
+}
+
 class CShmMapping : public IShmMapping {
 public:
     CShmMapping(const char* name)
-        :m_heap(new TManagedSharedMemory(boost::interprocess::open_read_only, (ShmNamePrefix + name).c_str()))
+        : m_mappingName(ShmNamePrefix + name)
+        , m_heap(new TManagedSharedMemory(boost::interprocess::open_read_only, m_mappingName.c_str()))
     {
     }
+    virtual bool Contains(void* ptr) {
+        if (m_heap->belongs_to_segment(ptr))
+            return true;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto& s : m_segments) {
+            auto heap(s.second.weak.lock());
+            if (heap && heap->belongs_to_segment(ptr))
+                return true;
+        }
+        return false;
+    }
     virtual uint64_t FromPointer(void* ptr) {
-        return (uint64_t)m_heap->get_handle_from_address(ptr);
+        if (m_heap->belongs_to_segment(ptr))
+            return (uint64_t)m_heap->get_handle_from_address(ptr);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto& s : m_segments) {
+            auto heap(s.second.weak.lock());
+            if (heap && heap->belongs_to_segment(ptr))
+                return (uint64_t(s.first) << SegmentIndexShift) | (uint64_t)heap->get_handle_from_address(ptr);
+        }
+        throw std::runtime_error("CShmMapping::FromPointer(): given pointer does not belong to this mapping");
     }
     virtual void* ToPointer(uint64_t offset) {
-        return m_heap->get_address_from_handle((ptrdiff_t)offset);
+        const uint32_t index = uint32_t(offset >> SegmentIndexShift);
+        if (index == 0)
+            return m_heap->get_address_from_handle((ptrdiff_t)offset);
+        return segment(index)->get_address_from_handle((ptrdiff_t)(offset & SegmentOffsetMask));
+    }
+    virtual std::shared_ptr<void> Retain(uint64_t offset) {
+        const uint32_t index = uint32_t(offset >> SegmentIndexShift);
+        if (index == 0)
+            return m_heap;
+        return segment(index);
     }
 private:
+    // Spillover segments are mapped on first use. The mapping keeps them for a while after last use,
+    // afterwards they stay mapped only while retained by received samples.
+    std::shared_ptr<TManagedSharedMemory> segment(uint32_t index) {
+        const auto now = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto& s : m_segments) {
+            if (s.second.heap && now - s.second.lastUsed > ShmSegmentKeepTime)
+                s.second.heap.reset();
+        }
+        SSegment& s = m_segments[index];
+        s.lastUsed = now;
+        if (!s.heap)
+            s.heap = s.weak.lock();
+        if (!s.heap) {
+            s.heap.reset(new TManagedSharedMemory(boost::interprocess::open_read_only, shmSegmentName(m_mappingName, index).c_str()));
+            s.weak = s.heap;
+        }
+        return s.heap;
+    }
+    const std::string m_mappingName;
     std::shared_ptr<TManagedSharedMemory> m_heap;
+    struct SSegment {
+        std::shared_ptr<TManagedSharedMemory> heap;
+        std::weak_ptr<TManagedSharedMemory> weak;
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+    std::mutex m_mutex;
+    std::map<uint32_t, SSegment> m_segments;
+};
+
+// Shared memory arena which consists of the primary segment, same as that of CShmAllocator,
+// and of spillover segments "<primary segment name>_N" which are created on demand when
+// the primary segment is exhausted, typically because of slow clients holding frames.
+// Spillover segments are released after they have no allocated blocks for a while.
+// Allocations are served from the segments with lowest numbers first, so that spillover
+// segments get drained. Segment number N is kept in upper bits of offsets; numbers
+// are not reused, hence a client can map new segments lazily by just their offsets.
+class CShmArenaAllocator : public IShmAllocator {
+public:
+    CShmArenaAllocator(const char* name, int segmentSizeMB, int maxSpillSegments)
+        : m_state(std::make_shared<SState>())
+    {
+        m_state->mappingName = ShmNamePrefix + name;
+        m_state->segmentSize = 1024 * 1024 * segmentSizeMB;
+        m_state->maxSpillSegments = maxSpillSegments;
+        m_state->segments.push_back(std::make_shared<SSegment>(0, m_state->mappingName, m_state->segmentSize));
+    }
+    CShmArenaAllocator(CShmArenaAllocator* dup)
+        : m_state(dup->m_state)
+    {
+    }
+    virtual std::shared_ptr<uint8_t> Alloc(int size) {
+        std::shared_ptr<uint8_t> res;
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        m_state->releaseIdle();
+        for (auto& segment : m_state->segments) {
+            res = segment->alloc(size);
+            if (res)
+                return res;
+        }
+        if (m_state->segments.size() <= size_t(m_state->maxSpillSegments)) {
+            try {
+                auto segment(std::make_shared<SSegment>(m_state->nextIndex++, m_state->mappingName, m_state->segmentSize));
+                m_state->segments.push_back(segment);
+                VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "CShmArenaAllocator::Alloc(): created spillover segment "
+                    << segment->name << ", " << m_state->segments.size() - 1 << " spillover segments in use";
+                res = segment->alloc(size);
+            }
+            catch (const boost::interprocess::interprocess_exception& e) {
+                VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "CShmArenaAllocator::Alloc(): failed to create a spillover segment: " << e.what();
+            }
+        }
+        return res;
+    }
+    virtual bool Contains(void* ptr) {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        for (auto& segment : m_state->segments) {
+            if (segment->heap->belongs_to_segment(ptr))
+                return true;
+        }
+        return false;
+    }
+    virtual uint64_t FromPointer(void* ptr) {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        for (auto& segment : m_state->segments) {
+            if (segment->heap->belongs_to_segment(ptr))
+                return (uint64_t(segment->index) << SegmentIndexShift) | (uint64_t)segment->heap->get_handle_from_address(ptr);
+        }
+        throw std::runtime_error("CShmArenaAllocator::FromPointer(): given pointer does not belong to this allocator");
+    }
+    virtual void* ToPointer(uint64_t offset) {
+        auto segment(m_state->find(uint32_t(offset >> SegmentIndexShift)));
+        return segment ? segment->heap->get_address_from_handle((ptrdiff_t)(offset & SegmentOffsetMask)) : nullptr;
+    }
+    virtual std::shared_ptr<void> Retain(uint64_t offset) {
+        return m_state->find(uint32_t(offset >> SegmentIndexShift));
+    }
+    virtual IShmAllocator* Dup() {
+        return new CShmArenaAllocator(this);
+    }
+private:
+    struct SSegment : public std::enable_shared_from_this<SSegment> {
+        SSegment(uint32_t index, const std::string& mappingName, uint32_t size)
+            : index(index)
+            , name(shmSegmentName(mappingName, index))
+            , heap(createShmSegment(name, size))
+            , idleSince(std::chrono::steady_clock::now().time_since_epoch().count())
+        {
+        }
+        ~SSegment() {
+            heap.reset();
+#ifndef _WIN32
+            if (index != 0)
+                boost::interprocess::shared_memory_object::remove(name.c_str());
+#endif
+        }
+        std::shared_ptr<uint8_t> alloc(int size) {
+            std::shared_ptr<uint8_t> res;
+            try {
+                uint8_t* ptr = (uint8_t*)heap->allocate_aligned(size, 16);
+                ++allocated;
+                auto self(shared_from_this()); // blocks given away keep the segment
+                res.reset(ptr, [self](uint8_t* p) {
+                    self->heap->deallocate(p);
+                    if (--self->allocated == 0)
+                        self->idleSince = std::chrono::steady_clock::now().time_since_epoch().count();
+                });
+            }
+            catch (const boost::interprocess::bad_alloc&) {
+            }
+            return res;
+        }
+        const uint32_t index;
+        const std::string name;
+        std::shared_ptr<TManagedSharedMemory> heap;
+        std::atomic<int> allocated{ 0 };
+        std::atomic<int64_t> idleSince;
+    };
+    typedef std::shared_ptr<SSegment> PSegment;
+
+    struct SState {
+        std::string mappingName;
+        uint32_t segmentSize = 0;
+        int maxSpillSegments = 0;
+        uint32_t nextIndex = 1;
+        std::mutex mutex;
+        std::vector<PSegment> segments;
+        std::chrono::steady_clock::time_point lastReleaseCheck;
+
+        PSegment find(uint32_t index) {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (auto& segment : segments)
+                if (segment->index == index)
+                    return segment;
+            return PSegment();
+        }
+        // called with the mutex held
+        void releaseIdle() {
+            const auto now = std::chrono::steady_clock::now();
+            if (segments.size() == 1 || now - lastReleaseCheck < std::chrono::seconds(1))
+                return;
+            lastReleaseCheck = now;
+            for (auto it = segments.begin() + 1; it != segments.end();) {
+                auto& segment = *it;
+                const std::chrono::steady_clock::time_point idleSince(std::chrono::steady_clock::duration(segment->idleSince));
+                if (segment->allocated == 0 && now - idleSince > ShmSpillSegmentIdleTime) {
+                    VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "CShmArenaAllocator: releasing idle spillover segment " << segment->name;
+                    it = segments.erase(it);
+                }
+                else
+                    ++it;
+            }
+        }
+    };
+    std::shared_ptr<SState> m_state;
+public:
+    static const int DefaultMaxSpillSegments = 8;
 };
 
+// Shared memory allocator for frames of a few fixed sizes, which avoids the interprocess
+// mutex of the managed segment on the hot path. Segment memory is carved into slabs
+// of blocks of one size class; free blocks are kept in lock-free per-class lists,
+// and each thread additionally caches a few released blocks in its own magazine.
+// Blocks are never returned to the segment heap. Since blocks reside in the same
+// managed segment, offsets are the same as those of CShmAllocator, and the segment
+// can be opened by CShmMapping on the client side.
+class CShmSlabAllocator : public IShmAllocator {
+public:
+    CShmSlabAllocator(const char* name, int maxSizeMB)
+        : m_state(std::make_shared<SState>())
+    {
+        m_state->heap = createShmSegment(ShmNamePrefix + name, 1024 * 1024 * maxSizeMB);
+        m_state->base = (uint8_t*)m_state->heap->get_address();
+        m_state->self = m_state;
+    }
+    CShmSlabAllocator(CShmSlabAllocator* dup)
+        : m_state(dup->m_state)
+    {
+    }
+    virtual std::shared_ptr<uint8_t> Alloc(int size) {
+        std::shared_ptr<uint8_t> res;
+        if (size <= 0)
+            return res;
+        const int cls = sizeClassIndex(size);
+        uint8_t* ptr = m_state->take(cls);
+        if (ptr != nullptr) {
+            auto state(m_state);
+            res.reset(ptr, [state, cls](uint8_t* p) { state->give(p, cls); });
+        }
+        return res;
+    }
+    virtual bool Contains(void* ptr) {
+        return m_state->heap->belongs_to_segment(ptr);
+    }
+    virtual uint64_t FromPointer(void* ptr) {
+        if (!m_state->heap->belongs_to_segment(ptr)) {
+            throw std::runtime_error("CShmSlabAllocator::FromPointer(): given pointer does not belong to this allocator");
+        }
+        return (uint64_t)m_state->heap->get_handle_from_address(ptr);
+    }
+    virtual void* ToPointer(uint64_t offset) {
+        return m_state->heap->get_address_from_handle((ptrdiff_t)offset);
+    }
+    virtual std::shared_ptr<void> Retain(uint64_t offset) {
+        return m_state->heap;
+    }
+    virtual IShmAllocator* Dup() {
+        return new CShmSlabAllocator(this);
+    }
+private:
+    static const size_t SlabBytes = 16 * 1024 * 1024;
+    static const int MaxBlocksPerSlab = 64;
+    static const size_t MagazineBytes = 8 * 1024 * 1024;
+    static const size_t MaxBlocksPerMagazine = 16;
+
+    static size_t magazineCapacity(int cls) {
+        const size_t maxBlocks = MaxBlocksPerMagazine;
+        return std::min(maxBlocks, MagazineBytes / sizeClassBytes(cls));
+    }
+
+    struct SState;
+    // released blocks cached by a thread, per allocator and size class
+    struct SThreadCache {
+        std::weak_ptr<SState> owner;
+        std::map<int, std::vector<uint8_t*>> blocks;
+    };
+    struct SThreadCaches {
+        std::map<SState*, SThreadCache> caches;
+        ~SThreadCaches() {
+            for (auto& c : caches) {
+                auto state(c.second.owner.lock());
+                if (!state)
+                    continue;
+                for (auto& b : c.second.blocks)
+                    for (uint8_t* ptr : b.second)
+                        state->push(b.first, ptr, ptr);
+            }
+        }
+        SState* lastState = nullptr;
+        SThreadCache* lastCache = nullptr;
+        SThreadCache& get(SState* state) {
+            if (state == lastState && !lastCache->owner.expired())
+                return *lastCache;
+            if (caches.find(state) == caches.end()) {
+                for (auto it = caches.begin(); it != caches.end();) {
+                    if (it->second.owner.expired())
+                        it = caches.erase(it);
+                    else
+                        ++it;
+                }
+            }
+            SThreadCache& c = caches[state];
+            if (c.owner.expired()) { // either a new entry or a stale one for the same address
+                c.owner = state->self;
+                c.blocks.clear();
+            }
+            lastState = state;
+            lastCache = &c;
+            return c;
+        }
+    };
+    static SThreadCaches& threadCaches() {
+        thread_local SThreadCaches caches;
+        return caches;
+    }
+
+    // Free lists are Treiber stacks of blocks. A list head keeps the offset of the first
+    // block from segment base plus one (zero means empty list) in the lower half,
+    // and a modification counter preventing ABA in the upper half. Links are kept
+    // in the first bytes of free blocks in the same encoding.
+    struct SState {
+        std::weak_ptr<SState> self;
+        std::shared_ptr<TManagedSharedMemory> heap;
+        uint8_t* base = nullptr;
+        std::atomic<uint64_t> free[NumSizeClasses];
+        std::mutex refillMutex;
+
+        SState() {
+            for (auto& f : free)
+                f.store(0, std::memory_order_relaxed);
+        }
+        uint32_t link(uint8_t* ptr) {
+            return uint32_t(ptr - base + 1);
+        }
+        void push(int cls, uint8_t* first, uint8_t* last) {
+            uint64_t head = free[cls].load(std::memory_order_relaxed);
+            uint64_t next;
+            do {
+                *reinterpret_cast<volatile uint32_t*>(last) = uint32_t(head);
+                next = (((head >> 32) + 1) << 32) | link(first);
+            } while (!free[cls].compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+        }
+        uint8_t* pop(int cls) {
+            uint64_t head = free[cls].load(std::memory_order_acquire);
+            while (uint32_t(head) != 0) {
+                uint8_t* ptr = base + (uint32_t(head) - 1);
+                // the block may get popped and overwritten concurrently, in which case CAS fails
+                const uint32_t link = *reinterpret_cast<volatile uint32_t*>(ptr);
+                const uint64_t next = (((head >> 32) + 1) << 32) | link;
+                if (free[cls].compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+                    return ptr;
+            }
+            return nullptr;
+        }
+        // carve a new slab out of the segment, keep one block and put the rest into the free list
+        uint8_t* refill(int cls) {
+            std::unique_lock<std::mutex> lock(refillMutex);
+            uint8_t* ptr = pop(cls); // someone could have refilled it while we were waiting
+            if (ptr != nullptr)
+                return ptr;
+            const size_t blockSize = sizeClassBytes(cls);
+            const size_t maxBlocks = MaxBlocksPerSlab;
+            size_t nblocks = std::max<size_t>(1, std::min(maxBlocks, SlabBytes / blockSize));
+            for (; nblocks > 0; nblocks /= 2) {
+                try {
+                    ptr = (uint8_t*)heap->allocate_aligned(nblocks * blockSize, 16);
+                    break;
+                }
+                catch (const boost::interprocess::bad_alloc&) {
+                }
+            }
+            if (ptr == nullptr) {
+                VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "CShmSlabAllocator::Alloc() failed to allocate a slab of blocks of " << blockSize << " bytes";
+                return nullptr;
+            }
+            if (nblocks > 1) {
+                for (size_t k = 1; k < nblocks - 1; ++k)
+                    *reinterpret_cast<uint32_t*>(ptr + k * blockSize) = link(ptr + (k + 1) * blockSize);
+                push(cls, ptr + blockSize, ptr + (nblocks - 1) * blockSize);
+            }
+            return ptr;
+        }
+        uint8_t* take(int cls) {
+            if (magazineCapacity(cls) > 0) {
+                auto& magazine = threadCaches().get(this).blocks[cls];
+                if (!magazine.empty()) {
+                    uint8_t* ptr = magazine.back();
+                    magazine.pop_back();
+                    return ptr;
+                }
+            }
+            uint8_t* ptr = pop(cls);
+            if (ptr == nullptr)
+                ptr = refill(cls);
+            return ptr;
+        }
+        void give(uint8_t* ptr, int cls) {
+            const size_t capacity = magazineCapacity(cls);
+            if (capacity > 0) {
+                auto& magazine = threadCaches().get(this).blocks[cls];
+                if (magazine.size() < capacity) {
+                    magazine.push_back(ptr);
+                    return;
+                }
+            }
+            push(cls, ptr, ptr);
+        }
+    };
+    std::shared_ptr<SState> m_state;
+};
+
+// Maintains allocator counters for a shared memory allocator, whichever implementation it is.
+class CCountingShmAllocator : public IShmAllocator {
+public:
+    CCountingShmAllocator(IShmAllocator* allocator, const std::string& name)
+        : m_allocator(allocator)
+        , m_counters(registerAllocatorCounters(name))
+    {
+    }
+    CCountingShmAllocator(CCountingShmAllocator* dup)
+        : m_allocator(dup->m_allocator->Dup())
+        , m_counters(dup->m_counters)
+    {
+    }
+    virtual std::shared_ptr<uint8_t> Alloc(int size) {
+        std::shared_ptr<uint8_t> res(m_allocator->Alloc(size));
+        if (!res) {
+            m_counters->Failure();
+            return res;
+        }
+        m_counters->Alloc(size);
+        uint8_t* ptr = res.get();
+        auto counters(m_counters);
+        return std::shared_ptr<uint8_t>(ptr, [res, counters, size](uint8_t*) mutable { res.reset(); counters->Free(size); },
+            CSmallObjectAllocator<uint8_t>());
+    }
+    virtual bool Contains(void* ptr) {
+        return m_allocator->Contains(ptr);
+    }
+    virtual uint64_t FromPointer(void* ptr) {
+        return m_allocator->FromPointer(ptr);
+    }
+    virtual void* ToPointer(uint64_t offset) {
+        return m_allocator->ToPointer(offset);
+    }
+    virtual std::shared_ptr<void> Retain(uint64_t offset) {
+        return m_allocator->Retain(offset);
+    }
+    virtual IShmAllocator* Dup() {
+        return new CCountingShmAllocator(this);
+    }
+private:
+    std::unique_ptr<IShmAllocator> m_allocator;
+    PAllocatorCounters m_counters;
+};
 
 IShmAllocator *CreateShmAllocator(const char* name, int maxSizeMB) {
-    return new CShmAllocator(name, maxSizeMB);
+    const char* const shmAllocatorEnv = getenv("VNX_SHM_ALLOCATOR");
+    if (shmAllocatorEnv != nullptr && std::string("slab") == shmAllocatorEnv)
+        return CreateShmSlabAllocator(name, maxSizeMB);
+    if (shmAllocatorEnv != nullptr && std::string("arena") == shmAllocatorEnv) {
+        int maxSpillSegments = CShmArenaAllocator::DefaultMaxSpillSegments;
+        const char* const maxSpillSegmentsEnv = getenv("VNX_SHM_MAX_SPILL_SEGMENTS");
+        if (maxSpillSegmentsEnv != nullptr)
+            maxSpillSegments = std::max(0, atoi(maxSpillSegmentsEnv));
+        return CreateShmArenaAllocator(name, maxSizeMB, maxSpillSegments);
+    }
+    return new CCountingShmAllocator(new CShmAllocator(name, maxSizeMB), std::string("shm:") + name);
+}
+
+IShmAllocator *CreateShmSlabAllocator(const char* name, int maxSizeMB) {
+    return new CCountingShmAllocator(new CShmSlabAllocator(name, maxSizeMB), std::string("shm_slab:") + name);
+}
+
+IShmAllocator *CreateShmArenaAllocator(const char* name, int segmentSizeMB, int maxSpillSegments) {
+    return new CCountingShmAllocator(new CShmArenaAllocator(name, segmentSizeMB, maxSpillSegments), std::string("shm_arena:") + name);
 }
 
 IShmMapping* CreateShmMapping(const char* name) {
@@ -141,6 +1211,12 @@ PShmAllocator DupPreferredShmAllocator() {
         return PShmAllocator();
 }
 
+void PrewarmFramePool(ERawMediaFormat emf, int width, int height, int count) {
+    if (g_preferredAllocator != nullptr || width <= 0 || height <= 0)
+        return;
+    g_framePoolAllocatorImpl.Prewarm(CRawSample::AllocationSize(emf, width, height), count);
+}
+
 namespace VnxVideo {
     void WithPreferredShmAllocator(const char* name, int maxSizeMB, std::function<void(void)> action) {
         PShmAllocator allocator(CreateShmAllocator(name, maxSizeMB));
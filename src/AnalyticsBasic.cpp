@@ -10,6 +10,7 @@ using json = nlohmann::json;
 #include "vnxvideoimpl.h"
 #include "vnxvideologimpl.h"
 #include "GrayAnalyticsBase.h"
+#include "EventTrace.h"
 
 #include <ipp/ipp.h>
 #include <ipp/ippi.h>
@@ -98,6 +99,7 @@ protected:
             m_width, m_height, AV_PIX_FMT_GRAY8, SWS_POINT, nullptr, nullptr, nullptr), sws_freeContext);
     }
     virtual void process(uint8_t* data, int width, int stride, int height, uint64_t timestamp) {
+        VNXVIDEO_TRACE_SCOPE("analytics.process");
         //auto b = ippGetCpuClocks();
         
         //VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "timestamp diff: " << timestamp - m_status.timestamp;
@@ -1,111 +1,309 @@
 #include <mutex>
 #include <condition_variable>
+#include <deque>
+#include <algorithm>
 #include <thread>
+#include <memory>
+#include <typeinfo>
 
 #include "vnxvideoimpl.h"
 #include "vnxvideologimpl.h"
+#include "RawSample.h"
+#include "Executor.h"
+#include "FrameTrace.h"
+#include "EventTrace.h"
+#include "jget.h"
 
-class CAsyncProc : public virtual VnxVideo::IRawProc {
+class CAsyncProc : public virtual VnxVideo::IRawProc, public virtual VnxVideo::IAsyncQueue {
 public:
-    CAsyncProc(VnxVideo::PRawProc proc)
+    CAsyncProc(VnxVideo::PRawProc proc, const VnxVideo::SAsyncQueueConfig& config = VnxVideo::SAsyncQueueConfig())
         : m_impl(proc)
+        , m_config(config)
         , m_busy(false)
         , m_continue(true)
+        , m_scheduled(false)
+        , m_abandoned(std::make_shared<bool>(false))
+        , m_delivered(0)
+        , m_maxQueued(0)
+        , m_processed(0)
+        , m_dropped(0)
+        , m_blocked(0)
+        , m_expired(0)
+        , m_latency(GetLatencyHistogram("async"))
     {
-        m_thread=std::move(std::thread(&CAsyncProc::processThread, this));
+        m_config.depth = std::max(1, m_config.depth);
     }
     void SetFormat(EColorspace csp, int width, int height) {
         std::unique_lock<std::mutex> lock(m_mutex);
-        while (m_continue && m_busy)
+        // samples queued in the previous format go first
+        while (m_continue && (m_busy || !m_queue.empty()))
             m_cond.wait_for(lock, std::chrono::milliseconds(200));
 
         if(!m_continue)
             return;
         m_busy = true;
+        m_busyThread = std::this_thread::get_id();
+        VnxVideo::PRawProc impl(m_impl);
+        std::shared_ptr<bool> abandoned(m_abandoned);
         lock.unlock();
 
-        m_impl->SetFormat(csp, width, height);
+        impl->SetFormat(csp, width, height);
+        if (*abandoned)
+            return;
         lock.lock();
         m_busy = false;
+        schedule();
         m_cond.notify_all();
     }
     void Process(VnxVideo::IRawSample* sample, uint64_t timestamp) {
         std::unique_lock<std::mutex> lock(m_mutex);
         if(!m_continue)
             return;
-        m_sample.reset(sample->Dup());
-        m_timestamp = timestamp;
-        m_cond.notify_all();
+        // the new sample takes the last place once there is room for it
+        if ((int)m_queue.size() >= m_config.depth && !makeRoom(lock, isReference(m_config.depth - 1))) {
+            ++m_dropped;
+            return;
+        }
+        if (!m_continue)
+            return;
+        SQueuedSample q;
+        // a plain sample is queued as a handle of its frame, which takes no allocation;
+        // others keep their own type, like samples which memoize conversions do
+        if (typeid(*sample) == typeid(CRawSample))
+            q.frame = static_cast<CRawSample*>(sample)->GetFrame();
+        else
+            q.sample = MakeRawSamplePtr(sample->Dup());
+        q.timestamp = timestamp;
+        q.reference = isReference(m_queue.size());
+        m_queue.push_back(q);
+        m_maxQueued = std::max(m_maxQueued, (int)m_queue.size());
+        schedule();
     }
     void Flush() {
         std::unique_lock<std::mutex> lock(m_mutex);
-        while (m_continue && m_busy)
+        while (m_continue && (m_busy || !m_queue.empty()))
             m_cond.wait_for(lock, std::chrono::milliseconds(200));
         if (!m_continue)
             return;
 
         m_busy = true;
+        m_busyThread = std::this_thread::get_id();
+        VnxVideo::PRawProc impl(m_impl);
+        std::shared_ptr<bool> abandoned(m_abandoned);
 
         lock.unlock();
-        m_impl->Flush();
+        impl->Flush();
+        if (*abandoned)
+            return;
 
         lock.lock();
         m_busy = false;
+        schedule();
         m_cond.notify_all();
     }
+    VnxVideo::SAsyncQueueStats GetQueueStats() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        VnxVideo::SAsyncQueueStats stats;
+        stats.depth = m_config.depth;
+        stats.queued = (int)m_queue.size();
+        stats.maxQueued = m_maxQueued;
+        stats.processed = m_processed;
+        stats.dropped = m_dropped;
+        stats.blocked = m_blocked;
+        stats.expired = m_expired;
+        return stats;
+    }
     ~CAsyncProc() {
         std::unique_lock<std::mutex> lock(m_mutex);
         m_continue = false;
         m_cond.notify_all();
-        while(m_busy)
-            m_cond.wait(lock);
-        lock.unlock();
-        if(m_thread.get_id()!=std::this_thread::get_id())
-            m_thread.join();
+        if (m_busy && m_busyThread == std::this_thread::get_id()) {
+            // destroyed from within a call to m_impl, e.g. by an output callback: that call is on this very stack
+            // and would never finish if waited for, so it is told to return without touching the instance
+            *m_abandoned = true;
+            return;
+        }
+        // a worker might have the posted task of this instance in its own queue, so it runs pending tasks meanwhile
+        const bool worker = ExecutorIsWorkerThread();
+        while (m_busy || m_scheduled) {
+            if (worker) {
+                lock.unlock();
+                const bool helped = ExecutorHelp();
+                lock.lock();
+                if (!helped)
+                    m_cond.wait_for(lock, std::chrono::milliseconds(1));
+            }
+            else
+                m_cond.wait(lock);
+        }
     }
 protected:
-    void processThread() {
+    // whether the sample at the given place in the queue is going to be a reference one,
+    // counting the samples which actually reach m_impl, like the encoder counts its GOP
+    bool isReference(size_t place) const {
+        return m_config.referenceInterval > 0 && 0 == ((m_delivered + place) % m_config.referenceInterval);
+    }
+    // a sample dropped from the queue shifts the places of those behind it
+    void reflag() {
+        for (size_t k = 0; k < m_queue.size(); ++k)
+            m_queue[k].reference = isReference(k);
+    }
+    // frees a slot in the full queue according to the policy; false if the new sample should be dropped instead
+    bool makeRoom(std::unique_lock<std::mutex>& lock, bool reference) {
+        switch (m_config.policy) {
+        case VnxVideo::EADP_DROP_NEWEST:
+            return false;
+        case VnxVideo::EADP_DROP_NON_REFERENCE:
+            if (!reference)
+                return false;
+            for (auto q = m_queue.rbegin(); q != m_queue.rend(); ++q) {
+                if (!q->reference) {
+                    m_queue.erase(std::next(q).base());
+                    ++m_dropped;
+                    reflag();
+                    return true;
+                }
+            }
+            m_queue.pop_front();
+            ++m_dropped;
+            reflag();
+            return true;
+        case VnxVideo::EADP_BLOCK: {
+            ++m_blocked;
+            auto full = [this]() { return m_continue && (int)m_queue.size() >= m_config.depth; };
+            const bool timed = m_config.blockTimeoutMs > 0;
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_config.blockTimeoutMs);
+            // an executor worker waiting here might hold up the very task which would free the slot,
+            // so it runs pending tasks meanwhile instead of just sleeping
+            const bool worker = ExecutorIsWorkerThread();
+            while (full()) {
+                if (timed && std::chrono::steady_clock::now() >= deadline)
+                    break;
+                if (worker) {
+                    lock.unlock();
+                    const bool helped = ExecutorHelp();
+                    lock.lock();
+                    if (!helped)
+                        m_cond.wait_for(lock, std::chrono::milliseconds(1));
+                }
+                else if (timed)
+                    m_cond.wait_until(lock, deadline);
+                else
+                    m_cond.wait(lock);
+            }
+            return !full();
+        }
+        case VnxVideo::EADP_DROP_OLDEST:
+        default:
+            m_queue.pop_front();
+            ++m_dropped;
+            reflag();
+            return true;
+        }
+    }
+    // posts a task to process the next sample, unless there's one posted or running already,
+    // so that samples of the instance are processed one at a time and in order
+    void schedule() {
+        if (!m_continue || m_busy || m_scheduled || m_queue.empty())
+            return;
+        m_scheduled = true;
+        ExecutorPost([this]() { processNext(); });
+    }
+    void processNext() {
         std::unique_lock<std::mutex> lock(m_mutex);
-        while (m_continue) {
-            while (m_continue && (m_sample.get() == nullptr || m_busy))
-                m_cond.wait(lock);
-            if (!m_continue)
-                break;
+        if (!m_continue || m_busy || m_queue.empty()) {
+            // SetFormat or Flush took over, and will schedule when done
+            m_scheduled = false;
+            m_cond.notify_all();
+            return;
+        }
+
+        m_busy = true;
+        m_busyThread = std::this_thread::get_id();
+        VnxVideo::PRawProc impl(m_impl);
+        std::shared_ptr<bool> abandoned(m_abandoned);
+        SQueuedSample q(m_queue.front());
+        m_queue.pop_front();
+        m_cond.notify_all(); // there is a free slot
+        bool expired;
+        {
+            CRawSample frameSample(q.frame); // adapts the frame handle, unless the sample was queued as it is
+            VnxVideo::IRawSample* const sample = q.sample ? q.sample.get() : &frameSample;
+            // the sample could have waited too long for anyone to need the result
+            expired = IsFrameExpired(sample, q.timestamp, m_config.maxAgeMs);
+            if (expired)
+                reflag();
+            else
+                ++m_delivered;
 
-            m_busy = true;
-            VnxVideo::PRawSample sample(m_sample);
-            uint64_t timestamp(m_timestamp);
-            m_sample.reset();
-            
             lock.unlock();
-            m_impl->Process(sample.get(), timestamp);
-            
-            lock.lock();
-            m_busy = false;
-            m_cond.notify_all();
+            if (expired)
+                RecordFrameExpired(m_latency);
+            else {
+                RecordFrameLatency(m_latency, sample); // including the time spent in the queue
+                try {
+                    VNXVIDEO_TRACE_SCOPE("async.process");
+                    impl->Process(sample, q.timestamp);
+                }
+                catch (const std::exception& e) {
+                    VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CAsyncProc: Exception while processing a sample: " << e.what();
+                }
+            }
+            q.sample.reset();
+            q.frame = SRawFrame();
         }
+        if (*abandoned)
+            return;
+
+        lock.lock();
+        if (expired)
+            ++m_expired;
+        else
+            ++m_processed;
+        m_busy = false;
+        m_scheduled = false;
+        schedule();
+        m_cond.notify_all();
     }
 protected:
     VnxVideo::PRawProc m_impl;
+    VnxVideo::SAsyncQueueConfig m_config;
     std::condition_variable m_cond;
     std::mutex m_mutex;
     bool m_busy;
     bool m_continue;
-    std::thread m_thread;
+    bool m_scheduled; // a task to process the next sample is posted to the executor
+    std::thread::id m_busyThread; // the one calling m_impl while m_busy is set
+    // set, on m_busyThread, by the destructor called from within m_impl; the call then returns right away,
+    // holding its own references to this flag and to m_impl
+    std::shared_ptr<bool> m_abandoned;
+
+    // samples waiting for processing, with their timestamps
+    struct SQueuedSample {
+        VnxVideo::PRawSample sample; // unless the frame is queued as a handle
+        SRawFrame frame;
+        uint64_t timestamp;
+        bool reference;
+    };
+    std::deque<SQueuedSample> m_queue;
+    uint64_t m_delivered; // number of samples passed to m_impl or about to be, to tell reference ones
 
-    // next sample for processing and its timestamp
-    VnxVideo::PRawSample m_sample;
-    uint64_t m_timestamp;
+    int m_maxQueued;
+    uint64_t m_processed;
+    uint64_t m_dropped;
+    uint64_t m_blocked;
+    uint64_t m_expired;
+    CLatencyHistogram* const m_latency;
 };
 
 #pragma warning(push)
 #ifdef _MSC_VER
 #pragma warning(disable: 4250) // method xxx is inherited via dominance, which is exactly what we want
 #endif
-class CAsyncTransform: public VnxVideo::IRawTransform, private CAsyncProc {
+class CAsyncTransform: public VnxVideo::IRawTransform, public virtual VnxVideo::IAsyncQueue, private CAsyncProc {
 public:
-    CAsyncTransform(VnxVideo::PRawTransform tform) 
-        : CAsyncProc(tform)
+    CAsyncTransform(VnxVideo::PRawTransform tform, const VnxVideo::SAsyncQueueConfig& config)
+        : CAsyncProc(tform, config)
         , m_impl(tform)
     {
     }
@@ -128,10 +326,10 @@ private:
     VnxVideo::PRawTransform m_impl;
 };
 
-class CAsyncVideoEncoder : public VnxVideo::IMediaEncoder, private CAsyncProc {
+class CAsyncVideoEncoder : public VnxVideo::IMediaEncoder, public virtual VnxVideo::IAsyncQueue, private CAsyncProc {
 public:
-    CAsyncVideoEncoder(VnxVideo::PMediaEncoder enc)
-        : CAsyncProc(enc)
+    CAsyncVideoEncoder(VnxVideo::PMediaEncoder enc, const VnxVideo::SAsyncQueueConfig& config)
+        : CAsyncProc(enc, config)
         , m_impl(enc)
     {
     }
@@ -157,9 +355,41 @@ private:
 
 namespace VnxVideo {
     IRawTransform* CreateAsyncTransform(PRawTransform tform) {
-        return new CAsyncTransform(tform);
+        return new CAsyncTransform(tform, SAsyncQueueConfig());
+    }
+    IRawTransform* CreateAsyncTransform(PRawTransform tform, const SAsyncQueueConfig& config) {
+        return new CAsyncTransform(tform, config);
+    }
+    IRawProc* CreateAsyncProc(PRawProc proc, const SAsyncQueueConfig& config) {
+        return new CAsyncProc(proc, config);
     }
     IMediaEncoder* CreateAsyncVideoEncoder(PMediaEncoder enc) {
-        return new CAsyncVideoEncoder(enc);
+        return new CAsyncVideoEncoder(enc, SAsyncQueueConfig());
+    }
+    IMediaEncoder* CreateAsyncVideoEncoder(PMediaEncoder enc, const SAsyncQueueConfig& config) {
+        return new CAsyncVideoEncoder(enc, config);
+    }
+    SAsyncQueueConfig ParseAsyncQueueConfig(const nlohmann::json& config, const SAsyncQueueConfig& defaults) {
+        SAsyncQueueConfig res(defaults);
+        res.depth = jget<int>(config, "depth", defaults.depth);
+        res.blockTimeoutMs = jget<int>(config, "block_timeout_ms", defaults.blockTimeoutMs);
+        res.referenceInterval = jget<int>(config, "reference_interval", defaults.referenceInterval);
+        res.maxAgeMs = jget<int>(config, "max_age_ms", defaults.maxAgeMs);
+        std::string policy(jget<std::string>(config, "policy"));
+        if (policy == "drop_oldest")
+            res.policy = EADP_DROP_OLDEST;
+        else if (policy == "drop_newest")
+            res.policy = EADP_DROP_NEWEST;
+        else if (policy == "drop_non_reference")
+            res.policy = EADP_DROP_NON_REFERENCE;
+        else if (policy == "block")
+            res.policy = EADP_BLOCK;
+        else if (!policy.empty())
+            throw std::runtime_error("unknown async queue policy: " + policy);
+        if (res.depth < 1)
+            throw std::runtime_error("async queue depth should be positive");
+        if (res.maxAgeMs < 0)
+            throw std::runtime_error("async queue max_age_ms should not be negative");
+        return res;
     }
 }
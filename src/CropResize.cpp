@@ -1,3 +1,6 @@
+#include <mutex>
+#include <vector>
+
 #include "vnxipp.h"
 
 extern "C" {
@@ -9,6 +12,7 @@ extern "C" {
 
 #include "FFmpegUtils.h"
 #include "RawSample.h"
+#include "FrameTrace.h"
 
 int vnxvideo_raw_sample_crop_resize(vnxvideo_raw_sample_t in,
     int roi_left, int roi_top, int roi_width, int roi_height, 
@@ -55,8 +59,8 @@ int vnxvideo_raw_sample_crop_resize(vnxvideo_raw_sample_t in,
         }
     }
     else { // size does not match, resize image
-        std::shared_ptr<SwsContext> ctx(sws_getContext(roi_width, roi_height, toAVPixelFormat(csp),
-            target_width, target_height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr), sws_freeContext);
+        std::shared_ptr<SwsContext> ctx(getCachedSwsContext(roi_width, roi_height, toAVPixelFormat(csp),
+            target_width, target_height, AV_PIX_FMT_YUV420P, SWS_BILINEAR));
         const uint8_t* srcs[4] = { 0,0,0,0 };
         if(csp==EMF_I420) {
             srcs[0] = planesSrc[0] + roi_left + roi_top*stridesSrc[0];
@@ -94,6 +98,31 @@ int vnxvideo_raw_sample_select_roi(vnxvideo_raw_sample_t in,
     }
 }
 
+int vnxvideo_raw_sample_convert_on_demand(vnxvideo_raw_sample_t in, vnxvideo_raw_sample_t* out) {
+    auto s = reinterpret_cast<VnxVideo::IRawSample*>(in.ptr);
+    try {
+        out->ptr = VnxVideo::ConvertOnDemand(s);
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "vnxvideo_raw_sample_convert_on_demand: exception: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+
+int vnxvideo_raw_sample_convert(vnxvideo_raw_sample_t in, EColorspace csp, vnxvideo_raw_sample_t* out) {
+    auto s = reinterpret_cast<VnxVideo::IRawSample*>(in.ptr);
+    try {
+        VnxVideo::PRawSample res(VnxVideo::ConvertRawSample(s, csp));
+        out->ptr = res->Dup();
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "vnxvideo_raw_sample_convert: exception: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+
 namespace VnxVideo {
     IRawSample* CopyRawToI420(IRawSample* sample) {
         int strides[4];
@@ -111,3 +140,93 @@ namespace VnxVideo {
         return new CRawSample(csp, width, height, nullptr, nullptr, true);
     }
 }
+
+static VnxVideo::PRawSample convertRawSample(VnxVideo::IRawSample* sample, ERawMediaFormat emf) {
+    EColorspace csp;
+    int width, height;
+    sample->GetFormat(csp, width, height);
+    if (csp == emf)
+        return MakeRawSamplePtr(sample->Dup());
+    if (!vnxvideo_emf_is_video(csp) || !vnxvideo_emf_is_video(emf))
+        throw std::logic_error("convertRawSample: only video samples can be converted");
+
+    std::shared_ptr<SwsContext> ctx(getCachedSwsContext(width, height, toAVPixelFormat(csp),
+        width, height, toAVPixelFormat(emf), SWS_BILINEAR));
+    if (!ctx)
+        throw std::runtime_error("convertRawSample: sws_getContext failed");
+
+    int stridesSrc[4] = { 0,0,0,0 };
+    uint8_t* planesSrc[4] = { 0,0,0,0 };
+    sample->GetData(stridesSrc, planesSrc);
+
+    VnxVideo::PRawSample res(MakeRawSamplePtr(new CRawSample(emf, width, height)));
+    int stridesDst[4] = { 0,0,0,0 };
+    uint8_t* planesDst[4] = { 0,0,0,0 };
+    res->GetData(stridesDst, planesDst);
+    if (sws_scale(ctx.get(), planesSrc, stridesSrc, 0, height, planesDst, stridesDst) != height)
+        throw std::runtime_error("convertRawSample: sws_scale failed");
+    CopyFrameTrace(sample, res.get());
+    return res;
+}
+
+class CConvertOnDemandSample : public VnxVideo::IRawSample {
+public:
+    CConvertOnDemandSample(VnxVideo::IRawSample* native)
+        : m_native(MakeRawSamplePtr(native->Dup()))
+        , m_conversions(std::allocate_shared<SConversions>(CSmallObjectAllocator<SConversions>()))
+    {
+    }
+    void GetFormat(ERawMediaFormat &emf, int &x, int &y) {
+        m_native->GetFormat(emf, x, y);
+    }
+    void GetData(int* strides, uint8_t** planes) {
+        m_native->GetData(strides, planes);
+    }
+    VnxVideo::IRawSample* Dup() {
+        return new CConvertOnDemandSample(*this); // conversions are shared with the copy
+    }
+    bool GetTrace(VnxVideo::SFrameTrace& trace) {
+        return m_native->GetTrace(trace);
+    }
+    void SetTrace(const VnxVideo::SFrameTrace& trace) {
+        m_native->SetTrace(trace);
+    }
+    VnxVideo::PRawSample Get(ERawMediaFormat emf) {
+        // the lock is held while converting, so that concurrent consumers
+        // asking for the same format wait for a single conversion
+        std::unique_lock<std::mutex> lock(m_conversions->mutex);
+        for (auto& c : m_conversions->samples) {
+            if (c.first == emf)
+                return c.second;
+        }
+        VnxVideo::PRawSample res(convertRawSample(m_native.get(), emf));
+        m_conversions->samples.push_back(std::make_pair(emf, res));
+        return res;
+    }
+    VNX_SMALL_OBJECT_NEW_DELETE
+private:
+    struct SConversions {
+        std::mutex mutex;
+        std::vector<std::pair<ERawMediaFormat, VnxVideo::PRawSample>> samples;
+    };
+    VnxVideo::PRawSample m_native;
+    std::shared_ptr<SConversions> m_conversions;
+};
+
+namespace VnxVideo {
+    IRawSample* ConvertOnDemand(IRawSample* sample) {
+        if (dynamic_cast<CConvertOnDemandSample*>(sample))
+            return sample->Dup();
+        return new CConvertOnDemandSample(sample);
+    }
+    PRawSample ConvertRawSample(IRawSample* sample, ERawMediaFormat emf) {
+        if (auto lazy = dynamic_cast<CConvertOnDemandSample*>(sample)) {
+            EColorspace csp;
+            int width, height;
+            lazy->GetFormat(csp, width, height);
+            if (csp != emf)
+                return lazy->Get(emf);
+        }
+        return convertRawSample(sample, emf);
+    }
+}
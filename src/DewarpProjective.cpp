@@ -12,6 +12,7 @@ using json = nlohmann::json;
 #include "vnxvideologimpl.h"
 
 #include "RawSample.h"
+#include "FrameTrace.h"
 
 class CWarpTransform_8u {
 public:
@@ -56,7 +57,8 @@ class CDewarpProjective : public VnxVideo::IRawTransform {
 public:
     CDewarpProjective(const std::vector<double>& tform)
         : m_width(0)
-        , m_height(0) {
+        , m_height(0)
+        , m_latency(GetLatencyHistogram("transform")) {
 
         if(tform.size()!=9)
             throw std::logic_error("Nine transform coefficients, row-wise, are expected");
@@ -93,6 +95,7 @@ public:
         m_warpY.reset();
         m_warpUV.reset();
 
+        PrewarmFramePool(EMF_I420, width, height);
         m_onFormat(csp, width, height);
     }
     void Process(VnxVideo::IRawSample* sample, uint64_t timestamp) {
@@ -123,6 +126,8 @@ public:
 
             warp->Apply(planesIn[k], stridesIn[k], planesOut[k], stridesOut[k]);
         }
+        CopyFrameTrace(sample, &out);
+        RecordFrameLatency(m_latency, &out);
         m_onFrame(&out, timestamp);
     }
     void Flush() {
@@ -142,6 +147,7 @@ private:
     double m_warpCoeffsUV[3][3];
     std::unique_ptr<CWarpTransform_8u> m_warpY;
     std::unique_ptr<CWarpTransform_8u> m_warpUV;
+    CLatencyHistogram* const m_latency;
 };
 
 namespace VnxVideo {
@@ -156,7 +162,8 @@ namespace VnxVideo {
                 throw std::runtime_error("incorrect number of transform coefficiens, 3x3 matrix unwarped in a single array, row-wise, expected");
             }
             return CreateAsyncTransform(
-                PRawTransform(VnxVideo::CreateRawTransform_DewarpProjective(tform)));
+                PRawTransform(VnxVideo::CreateRawTransform_DewarpProjective(tform)),
+                ParseAsyncQueueConfig(jget<nlohmann::json>(config, "queue")));
         }
         else
             throw std::runtime_error("unknown raw video transform type: " + type);
@@ -0,0 +1,262 @@
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "vnxvideologimpl.h"
+#include "EventTrace.h"
+
+std::atomic<bool> g_eventTraceEnabled(false);
+
+uint64_t EventTraceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t currentThreadId() {
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#elif defined(__linux__)
+    return (uint64_t)syscall(SYS_gettid);
+#else
+    return (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+}
+
+static uint64_t currentProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return (uint64_t)getpid();
+#endif
+}
+
+struct STraceEvent {
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+    uint64_t tid; // rings of finished threads are taken over by new ones
+};
+
+// Recent events of a thread. Only the owner writes; the mutex is there for dumps, so it is never contended
+// otherwise.
+struct SEventRing {
+    std::mutex mutex;
+    std::vector<STraceEvent> events;
+    size_t next;
+    size_t count;
+    uint64_t tid;
+    bool orphaned; // the thread has finished
+};
+
+struct SEventRings {
+    std::mutex mutex;
+    std::vector<SEventRing*> rings; // never freed, so that threads may keep a plain pointer
+    size_t capacity;
+    SEventRings()
+        : capacity(16384)
+    {
+    }
+};
+static SEventRings& eventRings() {
+    static SEventRings* rings = new SEventRings;
+    return *rings;
+}
+
+struct SThreadRing {
+    SEventRing* ring;
+    SThreadRing()
+        : ring(nullptr)
+    {
+    }
+    ~SThreadRing() {
+        if (ring != nullptr) {
+            std::unique_lock<std::mutex> lock(ring->mutex);
+            ring->orphaned = true;
+        }
+    }
+};
+static thread_local SThreadRing t_ring;
+
+static SEventRing* acquireRing() {
+    SEventRings& rings(eventRings());
+    std::unique_lock<std::mutex> lock(rings.mutex);
+    const uint64_t tid = currentThreadId();
+    for (SEventRing* ring : rings.rings) {
+        std::unique_lock<std::mutex> ringLock(ring->mutex);
+        if (ring->orphaned) {
+            ring->orphaned = false;
+            ring->tid = tid;
+            t_ring.ring = ring;
+            return ring;
+        }
+    }
+    SEventRing* ring = new SEventRing;
+    ring->events.resize(rings.capacity);
+    ring->next = 0;
+    ring->count = 0;
+    ring->tid = tid;
+    ring->orphaned = false;
+    rings.rings.push_back(ring);
+    t_ring.ring = ring;
+    return ring;
+}
+
+void RecordTraceEvent(const char* name, uint64_t beginNs, uint64_t endNs) {
+    SEventRing* ring = t_ring.ring;
+    if (ring == nullptr)
+        ring = acquireRing();
+    std::unique_lock<std::mutex> lock(ring->mutex);
+    STraceEvent& e(ring->events[ring->next]);
+    e.name = name;
+    e.begin = beginNs;
+    e.end = endNs;
+    e.tid = ring->tid;
+    ring->next = (ring->next + 1) % ring->events.size();
+    ring->count = std::min(ring->count + 1, ring->events.size());
+}
+
+void EnableEventTrace(bool enable) {
+    g_eventTraceEnabled = enable;
+}
+
+std::string DumpEventTrace() {
+    std::vector<STraceEvent> events;
+    {
+        SEventRings& rings(eventRings());
+        std::unique_lock<std::mutex> lock(rings.mutex);
+        for (SEventRing* ring : rings.rings) {
+            std::unique_lock<std::mutex> ringLock(ring->mutex);
+            const size_t size = ring->events.size();
+            for (size_t k = 0; k < ring->count; ++k)
+                events.push_back(ring->events[(ring->next + size - ring->count + k) % size]);
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const STraceEvent& a, const STraceEvent& b) { return a.begin < b.begin; });
+
+    // complete events, timestamps in microseconds
+    const uint64_t pid = currentProcessId();
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t k = 0; k < events.size(); ++k) {
+        const STraceEvent& e(events[k]);
+        if (k > 0)
+            ss << ",";
+        ss << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << e.tid
+            << ",\"ts\":" << e.begin / 1000.0 << ",\"dur\":" << (e.end - e.begin) / 1000.0 << "}";
+    }
+    ss << "]}";
+    return ss.str();
+}
+
+bool DumpEventTraceToFile(const std::string& path) {
+    std::ofstream f(path.c_str(), std::ios::out | std::ios::trunc);
+    if (!f) {
+        VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "Could not open " << path << " to write the event trace to";
+        return false;
+    }
+    f << DumpEventTrace();
+    f.close();
+    if (!f) {
+        VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "Could not write the event trace to " << path;
+        return false;
+    }
+    VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "Event trace written to " << path;
+    return true;
+}
+
+#ifndef _WIN32
+// the signal handler only wakes up a thread which writes the trace, as hardly anything is allowed in a handler
+static int g_dumpSignalPipe[2] = { -1, -1 };
+
+static void onDumpSignal(int) {
+    const char c = 0;
+    const ssize_t res = write(g_dumpSignalPipe[1], &c, 1);
+    (void)res;
+}
+
+struct SSignalDump {
+    std::mutex mutex;
+    std::string path;
+};
+static SSignalDump& signalDump() {
+    static SSignalDump* dump = new SSignalDump;
+    return *dump;
+}
+
+bool DumpEventTraceOnSignal(int signum, const std::string& path) {
+    SSignalDump& dump(signalDump());
+    std::unique_lock<std::mutex> lock(dump.mutex);
+    if (g_dumpSignalPipe[0] < 0) {
+        if (pipe(g_dumpSignalPipe) != 0) {
+            VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Could not create a pipe for event trace dumps: " << strerror(errno);
+            return false;
+        }
+        std::thread([]() {
+            for (;;) {
+                char c;
+                const ssize_t res = read(g_dumpSignalPipe[0], &c, 1);
+                if (res < 0 && errno == EINTR)
+                    continue;
+                if (res != 1)
+                    break;
+                SSignalDump& dump(signalDump());
+                std::unique_lock<std::mutex> lock(dump.mutex);
+                const std::string path(dump.path);
+                lock.unlock();
+                DumpEventTraceToFile(path);
+            }
+        }).detach();
+    }
+    dump.path = path;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = onDumpSignal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(signum, &sa, nullptr) != 0) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Could not set a handler for signal " << signum << ": " << strerror(errno);
+        return false;
+    }
+    return true;
+}
+#else
+bool DumpEventTraceOnSignal(int signum, const std::string& path) {
+    return false;
+}
+#endif
+
+void InitEventTraceFromEnvironment() {
+    const char* const ringEnv = getenv("VNX_EVENT_TRACE_RING");
+    if (ringEnv != nullptr && atoi(ringEnv) > 0) {
+        SEventRings& rings(eventRings());
+        std::unique_lock<std::mutex> lock(rings.mutex);
+        rings.capacity = atoi(ringEnv);
+    }
+#ifndef _WIN32
+    const char* const fileEnv = getenv("VNX_EVENT_TRACE_FILE");
+    if (fileEnv != nullptr && fileEnv[0] != 0)
+        DumpEventTraceOnSignal(SIGUSR2, fileEnv);
+#endif
+    const char* const enableEnv = getenv("VNX_EVENT_TRACE");
+    if (enableEnv != nullptr && strncmp(enableEnv, "0", 1) != 0)
+        EnableEventTrace(true);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline of hot paths for chrome://tracing or Perfetto. VNXVIDEO_TRACE_SCOPE("decoder.decode") at the top
+// of a block records how long the block took, on which thread, into a ring of the thread's recent events.
+// While tracing is off, which is the default, a scope costs a relaxed load of an atomic flag, so the
+// instrumentation stays in release builds and tracing can be turned on during an incident.
+//
+// VNX_EVENT_TRACE=1 turns tracing on at vnxvideo_init, VNX_EVENT_TRACE_RING sets the number of events kept
+// per thread (16384 by default), and VNX_EVENT_TRACE_FILE names a file which the trace is written to
+// on SIGUSR2 (POSIX only).
+
+extern std::atomic<bool> g_eventTraceEnabled;
+
+uint64_t EventTraceNow(); // ns, steady clock
+// name should be a string literal: it is kept by pointer
+void RecordTraceEvent(const char* name, uint64_t beginNs, uint64_t endNs);
+
+class CEventTraceScope {
+public:
+    explicit CEventTraceScope(const char* name)
+        : m_name(g_eventTraceEnabled.load(std::memory_order_relaxed) ? name : nullptr)
+        , m_begin(m_name ? EventTraceNow() : 0)
+    {
+    }
+    ~CEventTraceScope() {
+        if (m_name)
+            RecordTraceEvent(m_name, m_begin, EventTraceNow());
+    }
+private:
+    CEventTraceScope(const CEventTraceScope&) = delete;
+    CEventTraceScope& operator=(const CEventTraceScope&) = delete;
+    const char* const m_name;
+    const uint64_t m_begin;
+};
+
+#define VNXVIDEO_TRACE_CONCAT_(a, b) a##b
+#define VNXVIDEO_TRACE_CONCAT(a, b) VNXVIDEO_TRACE_CONCAT_(a, b)
+#define VNXVIDEO_TRACE_SCOPE(name) CEventTraceScope VNXVIDEO_TRACE_CONCAT(vnxTraceScope, __LINE__)(name)
+
+void EnableEventTrace(bool enable);
+// {"traceEvents": [...]} with the events of all threads, oldest first
+std::string DumpEventTrace();
+bool DumpEventTraceToFile(const std::string& path);
+// writes the trace to the file whenever the process gets the signal; false where signals are not supported
+bool DumpEventTraceOnSignal(int signum, const std::string& path);
+void InitEventTraceFromEnvironment();
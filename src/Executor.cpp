@@ -0,0 +1,219 @@
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "vnxvideoimpl.h"
+#include "vnxvideologimpl.h"
+#include "Executor.h"
+
+// "0-3,8" -> 0,1,2,3,8
+static bool parseCpuList(const std::string& list, std::vector<int>& cpus) {
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty())
+            continue;
+        int first, last;
+        char dash;
+        std::stringstream is(item);
+        if (!(is >> first) || first < 0)
+            return false;
+        last = first;
+        if (is >> dash) {
+            if (dash != '-' || !(is >> last) || last < first)
+                return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return true;
+}
+
+static void setThreadAffinity(std::thread& thread, const std::vector<int>& cpus) {
+    if (cpus.empty())
+        return;
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu < (int)(8 * sizeof(mask)))
+            mask |= (DWORD_PTR)1 << cpu;
+    }
+    if (!mask || !SetThreadAffinityMask(thread.native_handle(), mask))
+        VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "Could not set affinity of an executor thread: " << GetLastError();
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    int res = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    if (res != 0)
+        VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "Could not set affinity of an executor thread: " << res;
+#endif
+}
+
+static thread_local int t_workerIndex = -1;
+
+class CExecutor {
+public:
+    CExecutor(int workers, const std::vector<int>& cpus)
+        : m_pending(0)
+        , m_next(0)
+    {
+        for (int k = 0; k < workers; ++k)
+            m_queues.emplace_back(new SQueue);
+        for (int k = 0; k < workers; ++k) {
+            std::thread thread([this, k]() { run(k); });
+            setThreadAffinity(thread, cpus);
+            thread.detach();
+        }
+        VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "Executor runs " << workers << " workers";
+    }
+    void Post(std::function<void()> task) {
+        const int index = (t_workerIndex >= 0) ? t_workerIndex : (int)(m_next++ % m_queues.size());
+        ++m_pending;
+        {
+            std::unique_lock<std::mutex> lock(m_queues[index]->mutex);
+            m_queues[index]->tasks.push_back(std::move(task));
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.notify_one();
+    }
+    bool Help() {
+        std::function<void()> task;
+        if (t_workerIndex < 0 || !take(t_workerIndex, task))
+            return false;
+        execute(task);
+        return true;
+    }
+private:
+    void run(int index) {
+        t_workerIndex = index;
+        for (;;) {
+            std::function<void()> task;
+            if (take(index, task)) {
+                execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]() { return m_pending.load() > 0; });
+        }
+    }
+    // own queue first, oldest task first; then the newest task of another worker
+    bool take(int index, std::function<void()>& task) {
+        {
+            SQueue& own(*m_queues[index]);
+            std::unique_lock<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                --m_pending;
+                return true;
+            }
+        }
+        for (size_t k = 1; k < m_queues.size(); ++k) {
+            SQueue& other(*m_queues[(index + k) % m_queues.size()]);
+            std::unique_lock<std::mutex> lock(other.mutex);
+            if (!other.tasks.empty()) {
+                task = std::move(other.tasks.back());
+                other.tasks.pop_back();
+                --m_pending;
+                return true;
+            }
+        }
+        return false;
+    }
+    void execute(std::function<void()>& task) {
+        try {
+            task();
+        }
+        catch (const std::exception& e) {
+            VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Executor task failed: " << e.what();
+        }
+    }
+
+    struct SQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+    std::vector<std::unique_ptr<SQueue> > m_queues;
+    std::atomic<int> m_pending; // tasks in all queues
+    std::atomic<unsigned> m_next; // queue for the next task posted from outside the pool
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+struct SExecutorConfig {
+    std::mutex mutex;
+    CExecutor* executor;
+    int workers;
+    std::vector<int> cpus;
+    SExecutorConfig()
+        : executor(nullptr)
+        , workers(std::max(1, (int)std::thread::hardware_concurrency()))
+    {
+        const char* const threadsEnv = getenv("VNX_EXECUTOR_THREADS");
+        if (threadsEnv != nullptr && atoi(threadsEnv) > 0)
+            workers = atoi(threadsEnv);
+        const char* const affinityEnv = getenv("VNX_EXECUTOR_AFFINITY");
+        if (affinityEnv != nullptr && !parseCpuList(affinityEnv, cpus)) {
+            VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "Invalid VNX_EXECUTOR_AFFINITY: " << affinityEnv;
+            cpus.clear();
+        }
+    }
+};
+static SExecutorConfig& executorConfig() {
+    static SExecutorConfig* config = new SExecutorConfig;
+    return *config;
+}
+
+static CExecutor& executor() {
+    static CExecutor* executor = [] {
+        SExecutorConfig& config(executorConfig());
+        std::unique_lock<std::mutex> lock(config.mutex);
+        config.executor = new CExecutor(config.workers, config.cpus);
+        return config.executor;
+    }();
+    return *executor;
+}
+
+void ExecutorPost(std::function<void()> task) {
+    executor().Post(std::move(task));
+}
+
+bool ExecutorHelp() {
+    return t_workerIndex >= 0 && executor().Help();
+}
+
+bool ExecutorIsWorkerThread() {
+    return t_workerIndex >= 0;
+}
+
+bool ConfigureExecutor(int workers, const std::string& affinity) {
+    std::vector<int> cpus;
+    if ((workers < 1 && workers != EXECUTOR_KEEP_WORKERS) || !parseCpuList(affinity, cpus))
+        return false;
+    SExecutorConfig& config(executorConfig());
+    std::unique_lock<std::mutex> lock(config.mutex);
+    if (config.executor != nullptr)
+        return false;
+    if (workers != EXECUTOR_KEEP_WORKERS)
+        config.workers = workers;
+    config.cpus = cpus;
+    return true;
+}
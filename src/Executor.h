@@ -0,0 +1,22 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+// Process-wide pool of worker threads for processing which should not own a thread,
+// like async transforms and encoders. Every worker has a queue of its own: tasks posted
+// from a worker go to its queue, others are spread over the queues, and idle workers steal
+// tasks from the queues of busy ones. Tasks run in no particular order, so objects which
+// need their tasks run one at a time should keep at most one task posted.
+//
+// The pool starts on the first post, with VNX_EXECUTOR_THREADS workers (the number of cpus
+// by default) restricted to the cpus listed in VNX_EXECUTOR_AFFINITY, like "0-3,8-11", if set.
+
+void ExecutorPost(std::function<void()> task);
+// runs one pending task if called from a worker; for workers which would otherwise wait for other tasks
+bool ExecutorHelp();
+bool ExecutorIsWorkerThread();
+// workers for ConfigureExecutor which keeps the number configured so far, or the default one
+const int EXECUTOR_KEEP_WORKERS = 0;
+// overrides the environment; false if the pool has already started or the affinity does not parse
+bool ConfigureExecutor(int workers, const std::string& affinity);
@@ -10,6 +10,8 @@ extern "C" {
 #include "vnxvideologimpl.h"
 
 #include "FFmpegUtils.h"
+#include "FrameTrace.h"
+#include "EventTrace.h"
 
 
 class CVideoDecoder : public VnxVideo::IMediaDecoder {
@@ -20,6 +22,7 @@ public:
         , m_height(0)
         , m_codecID(codecID)
         , m_codecImpl(eci)
+        , m_latency(GetLatencyHistogram("decoder"))
     {
         reInitialize();
     }
@@ -79,10 +82,12 @@ public:
         m_onFrame = onFrame;
     }
     virtual void Decode(VnxVideo::IBuffer* nalu, uint64_t timestamp) {
+        VNXVIDEO_TRACE_SCOPE("decoder.decode");
         if (m_errorsInARow > 250) {
             VNXVIDEO_LOG(VNXLOG_INFO, "ffmpeg") << "Reached 250 errors in a row mark; will re-initialize the decoder";
             reInitialize();
         }
+        m_traces.Push(nalu, timestamp);
         uint8_t* data=nullptr;
         int size=0;
         nalu->GetData(data, size);
@@ -159,7 +164,7 @@ private:
             }
             m_errorsInARow = 0;
             callOnFormat(result.GetAVFrame());
-            m_onFrame(&result, result.GetAVFrame()->pts); // pkt_pts said to be deprecated but it's the only valid value
+            deliver(&result, result.GetAVFrame()->pts); // pkt_pts said to be deprecated but it's the only valid value
         }
     }
     void fetchDecodedHw() {
@@ -196,11 +201,17 @@ private:
             }
             callOnFormat(dst.get());
             CAvcodecRawSample result(dst);
-            m_onFrame(&result, dst->pts);
+            deliver(&result, dst->pts);
             m_errorsInARow = 0;
         }
 #endif
     }
+    void deliver(CAvcodecRawSample* sample, uint64_t timestamp) {
+        // consumers which need the frame in another format convert it once and share the result
+        std::unique_ptr<VnxVideo::IRawSample> lazy(VnxVideo::ConvertOnDemand(sample));
+        m_traces.Pass(lazy.get(), timestamp, m_latency);
+        m_onFrame(lazy.get(), timestamp);
+    }
     void callOnFormat(AVFrame* f) {
         EColorspace csp = fromAVPixelFormat((AVPixelFormat)f->format);
         if (m_width != f->width || m_height != f->height || m_csp != csp) {
@@ -221,6 +232,8 @@ private:
     EColorspace m_csp;
     int m_width, m_height;
     int m_errorsInARow;
+    CFrameTraceCarrier m_traces; // from coded to decoded frames, by timestamp
+    CLatencyHistogram* const m_latency;
 };
 
 namespace VnxVideo {
@@ -6,11 +6,12 @@
 #include "RawSample.h"
 #include "FFmpegUtils.h"
 #include "BufferImpl.h"
+#include "FrameTrace.h"
+#include "EventTrace.h"
 
 #include "vnxvideoimpl.h"
 
 extern "C" {
-#include <libswscale/swscale.h>
 #include "libavutil/opt.h"
 }
 
@@ -34,13 +35,15 @@ private:
 
     VnxVideo::TOnBufferCallback m_onBuffer;
 
-    std::shared_ptr<SwsContext> m_swsc;
     std::shared_ptr<AVCodecContext> m_cc;
 
     EColorspace m_csp;
     int m_width;
     int m_height;
     int m_nframe;
+
+    CFrameTraceCarrier m_traces; // from raw to encoded frames, by timestamp
+    CLatencyHistogram* const m_latency;
 public:
     CFFmpegEncoderImpl(const char* profile, const char* preset, int fps,
                        const VnxVideo::TEncoderQuality& quality,
@@ -51,6 +54,7 @@ public:
         , m_quality(quality)
         , m_codecImpl(eci)
         , m_nframe(0)
+        , m_latency(GetLatencyHistogram("encoder"))
     {
         if (m_preset == "ultrafast" || m_preset == "superfast") {
             m_preset = "veryfast";
@@ -82,26 +86,24 @@ public:
 
         m_cc.reset();
 
-        if (m_codecImpl != VnxVideo::ECodecImpl::ECI_CPU && csp != EMF_NV12) {
-            m_swsc.reset(sws_getContext(width, height, toAVPixelFormat(csp),
-                width, height, AV_PIX_FMT_NV12, SWS_BILINEAR,
-                nullptr, nullptr, nullptr), sws_freeContext);
-        }
-        else
-            m_swsc.reset();
+        if (m_codecImpl != VnxVideo::ECodecImpl::ECI_CPU && csp != EMF_NV12)
+            PrewarmFramePool(EMF_NV12, width, height);
 
     }
     void OutputNAL(uint8_t *data, int size, uint64_t ts) {
         CNoOwnershipNalBuffer b(data, size);
+        m_traces.Pass(&b, ts, m_latency);
         m_onBuffer(&b, ts);
     }
     virtual void Process(VnxVideo::IRawSample* sample, uint64_t timestamp) {
+        VNXVIDEO_TRACE_SCOPE("encoder.process");
         ERawMediaFormat emf;
         int width, height;
         sample->GetFormat(emf, width, height);
         if (!vnxvideo_emf_is_video(emf)) {
             return;
         }
+        m_traces.Push(sample, timestamp);
 
         try {
             checkCreateCc();
@@ -122,18 +124,17 @@ public:
         uint8_t** planes = planes_src;
         int* strides = strides_src;
 
-        if (m_swsc.get()) {
-            sampleNV12.reset(new CRawSample(EMF_NV12, m_width, m_height, nullptr, nullptr, true));
-            sampleNV12->GetData(strides_dst, planes_dst);
-            int res = sws_scale(m_swsc.get(), planes, strides, 0, m_height, planes_dst, strides_dst);
-            if (res != m_height) {
-                VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "CFFmpegEncoderImpl::Process: sws_scale failed";
-                return;
+        if (m_codecImpl != VnxVideo::ECodecImpl::ECI_CPU && emf != EMF_NV12) {
+            try {
+                sampleNV12 = VnxVideo::ConvertRawSample(sample, EMF_NV12);
             }
-            else {
-                planes = planes_dst;
-                strides = strides_dst;
+            catch (const std::exception& e) {
+                VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "CFFmpegEncoderImpl::Process: format conversion failed: " << e.what();
+                return;
             }
+            sampleNV12->GetData(strides_dst, planes_dst);
+            planes = planes_dst;
+            strides = strides_dst;
         }
 
         std::shared_ptr<AVFrame> frm(avframeAlloc());
@@ -186,6 +187,7 @@ public:
             }
             else {
                 CNoOwnershipNalBuffer buffer(pkt->data, pkt->size);
+                m_traces.Pass(&buffer, pkt->pts, m_latency);
                 m_onBuffer(&buffer, pkt->pts);
             }
         }
@@ -1,7 +1,16 @@
 #include <functional>
 #include <set>
+#include <map>
+#include <list>
+#include <tuple>
 #include <mutex>
+#include <atomic>
 #include "FFmpegUtils.h"
+#include "RawSample.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
 
 AVCodecID codecIdFromSubtype(EMediaSubtype subtype) {
     switch (subtype) {
@@ -322,7 +331,22 @@ bool avfrmIsAudio(AVFrame* frm) {
 }
 
 VnxVideo::IRawSample* CAvcodecRawSample::Dup() {
-    return new CAvcodecRawSample(m_frame);
+    CAvcodecRawSample* res = new CAvcodecRawSample(m_frame);
+    res->m_trace = m_trace;
+    return res;
+}
+bool CAvcodecRawSample::GetTrace(VnxVideo::SFrameTrace& trace) {
+    trace = m_trace;
+    return m_trace.ingestNs != 0;
+}
+void CAvcodecRawSample::SetTrace(const VnxVideo::SFrameTrace& trace) {
+    m_trace = trace;
+}
+void* CAvcodecRawSample::operator new(size_t size) {
+    return SmallObjectAlloc(size);
+}
+void CAvcodecRawSample::operator delete(void* ptr, size_t size) {
+    SmallObjectFree(ptr, size);
 }
 void CAvcodecRawSample::GetFormat(ERawMediaFormat &emf, int &x, int &y) {
     if (avfrmIsVideo(m_frame.get())) {
@@ -436,3 +460,117 @@ void checkFramesContext(AVCodecContext& cc, int width, int height, AVPixelFormat
     }
 #endif
 }
+
+class CSwsContextCache {
+public:
+    CSwsContextCache()
+        : m_capacity(DefaultCapacity)
+        , m_hits(0)
+        , m_misses(0)
+        , m_evictions(0)
+    {
+        const char* const capacityStr = getenv("VNX_SWS_CACHE_SIZE");
+        if (capacityStr != nullptr)
+            m_capacity = std::max(0, atoi(capacityStr));
+    }
+    std::shared_ptr<SwsContext> Get(int srcW, int srcH, AVPixelFormat srcFormat, int dstW, int dstH, AVPixelFormat dstFormat, int flags) {
+        const TKey key(srcW, srcH, srcFormat, dstW, dstH, dstFormat, flags);
+        SwsContext* ctx = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto it = m_index.find(key);
+            if (it != m_index.end()) {
+                ctx = it->second->second;
+                m_idle.erase(it->second);
+                m_index.erase(it);
+            }
+        }
+        if (ctx)
+            ++m_hits;
+        else {
+            ++m_misses;
+            ctx = sws_getContext(srcW, srcH, srcFormat, dstW, dstH, dstFormat, flags, nullptr, nullptr, nullptr);
+            if (!ctx)
+                return std::shared_ptr<SwsContext>();
+        }
+        return std::shared_ptr<SwsContext>(ctx, [this, key](SwsContext* c) { put(key, c); },
+            CSmallObjectAllocator<SwsContext>());
+    }
+    SSwsCacheStats GetStats() {
+        SSwsCacheStats stats;
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.evictions = m_evictions;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        stats.idle = (int)m_idle.size();
+        stats.capacity = m_capacity;
+        return stats;
+    }
+private:
+    typedef std::tuple<int, int, int, int, int, int, int> TKey;
+    typedef std::list<std::pair<TKey, SwsContext*>> TIdle;
+
+    void put(const TKey& key, SwsContext* ctx) {
+        SwsContext* evicted = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_capacity == 0)
+                evicted = ctx;
+            else {
+                // most recently released contexts are at the front, eviction happens at the back
+                m_idle.push_front(std::make_pair(key, ctx));
+                m_index.insert(std::make_pair(key, m_idle.begin()));
+                if ((int)m_idle.size() > m_capacity) {
+                    auto last = std::prev(m_idle.end());
+                    auto range = m_index.equal_range(last->first);
+                    for (auto it = range.first; it != range.second; ++it) {
+                        if (it->second == last) {
+                            m_index.erase(it);
+                            break;
+                        }
+                    }
+                    evicted = last->second;
+                    m_idle.erase(last);
+                    ++m_evictions;
+                }
+            }
+        }
+        if (evicted)
+            sws_freeContext(evicted);
+    }
+
+    static const int DefaultCapacity = 32;
+    std::mutex m_mutex;
+    int m_capacity;
+    TIdle m_idle;
+    std::multimap<TKey, TIdle::iterator> m_index;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_evictions;
+};
+
+static CSwsContextCache& swsContextCache() {
+    static CSwsContextCache* cache = new CSwsContextCache; // never destroyed, contexts may be released after statics are gone
+    return *cache;
+}
+
+std::shared_ptr<SwsContext> getCachedSwsContext(int srcW, int srcH, AVPixelFormat srcFormat,
+    int dstW, int dstH, AVPixelFormat dstFormat, int flags)
+{
+    return swsContextCache().Get(srcW, srcH, srcFormat, dstW, dstH, dstFormat, flags);
+}
+
+SSwsCacheStats getSwsCacheStats() {
+    return swsContextCache().GetStats();
+}
+
+int vnxvideo_get_sws_cache_stats(uint64_t* hits, uint64_t* misses, uint64_t* evictions) {
+    SSwsCacheStats stats(getSwsCacheStats());
+    if (hits)
+        *hits = stats.hits;
+    if (misses)
+        *misses = stats.misses;
+    if (evictions)
+        *evictions = stats.evictions;
+    return vnxvideo_err_ok;
+}
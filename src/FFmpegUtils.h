@@ -43,6 +43,22 @@ bool isPlanarAudioFormat(AVSampleFormat format);
 bool avfrmIsVideo(AVFrame* frm);
 bool avfrmIsAudio(AVFrame* frm);
 
+struct SwsContext;
+// Scaling context from a bounded LRU cache keyed by conversion parameters. Creating a context
+// costs more than scaling a small image, so the context returns to the cache when released.
+// A context is only used by one thread at a time: concurrent callers get different instances.
+// Returns an empty pointer if sws_getContext fails.
+std::shared_ptr<SwsContext> getCachedSwsContext(int srcW, int srcH, AVPixelFormat srcFormat,
+    int dstW, int dstH, AVPixelFormat dstFormat, int flags);
+struct SSwsCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    int idle;
+    int capacity;
+};
+SSwsCacheStats getSwsCacheStats();
+
 
 class CAvcodecRawSample : public VnxVideo::IRawSample {
 public:
@@ -53,9 +69,15 @@ public:
     VnxVideo::IRawSample* Dup();
     virtual void GetFormat(ERawMediaFormat &, int &, int &);
     virtual void GetData(int* strides, uint8_t** planes);
+    virtual bool GetTrace(VnxVideo::SFrameTrace& trace);
+    virtual void SetTrace(const VnxVideo::SFrameTrace& trace);
     AVFrame* GetAVFrame();
+
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr, size_t size);
 private:
     std::shared_ptr<AVFrame> m_frame;
+    VnxVideo::SFrameTrace m_trace;
 };
 
 bool isCodecImplSupported(VnxVideo::ECodecImpl eci);
@@ -32,6 +32,7 @@
 #include <vnxvideo/vnxvideoimpl.h>
 #include <vnxvideo/vnxvideologimpl.h>
 #include <vnxvideo/BufferImpl.h>
+#include "FrameTrace.h"
 
 #include <vnxvideo/json.hpp>
 #include <vnxvideo/jget.h>
@@ -291,12 +292,15 @@ private:
                     }
                     auto onBuffer = itOnBuffer->second;
                     lock.unlock();
+                    const VnxVideo::SFrameTrace trace(NewFrameTrace()); // for all NAL units of the packet
                     try {
                         if (mediaSubtype == EMST_H264) {
                             if (p.flags & AV_PKT_FLAG_KEY) {
                                 CNoOwnershipNalBuffer sps(&m_sps[0], m_sps.size());
+                                sps.SetTrace(trace);
                                 onBuffer(&sps, ts);
                                 CNoOwnershipNalBuffer pps(&m_pps[0], m_pps.size());
+                                pps.SetTrace(trace);
                                 onBuffer(&pps, ts);
                             }
                             int pos = 0;
@@ -325,6 +329,7 @@ private:
                                 }
                                 std::vector<uint8_t> b(nalCopyPrependStartCode(p.data+pos, len));
                                 CNoOwnershipNalBuffer nalu(&b[0], b.size());
+                                nalu.SetTrace(trace);
                                 onBuffer(&nalu, ts);
                                 pos += len;
                             }
@@ -358,22 +363,27 @@ private:
                                     bool firstSlice = (p.data[pos + 6] & 0x80) != 0;
                                     if (typ >= 16 && typ <= 21 && firstSlice) { // send vps/sps/pps before every irap nal unit which is the first slice of the picture
                                         CNoOwnershipNalBuffer vps(&m_vps[0], m_vps.size());
+                                        vps.SetTrace(trace);
                                         onBuffer(&vps, ts);
                                         CNoOwnershipNalBuffer sps(&m_sps[0], m_sps.size());
+                                        sps.SetTrace(trace);
                                         onBuffer(&sps, ts);
                                         CNoOwnershipNalBuffer pps(&m_pps[0], m_pps.size());
+                                        pps.SetTrace(trace);
                                         onBuffer(&pps, ts);
                                     }
                                 }
                                 
                                 std::vector<uint8_t> b(nalCopyPrependStartCode(p.data+pos, len));
                                 CNoOwnershipNalBuffer nalu(&b[0], b.size());
+                                nalu.SetTrace(trace);
                                 onBuffer(&nalu, ts);
                                 pos += len;
                             }
                         }
                         else if (mediaSubtype == EMST_AAC || mediaSubtype == EMST_OPUS) {
                             CNoOwnershipNalBuffer nalu(p.data, p.size);
+                            nalu.SetTrace(trace);
                             onBuffer(&nalu, ts);
                         }
                     }
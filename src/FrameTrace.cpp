@@ -0,0 +1,202 @@
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "FrameTrace.h"
+
+static uint64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+VnxVideo::SFrameTrace NewFrameTrace() {
+    static std::atomic<uint64_t> sequence(0);
+    VnxVideo::SFrameTrace trace;
+    trace.ingestNs = steadyNowNs();
+    trace.sequence = ++sequence;
+    return trace;
+}
+
+// Latencies in microseconds, in log-linear buckets: values below 16 have a bucket each, and every
+// octave above is split into 16 buckets, so that percentiles are off by 1/16 at most.
+class CLatencyHistogram {
+public:
+    CLatencyHistogram() {
+        Reset();
+    }
+    void Record(uint64_t us) {
+        ++m_buckets[bucket(us)];
+        uint64_t max = m_max.load();
+        while (us > max && !m_max.compare_exchange_weak(max, us))
+            ;
+    }
+    void RecordExpired() {
+        ++m_expired;
+    }
+    void Reset() {
+        for (auto& b : m_buckets)
+            b = 0;
+        m_max = 0;
+        m_expired = 0;
+    }
+    nlohmann::json GetStats() {
+        uint64_t counts[BUCKETS];
+        uint64_t count = 0;
+        for (int k = 0; k < BUCKETS; ++k) {
+            counts[k] = m_buckets[k].load();
+            count += counts[k];
+        }
+        const uint64_t max = m_max.load();
+        return {
+            { "count", count },
+            { "p50_us", std::min(max, percentile(counts, count, 50)) },
+            { "p99_us", std::min(max, percentile(counts, count, 99)) },
+            { "max_us", max },
+            { "expired", m_expired.load() }
+        };
+    }
+private:
+    static const int SUB_BITS = 4;
+    static const int SUB = 1 << SUB_BITS;
+    static const int OCTAVES = 36; // up to 2^36 us, about 19 hours
+    static const int BUCKETS = SUB * (OCTAVES - SUB_BITS + 1);
+
+    static int bucket(uint64_t us) {
+        if (us < SUB)
+            return (int)us;
+        int msb = 63;
+        while (!(us & ((uint64_t)1 << msb)))
+            --msb;
+        if (msb >= OCTAVES)
+            return BUCKETS - 1;
+        const int sub = (int)(us >> (msb - SUB_BITS)) & (SUB - 1);
+        return (msb - SUB_BITS + 1) * SUB + sub;
+    }
+    // the largest value which falls into the bucket
+    static uint64_t upperBound(int bucket) {
+        if (bucket < SUB)
+            return bucket;
+        const int msb = bucket / SUB + SUB_BITS - 1;
+        const uint64_t sub = bucket % SUB;
+        return ((SUB + sub + 1) << (msb - SUB_BITS)) - 1;
+    }
+    static uint64_t percentile(const uint64_t* counts, uint64_t count, int percent) {
+        if (count == 0)
+            return 0;
+        const uint64_t rank = std::max<uint64_t>(1, (count * percent + 99) / 100);
+        uint64_t seen = 0;
+        for (int k = 0; k < BUCKETS; ++k) {
+            seen += counts[k];
+            if (seen >= rank)
+                return upperBound(k);
+        }
+        return upperBound(BUCKETS - 1);
+    }
+
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+    std::atomic<uint64_t> m_max;
+    std::atomic<uint64_t> m_expired;
+};
+
+struct SLatencyHistograms {
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<CLatencyHistogram> > stages;
+};
+static SLatencyHistograms& latencyHistograms() {
+    static SLatencyHistograms* histograms = new SLatencyHistograms;
+    return *histograms;
+}
+
+CLatencyHistogram* GetLatencyHistogram(const std::string& stage) {
+    SLatencyHistograms& h(latencyHistograms());
+    std::unique_lock<std::mutex> lock(h.mutex);
+    auto& res(h.stages[stage]);
+    if (!res)
+        res.reset(new CLatencyHistogram);
+    return res.get();
+}
+
+void RecordFrameLatency(CLatencyHistogram* stage, const VnxVideo::SFrameTrace& trace) {
+    if (stage == nullptr || trace.ingestNs == 0)
+        return;
+    const uint64_t now = steadyNowNs();
+    stage->Record((now > trace.ingestNs) ? (now - trace.ingestNs) / 1000 : 0);
+}
+
+void RecordFrameExpired(CLatencyHistogram* stage) {
+    if (stage != nullptr)
+        stage->RecordExpired();
+}
+
+bool GetFrameAge(VnxVideo::IRawSample* sample, uint64_t timestamp, int64_t& ageMs) {
+    VnxVideo::SFrameTrace trace;
+    if (sample != nullptr && sample->GetTrace(trace)) {
+        ageMs = (int64_t)(steadyNowNs() - trace.ingestNs) / 1000000;
+        return true;
+    }
+    const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    const int64_t age = now - (int64_t)timestamp;
+    if (age <= -3600000 || age >= 3600000)
+        return false;
+    ageMs = age;
+    return true;
+}
+
+bool IsFrameExpired(VnxVideo::IRawSample* sample, uint64_t timestamp, int maxAgeMs) {
+    int64_t age;
+    return maxAgeMs > 0 && GetFrameAge(sample, timestamp, age) && age > maxAgeMs;
+}
+
+nlohmann::json GetLatencyStats() {
+    SLatencyHistograms& h(latencyHistograms());
+    std::unique_lock<std::mutex> lock(h.mutex);
+    nlohmann::json res = nlohmann::json::object();
+    for (const auto& stage : h.stages)
+        res[stage.first] = stage.second->GetStats();
+    return res;
+}
+
+void ResetLatencyStats() {
+    SLatencyHistograms& h(latencyHistograms());
+    std::unique_lock<std::mutex> lock(h.mutex);
+    for (const auto& stage : h.stages)
+        stage.second->Reset();
+}
+
+CFrameTraceCarrier::CFrameTraceCarrier()
+    : m_next(0)
+{
+    for (auto& e : m_entries) {
+        e.timestamp = 0;
+        e.passed = true;
+    }
+}
+
+void CFrameTraceCarrier::Push(uint64_t timestamp, const VnxVideo::SFrameTrace& trace) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // the NAL units of an access unit come with the same timestamp; the first one counts
+    const SEntry& last(m_entries[(m_next + CAPACITY - 1) % CAPACITY]);
+    if (last.trace.ingestNs != 0 && last.timestamp == timestamp)
+        return;
+    SEntry& e(m_entries[m_next]);
+    e.timestamp = timestamp;
+    e.trace = trace;
+    e.passed = false;
+    m_next = (m_next + 1) % CAPACITY;
+}
+
+bool CFrameTraceCarrier::Find(uint64_t timestamp, VnxVideo::SFrameTrace& trace, bool& first) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // newest first, in case timestamps repeat
+    for (int k = 1; k <= CAPACITY; ++k) {
+        SEntry& e(m_entries[(m_next + CAPACITY - k) % CAPACITY]);
+        if (e.trace.ingestNs != 0 && e.timestamp == timestamp) {
+            trace = e.trace;
+            first = !e.passed;
+            e.passed = true;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <mutex>
+
+#include "json.hpp"
+#include "vnxvideoimpl.h"
+
+// Frame latency tracing. Sources give every frame they deliver a new trace, components pass traces on
+// from their input to their output, and every stage records the latency of frames reaching it, that is
+// the time since their ingest, to a histogram of its own. See vnxvideo_get_latency_stats.
+
+VnxVideo::SFrameTrace NewFrameTrace();
+
+class CLatencyHistogram;
+// the histogram of a stage, like "decoder"; kept for the lifetime of the process
+CLatencyHistogram* GetLatencyHistogram(const std::string& stage);
+void RecordFrameLatency(CLatencyHistogram* stage, const VnxVideo::SFrameTrace& trace); // untraced frames are ignored
+
+// frames a stage skipped because they were too old, see IsFrameExpired
+void RecordFrameExpired(CLatencyHistogram* stage);
+
+// {"<stage>": {"count", "p50_us", "p99_us", "max_us", "expired"}, ...}
+nlohmann::json GetLatencyStats();
+void ResetLatencyStats();
+
+template<class TFrame> // IRawSample or IBuffer
+inline void RecordFrameLatency(CLatencyHistogram* stage, TFrame* frame) {
+    VnxVideo::SFrameTrace trace;
+    if (frame != nullptr && frame->GetTrace(trace))
+        RecordFrameLatency(stage, trace);
+}
+
+// Age of a frame in milliseconds: the time since its ingest if it is traced, otherwise the time since its
+// timestamp by the wall clock. False if neither tells: timestamps an hour or more off the wall clock
+// are not wall clock time, like those of a file.
+bool GetFrameAge(VnxVideo::IRawSample* sample, uint64_t timestamp, int64_t& ageMs);
+// true if the frame is older than maxAgeMs, so that the work on it would be wasted; never if maxAgeMs is 0
+// or the age is unknown
+bool IsFrameExpired(VnxVideo::IRawSample* sample, uint64_t timestamp, int maxAgeMs);
+
+template<class TFrom, class TTo>
+inline void CopyFrameTrace(TFrom* from, TTo* to) {
+    VnxVideo::SFrameTrace trace;
+    if (from != nullptr && to != nullptr && from->GetTrace(trace))
+        to->SetTrace(trace);
+}
+
+// Traces of frames a component took, for whatever it makes of them later, like decoded or encoded frames.
+// Those are matched by timestamp, which components already pass along with frames.
+class CFrameTraceCarrier {
+public:
+    CFrameTraceCarrier();
+    template<class TFrame>
+    void Push(TFrame* frame, uint64_t timestamp) {
+        VnxVideo::SFrameTrace trace;
+        if (frame != nullptr && frame->GetTrace(trace))
+            Push(timestamp, trace);
+    }
+    void Push(uint64_t timestamp, const VnxVideo::SFrameTrace& trace);
+    // gives the output the trace of the frame with the same timestamp, and records the latency of the stage
+    // when the first output of the frame appears: an access unit of several NAL units is counted once
+    template<class TFrame>
+    void Pass(TFrame* output, uint64_t timestamp, CLatencyHistogram* stage) {
+        VnxVideo::SFrameTrace trace;
+        bool first;
+        if (output != nullptr && Find(timestamp, trace, first)) {
+            output->SetTrace(trace);
+            if (first)
+                RecordFrameLatency(stage, trace);
+        }
+    }
+    bool Find(uint64_t timestamp, VnxVideo::SFrameTrace& trace, bool& first);
+private:
+    struct SEntry {
+        uint64_t timestamp;
+        VnxVideo::SFrameTrace trace;
+        bool passed;
+    };
+    // frames stay in components for a few frame intervals at most, like with B-frames or lookahead
+    static const int CAPACITY = 32;
+    std::mutex m_mutex;
+    SEntry m_entries[CAPACITY];
+    int m_next;
+};
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include"vnxvideoimpl.h"
 #include "vnxvideologimpl.h"
+#include "FrameTrace.h"
 
 class CGrayAnalyticsBase : public VnxVideo::IAnalytics {
 public:
@@ -12,6 +13,8 @@ public:
         , m_height(0)
         , m_onJson([](const std::string&, uint64_t) {})
         , m_onBuffer([](VnxVideo::IBuffer*, uint64_t) {})
+        , m_maxAgeMs(0)
+        , m_latency(GetLatencyHistogram("analytics"))
     {
     }
     void SetFormat(EColorspace csp, int w, int h) {
@@ -42,6 +45,11 @@ public:
     void Process(VnxVideo::IRawSample *sample, uint64_t timestamp) {
         if (!checkFormat(sample))
             return;
+        if (IsFrameExpired(sample, timestamp, m_maxAgeMs)) {
+            RecordFrameExpired(m_latency);
+            return;
+        }
+        RecordFrameLatency(m_latency, sample);
         int strides[4];
         uint8_t* planes[4];
         sample->GetData(strides, planes);
@@ -54,6 +62,9 @@ public:
         m_onJson = onJson;
         m_onBuffer = onBuffer;
     }
+    void SetMaxFrameAge(int maxAgeMs) {
+        m_maxAgeMs = maxAgeMs;
+    }
 private:
     const std::vector<float> m_roi;
     VnxVideo::TOnJsonCallback m_onJson;
@@ -65,6 +76,9 @@ private:
     int m_roiTop;
     int m_roiWidth;
     int m_roiHeight;
+
+    int m_maxAgeMs;
+    CLatencyHistogram* const m_latency;
 private:
     bool checkFormat(VnxVideo::IRawSample *sample) const {
         EColorspace csp;
@@ -0,0 +1,628 @@
+#include "vnxvideoimpl.h"
+#include "vnxvideologimpl.h"
+#include "RawSample.h"
+#include "LocalTransport.h"
+#include "FrameTrace.h"
+
+#include <set>
+#include <map>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <system_error>
+#include <boost/asio.hpp>
+#ifndef _WIN32
+#include <boost/asio/steady_timer.hpp>
+#endif
+#include <boost/bind.hpp>
+
+#include "Win32Utils.h"
+
+// Local transport of coded media (access units of H.264/HEVC, audio frames). Unlike raw samples,
+// coded frames cannot be skipped at will, so every client gets every access unit, in order.
+// A client which does not free access units fast enough loses them until the next keyframe.
+
+#pragma pack(push)
+#pragma pack(1)
+struct SMediaBufferMsg {
+    uint64_t pointer; // offset in the provider's shm segment
+    uint64_t timestamp;
+    int subtype; // EMediaSubtype
+    int size;
+    int flags;
+    int reserved;
+    // total 32 bytes
+};
+#pragma pack(pop)
+
+const int MEDIA_FLAG_KEYFRAME = 1;
+
+// [1, flags] -> start sending access units to the client; flags may include JOIN_AT_KEYFRAME
+const uint64_t CMD_MEDIA_JOIN = 1;
+const uint64_t JOIN_AT_KEYFRAME = 1;
+// [2, count] followed by count handles -> free access units
+const uint64_t CMD_MEDIA_FREE_BATCH = 2;
+
+const size_t MAX_HELD_BUFFERS = 256; // access units a client may hold before it starts to lose them
+const uint64_t MAX_MEDIA_FREE_BATCH = 4096;
+
+static bool isVideoSubtype(EMediaSubtype subtype) {
+    return subtype == EMST_H264 || subtype == EMST_HEVC;
+}
+
+// Whether an Annex B access unit contains an IDR (H.264) or IRAP (HEVC) picture.
+// All pictures of an access unit are of the same kind, so the first VCL NAL unit decides.
+// Non-video buffers are all keyframes.
+static bool isKeyframe(EMediaSubtype subtype, const uint8_t* data, int size) {
+    if (!isVideoSubtype(subtype))
+        return true;
+    for (int k = 0; k + 3 < size; ++k) {
+        if (data[k] != 0 || data[k + 1] != 0 || data[k + 2] != 1)
+            continue;
+        const uint8_t header = data[k + 3];
+        if (subtype == EMST_H264) {
+            const int type = header & 0x1f;
+            if (type >= 1 && type <= 5)
+                return type == 5;
+        }
+        else {
+            const int type = (header >> 1) & 0x3f;
+            if (type <= 31)
+                return type >= 16 && type <= 21;
+        }
+        k += 2;
+    }
+    return false;
+}
+
+struct SMediaConnection { // connection to a local media client:
+    pipe_t pipe;
+    const int id;
+    bool joined; // the client asked for access units
+    bool waitKeyframe; // the client joins, or has lost access units, and waits for the next keyframe
+    std::map<uint64_t, std::shared_ptr<void> > held; // access units sent to the client and not freed yet
+    std::deque<SMediaBufferMsg> out; // front is being written
+    uint64_t in[2];
+    std::vector<uint64_t> batch;
+    uint64_t delivered;
+    uint64_t dropped;
+
+#ifdef _WIN32
+    SMediaConnection(boost::asio::io_service& ios, pipe_t::native_handle_type handle, int id)
+        : pipe(ios, handle)
+#else
+    SMediaConnection(boost::asio::io_service& ios, int id)
+        : pipe(ios)
+#endif
+        , id(id)
+        , joined(false)
+        , waitKeyframe(false)
+        , delivered(0)
+        , dropped(0)
+    {
+    }
+};
+
+// OUTPUT coded media channel. Copies access units into a shared memory segment, unless they
+// are already there, and publishes them to CLocalMediaClients of other processes.
+class CLocalMediaProvider : public VnxVideo::ILocalMediaProvider {
+public:
+    CLocalMediaProvider(const std::string& address, int maxSizeMB, PShmAllocator allocator = PShmAllocator())
+        : m_address(address)
+        , m_allocator(allocator)
+        , m_shutdown(false)
+        , m_nextConnectionId(0)
+#ifndef _WIN32
+        , m_acceptor(LocalTransportIoService())
+#endif
+    {
+        if (!m_allocator.get()) {
+            m_allocator.reset(CreateShmAllocator(address.c_str(), maxSizeMB));
+        }
+        bind();
+        listen();
+    }
+    ~CLocalMediaProvider() {
+        m_strand.Post([this]() { shutdown(); });
+        m_strand.Wait();
+    }
+private:
+    void shutdown() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+#ifndef _WIN32
+        try {
+            m_acceptor.cancel();
+        }
+        catch (const std::exception&) {
+        }
+#endif
+        for (auto p : m_connections) {
+            if (p->pipe.is_open()) {
+                p->pipe.cancel();
+                p->pipe.close();
+            }
+        }
+    }
+#ifdef _WIN32
+    void bind() {}
+    void listen() {
+        std::shared_ptr<SECURITY_ATTRIBUTES> psa(BuildSecurityAttributes777());
+
+        pipe_t::native_handle_type pipeh = CreateNamedPipeA((PIPE_PATH_PREFIX + m_address).c_str(),
+            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES, 8192, 8192, 10000, psa.get());
+        if (INVALID_HANDLE_VALUE == pipeh)
+            throw std::system_error(GetLastError(), std::system_category());
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto conn = std::make_shared<SMediaConnection>(LocalTransportIoService(), pipeh, ++m_nextConnectionId);
+        m_connections.insert(conn);
+
+        boost::asio::windows::overlapped_ptr op(LocalTransportIoService(),
+            m_strand.Wrap(boost::bind(&CLocalMediaProvider::acceptHandler, this, conn, _1, _2)));
+        BOOL ok = ConnectNamedPipe(conn->pipe.native_handle(), op.get());
+        int err = GetLastError();
+        if (!ok && err != ERROR_IO_PENDING) {
+            op.complete(boost::system::error_code(err, boost::system::system_category()), 0);
+        }
+        else
+            op.release();
+    }
+#else
+    void bind() {
+        std::string addr(PIPE_PATH_PREFIX + m_address);
+        unlink(addr.c_str());
+        boost::asio::local::stream_protocol::endpoint endpoint(addr);
+        m_acceptor.open(endpoint.protocol());
+        m_acceptor.set_option(boost::asio::local::stream_protocol::acceptor::reuse_address(true));
+        m_acceptor.bind(endpoint);
+        m_acceptor.listen();
+    }
+    void listen() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto conn = std::make_shared<SMediaConnection>(LocalTransportIoService(), ++m_nextConnectionId);
+        m_connections.insert(conn);
+
+        m_acceptor.async_accept(conn->pipe,
+            m_strand.Wrap(boost::bind(&CLocalMediaProvider::acceptHandler, this, conn, _1, 0)));
+    }
+#endif
+    void acceptHandler(std::shared_ptr<SMediaConnection> conn, const boost::system::error_code & ec, size_t n) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_shutdown)
+                return;
+        }
+        listen(); // the connection is accepted, but we should start to listen for a new one
+        if (!ec) {
+            VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalMediaProvider::acceptHandler: Accepted connection to local media transport " << m_address;
+            scheduleRead(conn);
+        }
+        else {
+            VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalMediaProvider::acceptHandler: Listening for connection to local media transport "
+                << m_address << " failed: " << ec;
+            dropConnection(conn);
+        }
+    }
+    void scheduleRead(std::shared_ptr<SMediaConnection> conn) {
+        boost::asio::async_read(conn->pipe, boost::asio::buffer(conn->in, sizeof(conn->in)),
+            m_strand.Wrap(boost::bind(&CLocalMediaProvider::readHandler, this, conn, _1, _2)));
+    }
+    void readHandler(std::shared_ptr<SMediaConnection> conn, const boost::system::error_code & ec, size_t n) {
+        if (ec) {
+            if (ec != boost::system::errc::operation_canceled) {
+                VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalMediaProvider::readHandler: Error on reading from named pipe: " << ec;
+                dropConnection(conn);
+            }
+            return;
+        }
+        const uint64_t command = conn->in[0];
+        const uint64_t argument = conn->in[1];
+        if (command == CMD_MEDIA_JOIN) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            conn->joined = true;
+            conn->waitKeyframe = (argument & JOIN_AT_KEYFRAME) != 0;
+        }
+        else if (command == CMD_MEDIA_FREE_BATCH) {
+            if (argument > MAX_MEDIA_FREE_BATCH) {
+                VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalMediaProvider::readHandler: Too many buffers to free: " << argument;
+                dropConnection(conn);
+                return;
+            }
+            conn->batch.resize((size_t)argument);
+            boost::asio::async_read(conn->pipe, boost::asio::buffer(conn->batch),
+                m_strand.Wrap(boost::bind(&CLocalMediaProvider::batchReadHandler, this, conn, _1, _2)));
+            return;
+        }
+        else
+            VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalMediaProvider::readHandler: Unknown command in local media transport: " << command;
+        scheduleRead(conn);
+    }
+    void batchReadHandler(std::shared_ptr<SMediaConnection> conn, const boost::system::error_code & ec, size_t n) {
+        if (ec) {
+            if (ec != boost::system::errc::operation_canceled) {
+                VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalMediaProvider::batchReadHandler: Error on reading from named pipe: " << ec;
+                dropConnection(conn);
+            }
+            return;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (uint64_t pointer : conn->batch)
+            conn->held.erase(pointer);
+        lock.unlock();
+        scheduleRead(conn);
+    }
+    void startWrite(std::shared_ptr<SMediaConnection> conn) { // under the lock!!!
+        boost::asio::async_write(conn->pipe,
+            boost::asio::buffer(&conn->out.front(), sizeof(SMediaBufferMsg)),
+            m_strand.Wrap(boost::bind(&CLocalMediaProvider::writeHandler, this, conn, _1, _2)));
+    }
+    void writeHandler(std::shared_ptr<SMediaConnection> conn, const boost::system::error_code & ec, size_t n) {
+        if (ec) {
+            if (ec != boost::system::errc::operation_canceled) {
+                VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalMediaProvider::writeHandler: Error on writing to named pipe: " << ec;
+                dropConnection(conn);
+            }
+            return;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        conn->out.pop_front();
+        if (!conn->out.empty())
+            startWrite(conn);
+    }
+    void dropConnection(std::shared_ptr<SMediaConnection> conn) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_connections.erase(conn);
+        try {
+            conn->pipe.cancel();
+            conn->pipe.close();
+        }
+        catch (const std::exception&) {
+        }
+    }
+public:
+    virtual void Process(EMediaSubtype subtype, VnxVideo::IBuffer* buffer, uint64_t timestamp) {
+        uint8_t* data;
+        int size;
+        buffer->GetData(data, size);
+        if (nullptr == data || size <= 0)
+            return;
+
+        SMediaBufferMsg m;
+        memset(&m, 0, sizeof m);
+        m.timestamp = timestamp;
+        m.subtype = subtype;
+        m.size = size;
+
+        bool taken = false; // some client takes the buffer whether it is a keyframe or not
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            bool joined = false;
+            for (auto& c : m_connections) {
+                joined = joined || c->joined;
+                taken = taken || (c->joined && !(c->waitKeyframe && isVideoSubtype(subtype)));
+            }
+            if (!joined)
+                return;
+        }
+        const bool keyframe = isKeyframe(subtype, data, size);
+        if (!taken && !keyframe)
+            return; // all clients wait for a keyframe
+        m.flags = keyframe ? MEDIA_FLAG_KEYFRAME : 0;
+
+        std::shared_ptr<void> holder;
+        if (m_allocator->Contains(data)) {
+            // encoders which allocate from the preferred shm allocator need no copy
+            m.pointer = m_allocator->FromPointer(data);
+            holder.reset(buffer->Dup());
+        }
+        else {
+            std::shared_ptr<uint8_t> copy(m_allocator->Alloc(size));
+            if (!copy) {
+                VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "CLocalMediaProvider::Process: Out of shared memory on " << m_address;
+                std::unique_lock<std::mutex> lock(m_mutex);
+                for (auto& c : m_connections)
+                    loseBuffer(c);
+                return;
+            }
+            memcpy(copy.get(), data, size);
+            m.pointer = m_allocator->FromPointer(copy.get());
+            holder = copy;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto& c : m_connections) {
+            if (!c->joined)
+                continue;
+            if (c->waitKeyframe && isVideoSubtype(subtype)) { // audio does not wait for video keyframes
+                if (!keyframe)
+                    continue;
+                c->waitKeyframe = false;
+            }
+            if (c->held.size() >= MAX_HELD_BUFFERS) {
+                loseBuffer(c);
+                continue;
+            }
+            c->held[m.pointer] = holder;
+            ++c->delivered;
+            c->out.push_back(m);
+            if (c->out.size() == 1)
+                startWrite(c);
+        }
+    }
+private:
+    void loseBuffer(std::shared_ptr<SMediaConnection> conn) { // under the lock!!!
+        if (!conn->joined)
+            return;
+        ++conn->dropped;
+        if (!conn->waitKeyframe)
+            VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "CLocalMediaProvider: Client " << conn->id << " of " << m_address
+                << " does not keep up, skipping to the next keyframe";
+        conn->waitKeyframe = true;
+    }
+
+    CEndpointStrand m_strand;
+    const std::string m_address;
+    PShmAllocator m_allocator;
+    std::mutex m_mutex;
+    std::set<std::shared_ptr<SMediaConnection> > m_connections;
+    bool m_shutdown;
+    int m_nextConnectionId;
+#ifndef _WIN32
+    boost::asio::local::stream_protocol::acceptor m_acceptor;
+#endif
+};
+
+// Access unit in the provider's shm segment. Dup is shallow: the provider gets the buffer back
+// once the last copy is gone.
+class CShmMediaBuffer : public VnxVideo::IBuffer {
+public:
+    CShmMediaBuffer(uint8_t* data, int size, std::shared_ptr<void> holder)
+        : m_data(data)
+        , m_size(size)
+        , m_holder(holder)
+    {
+    }
+    virtual void GetData(uint8_t* &data, int& size) {
+        data = m_data;
+        size = m_size;
+    }
+    virtual VnxVideo::IBuffer* Dup() {
+        return new CShmMediaBuffer(*this);
+    }
+    virtual bool GetTrace(VnxVideo::SFrameTrace& trace) {
+        trace = m_trace;
+        return m_trace.ingestNs != 0;
+    }
+    virtual void SetTrace(const VnxVideo::SFrameTrace& trace) {
+        m_trace = trace;
+    }
+private:
+    uint8_t* m_data;
+    int m_size;
+    std::shared_ptr<void> m_holder;
+    VnxVideo::SFrameTrace m_trace;
+};
+
+// INPUT coded media channel. Acquires access units from a CLocalMediaProvider of another process
+// and presents them as a media source.
+class CLocalMediaClient : public VnxVideo::IMediaSource {
+public:
+    CLocalMediaClient(const std::string& address, bool joinAtKeyframe)
+        : m_address(address)
+        , m_joinAtKeyframe(joinAtKeyframe)
+        , m_timer(LocalTransportIoService())
+        , m_pipe(LocalTransportIoService())
+        , m_writing(false)
+        , m_running(false)
+    {
+    }
+    ~CLocalMediaClient() {
+        Stop();
+    }
+private:
+#ifdef _WIN32
+    void openPipe() {
+        pipe_t::native_handle_type pipeh = CreateFileA((PIPE_PATH_PREFIX + m_address).c_str(),
+            GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+            OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
+        if (INVALID_HANDLE_VALUE == pipeh) {
+            DWORD err = GetLastError();
+            throw std::system_error(err, std::system_category());
+        }
+        m_pipe = pipe_t(LocalTransportIoService(), pipeh);
+    }
+#else
+    void openPipe() {
+        boost::asio::local::stream_protocol::endpoint endpoint(PIPE_PATH_PREFIX + m_address);
+        pipe_t pipe(LocalTransportIoService());
+        pipe.connect(endpoint);
+        m_pipe = std::move(pipe);
+    }
+#endif
+    void connect() {
+        openPipe();
+        m_mapping.reset(CreateShmMapping(m_address.c_str()));
+        m_shared.reset(new SFree());
+        m_writing = false;
+        m_commands.clear();
+        m_commands.push_back(CMD_MEDIA_JOIN);
+        m_commands.push_back(m_joinAtKeyframe ? JOIN_AT_KEYFRAME : 0);
+        m_writing = true;
+        boost::asio::async_write(m_pipe, boost::asio::buffer(m_commands),
+            m_strand.Wrap(boost::bind(&CLocalMediaClient::writeHandler, this, _1, _2)));
+        scheduleRead();
+    }
+    void scheduleRead() {
+        boost::asio::async_read(m_pipe, boost::asio::buffer(&m_msg, sizeof(m_msg)),
+            m_strand.Wrap(boost::bind(&CLocalMediaClient::readHandler, this, _1, _2)));
+    }
+    void readHandler(const boost::system::error_code & ec, size_t n) {
+        if (ec) {
+            if (ec != boost::system::errc::operation_canceled) {
+                VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalMediaClient::readHandler: Error on reading from named pipe: " << ec;
+                scheduleReconnect();
+            }
+            return;
+        }
+        deliver(m_msg);
+        flushFrees();
+        scheduleRead();
+    }
+    void flushFrees() {
+        if (m_writing)
+            return;
+        m_commands.clear();
+        {
+            std::unique_lock<std::mutex> lock(m_shared->mutex);
+            if (m_shared->free.empty())
+                return;
+            m_commands.push_back(CMD_MEDIA_FREE_BATCH);
+            m_commands.push_back(m_shared->free.size());
+            m_commands.insert(m_commands.end(), m_shared->free.begin(), m_shared->free.end());
+            m_shared->free.clear();
+        }
+        m_writing = true;
+        boost::asio::async_write(m_pipe, boost::asio::buffer(m_commands),
+            m_strand.Wrap(boost::bind(&CLocalMediaClient::writeHandler, this, _1, _2)));
+    }
+    void writeHandler(const boost::system::error_code & ec, size_t n) {
+        m_writing = false;
+        if (ec) {
+            if (ec != boost::system::errc::operation_canceled) {
+                VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalMediaClient::writeHandler: Error on writing to named pipe: " << ec;
+                scheduleReconnect();
+            }
+            return;
+        }
+        flushFrees();
+    }
+    void deliver(const SMediaBufferMsg& m) {
+        const EMediaSubtype subtype = (EMediaSubtype)m.subtype;
+        std::vector<VnxVideo::TOnBufferCallback> callbacks;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_subtypes.insert(subtype);
+            for (auto& s : m_subscriptions) {
+                if (s.first == EMST_ANY || s.first == subtype)
+                    callbacks.push_back(s.second);
+            }
+        }
+        auto shared(m_shared);
+        auto segment(m_mapping->Retain(m.pointer));
+        std::shared_ptr<void> holder((void*)m.pointer, [shared, segment](void* p) {
+            std::unique_lock<std::mutex> lock(shared->mutex);
+            shared->free.push_back((uint64_t)p);
+        });
+        CShmMediaBuffer buffer((uint8_t*)m_mapping->ToPointer(m.pointer), m.size, holder);
+        holder.reset();
+        buffer.SetTrace(NewFrameTrace()); // frames of other processes enter this one here
+        for (auto& cb : callbacks)
+            cb(&buffer, m.timestamp);
+    }
+    void scheduleReconnect() {
+        try {
+            m_pipe.close();
+        }
+        catch (const boost::system::system_error&) {
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_running)
+                return;
+        }
+        m_timer.expires_from_now(std::chrono::nanoseconds(1000000000));
+        m_timer.async_wait(m_strand.Wrap([this](const boost::system::error_code & ec) {
+            if (!ec) {
+                try {
+                    connect();
+                }
+                catch (const std::exception& e) {
+                    VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "CLocalMediaClient::scheduleReconnect: " << e.what();
+                    scheduleReconnect();
+                }
+            }
+        }));
+    }
+public: // IMediaSource
+    virtual void SubscribeMedia(EMediaSubtype mediaSubtype, VnxVideo::TOnBufferCallback onBuffer) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_subscriptions.emplace_back(mediaSubtype, onBuffer);
+    }
+    virtual void SubscribeJson(VnxVideo::TOnJsonCallback onJson) {
+    }
+    virtual void Run() {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_running = true;
+        }
+        m_strand.Post([this]() {
+            try {
+                connect();
+            }
+            catch (const std::exception&) {
+                scheduleReconnect();
+            }
+        });
+    }
+    virtual void Stop() {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_strand.Post([this]() {
+            m_timer.cancel();
+            try {
+                if (m_pipe.is_open()) {
+                    m_pipe.cancel();
+                    m_pipe.close();
+                }
+            }
+            catch (const std::exception&) {
+            }
+        });
+        m_strand.Wait();
+    }
+    // subtypes received so far
+    virtual std::vector<EMediaSubtype> EnumMediatypes() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return std::vector<EMediaSubtype>(m_subtypes.begin(), m_subtypes.end());
+    }
+    // parameter sets travel in-band, with keyframes
+    virtual VnxVideo::IBuffer* GetExtradata(EMediaSubtype mediaSubtype) {
+        return nullptr;
+    }
+private:
+    const std::string m_address;
+    const bool m_joinAtKeyframe;
+    CEndpointStrand m_strand;
+    boost::asio::steady_timer m_timer;
+    pipe_t m_pipe;
+    std::shared_ptr<IShmMapping> m_mapping;
+
+    // handles of access units to be freed; buffers may outlive this object
+    struct SFree {
+        std::mutex mutex;
+        std::vector<uint64_t> free;
+    };
+    std::shared_ptr<SFree> m_shared;
+    std::vector<uint64_t> m_commands; // being written
+    bool m_writing;
+    SMediaBufferMsg m_msg; // being read
+
+    std::mutex m_mutex;
+    bool m_running;
+    std::vector<std::pair<EMediaSubtype, VnxVideo::TOnBufferCallback> > m_subscriptions;
+    std::set<EMediaSubtype> m_subtypes;
+};
+
+namespace VnxVideo {
+    ILocalMediaProvider *CreateLocalMediaProvider(const char* name, int maxSizeMB) {
+        return new CLocalMediaProvider(name, maxSizeMB, DupPreferredShmAllocator());
+    }
+    IMediaSource *CreateLocalMediaClient(const char* name, bool joinAtKeyframe) {
+        return new CLocalMediaClient(name, joinAtKeyframe);
+    }
+}
@@ -1,8 +1,13 @@
 #include "vnxvideoimpl.h"
 #include "vnxvideologimpl.h"
 #include "RawSample.h"
+#include "ShmRing.h"
+#include "LocalTransport.h"
+#include "FrameTrace.h"
+#include "EventTrace.h"
 
 #include <set>
+#include <deque>
 #include <vector>
 #include <thread>
 #include <mutex>
@@ -15,6 +20,8 @@
 #include <boost/asio/local/stream_protocol.hpp>
 #endif
 #include <boost/bind.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include "Win32Utils.h"
 
@@ -44,70 +51,192 @@ struct SRawSampleMsg {
 const uint64_t CMD_REQUEST = 0;
 const uint64_t CMD_FREE = 1;
 const uint64_t CMD_FREE_AND_REQUEST = 2;
+// [3, capacity] -> switch the connection to shared memory rings. The reply is a SRawSampleMsg
+// with format EMF_NONE, pointer set to the ring id and nplanes set to the ring capacity,
+// or to 0 if the provider cannot do that. The pipe is then only used to detect disconnection.
+// A client which cannot open the ring sends CMD_REQUEST or CMD_CREDIT instead, which turns the connection
+// back to the pipe protocol.
+const uint64_t CMD_RING = 3;
 
-#ifdef _WIN32
-typedef boost::asio::windows::stream_handle pipe_t;
-#else
-typedef boost::asio::local::stream_protocol::socket pipe_t;
-#endif
+// [4, n] -> the client can take n more frames; the provider pushes frames without waiting for requests
+// while the client has credits. Each frame sent takes one credit.
+const uint64_t CMD_CREDIT = 4;
+// [5, count] followed by count handles -> free frames
+const uint64_t CMD_FREE_BATCH = 5;
+// [6, rate] -> limit the rate of frames sent to the client. Low 32 bits of rate are the max fps
+// in millihertz, high 32 bits are the minimum interval between frames in microseconds; 0 means no limit.
+// Frames published before the next frame is due are not sent to the client at all.
+const uint64_t CMD_RATE = 6;
+
+typedef CShmRing<SRawSampleMsg> CSampleRing;
+const uint32_t MAX_RING_CAPACITY = 64;
+const int MAX_CREDITS = 64;
+const uint64_t MAX_FREE_BATCH = 4096;
+const size_t MAX_RECLAIMED = 4096; // frees of reclaimed frames to wait for, before the client is given up on
+
+// A frame sent to a client and not freed by it yet
+struct SLease {
+    std::shared_ptr<VnxVideo::IRawSample> sample;
+    int64_t bytes;
+    std::chrono::steady_clock::time_point since;
+};
+
+boost::asio::io_service& LocalTransportIoService() {
+    struct SReactor {
+        boost::asio::io_service ios;
+        boost::asio::io_service::work work;
+        SReactor()
+            : work(ios)
+        {
+            int threads = std::max(1, std::min(4, (int)std::thread::hardware_concurrency()));
+            const char* const threadsEnv = getenv("VNX_LOCAL_IO_THREADS");
+            if (threadsEnv != nullptr)
+                threads = std::max(1, atoi(threadsEnv));
+            VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "Local transport runs " << threads << " io threads";
+            for (int k = 0; k < threads; ++k) {
+                std::thread([this]() {
+                    for (;;) {
+                        try {
+                            ios.run();
+                            return;
+                        }
+                        catch (const std::exception& e) {
+                            VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "LocalTransportIoService: caught exception: " << e.what();
+                        }
+                    }
+                }).detach();
+            }
+        }
+    };
+    static SReactor* reactor = new SReactor;
+    return reactor->ios;
+}
+
+// Rings live in their own small shm objects, as clients map frame memory read only
+std::string ringShmName(const std::string& address, uint64_t id) {
+    return "viinex_ring_" + address + "_" + std::to_string(id);
+}
 
 struct SConnection { // connection to a local transport client:
     pipe_t pipe; // communication pipe
-    std::map<uint64_t, std::shared_ptr<VnxVideo::IRawSample> > samples; // samples held by that client
+    std::map<uint64_t, SLease> samples; // samples held by that client
+    int64_t heldBytes; // total size of samples held by the client
+    std::multiset<uint64_t> reclaimed; // taken back from the client, which is still to free them
+    uint64_t rejected; // frames not sent because the client held too much
+    uint64_t reclaimedTotal; // leases which have expired
+    bool lagging; // the client has frames reclaimed and not freed yet
     uint64_t lastSeenIndex; // index of the last sample sent to the client
-    SRawSampleMsg out; // frames sent to the client
-    size_t written;
+    bool accepted; // false for the connection which is waiting for a client
+    uint64_t startIndex; // index of the last sample published before the client connected
+    uint64_t delivered; // number of samples sent to the client
+    int credits; // number of frames which may be pushed to the client without a request
+    std::chrono::steady_clock::duration minInterval; // between frames sent to the client, if it asked for decimation
+    std::chrono::steady_clock::time_point nextDue; // when the client may get the next frame
+    std::deque<SRawSampleMsg> out; // frames sent to the client, front is being written
     uint64_t in[2]; // commands received from client: [0, _] -> request frame, [1, handle] -> free frame.
     size_t read;
+    std::vector<uint64_t> batch; // handles of CMD_FREE_BATCH
+    std::unique_ptr<boost::interprocess::mapped_region> ringRegion; // for connections which use rings
+    std::unique_ptr<CSampleRing> ring;
+    uint32_t ringCapacity;
+    const int id; // sequential number of the connection within its provider, for diagnostics
 
 #ifdef _WIN32
-    SConnection(boost::asio::io_service& ios, pipe_t::native_handle_type handle)
+    SConnection(boost::asio::io_service& ios, pipe_t::native_handle_type handle, int id)
         : pipe(ios, handle)
+        , heldBytes(0)
+        , rejected(0)
+        , reclaimedTotal(0)
+        , lagging(false)
         , lastSeenIndex(0)
+        , accepted(false)
+        , startIndex(0)
+        , delivered(0)
+        , credits(0)
+        , minInterval(0)
         , read(0)
+        , ringCapacity(0)
+        , id(id)
     {
     }
 #else
-    SConnection(boost::asio::io_service& ios)
+    SConnection(boost::asio::io_service& ios, int id)
         : pipe(ios)
+        , heldBytes(0)
+        , rejected(0)
+        , reclaimedTotal(0)
+        , lagging(false)
         , lastSeenIndex(0)
+        , accepted(false)
+        , startIndex(0)
+        , delivered(0)
+        , credits(0)
+        , minInterval(0)
         , read(0)
+        , ringCapacity(0)
+        , id(id)
     {
     }
 #endif
 };
 
-#ifdef _WIN32
-const std::string PIPE_PATH_PREFIX = "\\\\.\\pipe\\viinex_pipe_";
-#else
-const std::string PIPE_PATH_PREFIX = "/tmp/viinex_pipe_";
-#endif
+class CLocalVideoProvider;
+// Live providers, so that memory held by their clients can be reported.
+struct SLocalProviderRegistry {
+    std::mutex mutex;
+    std::set<CLocalVideoProvider*> providers;
+};
+static SLocalProviderRegistry& localProviderRegistry() {
+    static SLocalProviderRegistry* registry = new SLocalProviderRegistry;
+    return *registry;
+}
 
 // OUTPUT video channel. A local named pipe server 
 // which publishes a raw video stream and allows other 
 // processes to subscribe to it using the CLocalVideoClients.
+// Clients lease the frames they are sent until they free them. VNX_LOCAL_MAX_HELD_FRAMES (64 by default)
+// and VNX_LOCAL_MAX_HELD_MB (unlimited by default) bound what a client may hold; frames beyond that are
+// not sent to it. Leases older than VNX_LOCAL_LEASE_TIMEOUT_MS, if set, are taken back from the client.
 class CLocalVideoProvider : public VnxVideo::IRawProc {
 private:
 
 public:
     CLocalVideoProvider(const std::string& address, int maxSizeMB, PShmAllocator allocator= PShmAllocator())
+#ifndef _WIN32
+        : m_acceptor(LocalTransportIoService())
+        , m_address(address)
+#else
         : m_address(address)
+#endif
         , m_allocator(allocator) 
         , m_timestamp(0)
         , m_currentIndex(0)
         , m_shutdown(false)
         , m_audioSampleRateShl4(0)
-#ifndef _WIN32
-        , m_acceptor(m_ios)
-#endif
+        , m_nextConnectionId(0)
+        , m_sampleBytes(0)
+        , m_maxHeldFrames(64)
+        , m_maxHeldBytes(0)
+        , m_leaseTimeout(0)
     {
         if (!m_allocator.get()) {
             m_allocator.reset(CreateShmAllocator(address.c_str(), maxSizeMB));
         }
-        auto pios(&m_ios);
+        const char* const framesEnv = getenv("VNX_LOCAL_MAX_HELD_FRAMES");
+        if (framesEnv != nullptr)
+            m_maxHeldFrames = std::max(0, atoi(framesEnv));
+        const char* const bytesEnv = getenv("VNX_LOCAL_MAX_HELD_MB");
+        if (bytesEnv != nullptr)
+            m_maxHeldBytes = std::max<int64_t>(0, atoi(bytesEnv)) * 1024 * 1024;
+        const char* const leaseEnv = getenv("VNX_LOCAL_LEASE_TIMEOUT_MS");
+        if (leaseEnv != nullptr)
+            m_leaseTimeout = std::chrono::milliseconds(std::max(0, atoi(leaseEnv)));
         bind();
         listen();
-        m_thread = std::move(std::thread([pios]() {pios->run(); }));
+
+        SLocalProviderRegistry& registry = localProviderRegistry();
+        std::unique_lock<std::mutex> lock(registry.mutex);
+        registry.providers.insert(this);
     }
 #ifdef _WIN32
     void bind() {}
@@ -120,12 +249,12 @@ public:
         if (INVALID_HANDLE_VALUE == pipeh)
             throw std::system_error(GetLastError(), std::system_category());
 
-        auto conn = std::make_shared<SConnection>(m_ios, pipeh);
         std::unique_lock<std::mutex> lock(m_mutex);
+        auto conn = std::make_shared<SConnection>(LocalTransportIoService(), pipeh, ++m_nextConnectionId);
         m_connections.insert(conn);
 
-        boost::asio::windows::overlapped_ptr op(m_ios, 
-            boost::bind(&CLocalVideoProvider::acceptHandler, this, conn, _1, _2));
+        boost::asio::windows::overlapped_ptr op(LocalTransportIoService(),
+            m_strand.Wrap(boost::bind(&CLocalVideoProvider::acceptHandler, this, conn, _1, _2)));
         BOOL ok = ConnectNamedPipe(conn->pipe.native_handle(), op.get());
         int err = GetLastError();
         if (!ok && err != ERROR_IO_PENDING) {
@@ -145,13 +274,13 @@ public:
         m_acceptor.listen();
     }
     void listen(){
-        auto conn = std::make_shared<SConnection>(m_ios);
         std::unique_lock<std::mutex> lock(m_mutex);
+        auto conn = std::make_shared<SConnection>(LocalTransportIoService(), ++m_nextConnectionId);
         m_connections.insert(conn);
 
         m_acceptor.async_accept(conn->pipe,
-                                boost::bind(&CLocalVideoProvider::acceptHandler,
-                                            this, conn, _1, 0));
+                                m_strand.Wrap(boost::bind(&CLocalVideoProvider::acceptHandler,
+                                            this, conn, _1, 0)));
     }
 #endif
     void acceptHandler(std::shared_ptr<SConnection> conn, const boost::system::error_code & ec, size_t n) {
@@ -159,6 +288,8 @@ public:
         if (m_shutdown) {
             return;
         }
+        conn->accepted = !ec;
+        conn->startIndex = m_sample ? m_currentIndex - 1 : m_currentIndex;
         lock.unlock();
         listen(); // the connection is accepted, but we should start to listen for a new one
         if (!ec) {
@@ -188,7 +319,7 @@ public:
                 boost::asio::async_read(conn->pipe,
                     boost::asio::buffer((uint8_t*)(conn->in) + conn->read,
                         sizeof(conn->in) - conn->read),
-                    boost::bind(&CLocalVideoProvider::readHandler, this, conn, _1, _2));
+                    m_strand.Wrap(boost::bind(&CLocalVideoProvider::readHandler, this, conn, _1, _2)));
             }
             else {
                 const uint64_t command = conn->in[0];
@@ -201,6 +332,24 @@ public:
                     freeFrame(conn, argument);
                     requestFrame(conn);
                 }
+                else if (command == CMD_RING)
+                    setupRing(conn, argument);
+                else if (command == CMD_CREDIT)
+                    grantCredits(conn, argument);
+                else if (command == CMD_RATE)
+                    setRate(conn, argument);
+                else if (command == CMD_FREE_BATCH) {
+                    if (argument > MAX_FREE_BATCH) {
+                        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalVideoProvider::readHandler: Too many frames to free: " << argument;
+                        dropConnection(conn);
+                        return;
+                    }
+                    conn->batch.resize((size_t)argument);
+                    boost::asio::async_read(conn->pipe,
+                        boost::asio::buffer(conn->batch),
+                        m_strand.Wrap(boost::bind(&CLocalVideoProvider::batchReadHandler, this, conn, _1, _2)));
+                    return;
+                }
                 else
                     VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalVideoProvider::readHandler: Unknown command in local transport: " << conn->in[0];
 
@@ -208,21 +357,183 @@ public:
             }
         }
     }
+    void batchReadHandler(std::shared_ptr<SConnection> conn, const boost::system::error_code & ec, size_t n) {
+        if (ec) {
+            if (ec != boost::system::errc::operation_canceled) {
+                VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalVideoProvider::batchReadHandler: Error on reading from named pipe: " << ec;
+                dropConnection(conn);
+            }
+        }
+        else {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (uint64_t frameId : conn->batch)
+                releaseFrame(conn, frameId);
+            lock.unlock();
+            scheduleRead(conn);
+        }
+    }
+    void grantCredits(std::shared_ptr<SConnection> conn, uint64_t n) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (conn->ring)
+            abandonRing(conn);
+        conn->credits = (int)std::min<uint64_t>(MAX_CREDITS, conn->credits + n);
+        m_creditConnections.insert(conn);
+        m_starving.erase(conn);
+        if (conn->credits > 0 && m_sample.get() && (conn->lastSeenIndex < m_currentIndex) && due(conn) && admit(conn)) {
+            --conn->credits;
+            sendCurrentFrame(conn);
+        }
+    }
     void requestFrame(std::shared_ptr<SConnection> conn) {
         std::unique_lock<std::mutex> lock(m_mutex);
-        if (m_sample.get() && (conn->lastSeenIndex < m_currentIndex))
+        if (conn->ring)
+            abandonRing(conn);
+        if (m_sample.get() && (conn->lastSeenIndex < m_currentIndex) && due(conn) && admit(conn))
             sendCurrentFrame(conn); // under the lock!
         else
             m_starving.insert(conn);
     }
+    // the client could not open its ring and falls back to the pipe protocol; frames pushed to the ring
+    // have never reached it
+    void abandonRing(std::shared_ptr<SConnection> conn) { // under the lock!!!
+        VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalVideoProvider::abandonRing: Client of " << m_address
+            << " did not open its shared memory ring, falling back to pipe transport";
+        m_ringConnections.erase(conn);
+        conn->ring->Close();
+        conn->ring.reset();
+        conn->ringRegion.reset();
+        boost::interprocess::shared_memory_object::remove(ringShmName(m_address, conn->id).c_str());
+        conn->samples.clear();
+        conn->heldBytes = 0;
+        conn->reclaimed.clear();
+        conn->lagging = false;
+    }
     void freeFrame(std::shared_ptr<SConnection> conn, uint64_t frameId) {
         std::unique_lock<std::mutex> lock(m_mutex);
-        conn->samples.erase(frameId);
+        releaseFrame(conn, frameId);
     }
-    void sendCurrentFrame(std::shared_ptr<SConnection> conn) { // under the lock!!!
-        conn->lastSeenIndex = m_currentIndex;
-
-        SRawSampleMsg& m = conn->out;
+    void releaseFrame(std::shared_ptr<SConnection> conn, uint64_t frameId) { // under the lock!!!
+        // a reclaimed frame may have been sent again at the same address, so frees are counted
+        // against reclaimed frames first, and the lease lasts until the last of them
+        auto r = conn->reclaimed.find(frameId);
+        if (r != conn->reclaimed.end()) {
+            conn->reclaimed.erase(r);
+            if (conn->reclaimed.empty())
+                conn->lagging = false;
+            return;
+        }
+        auto l = conn->samples.find(frameId);
+        if (l != conn->samples.end()) {
+            conn->heldBytes -= l->second.bytes;
+            conn->samples.erase(l);
+        }
+    }
+    bool admit(std::shared_ptr<SConnection> conn) { // under the lock!!!
+        if ((m_maxHeldFrames > 0 && (int)conn->samples.size() >= m_maxHeldFrames)
+            || (m_maxHeldBytes > 0 && conn->heldBytes + m_sampleBytes > m_maxHeldBytes)) {
+            ++conn->rejected;
+            return false;
+        }
+        return true;
+    }
+    void lease(std::shared_ptr<SConnection> conn, uint64_t frameId) { // under the lock!!!
+        SLease& l = conn->samples[frameId];
+        conn->heldBytes += m_sampleBytes - l.bytes;
+        l.sample = m_sample;
+        l.bytes = m_sampleBytes;
+        l.since = std::chrono::steady_clock::now();
+    }
+    void reclaimExpired(std::shared_ptr<SConnection> conn, std::chrono::steady_clock::time_point now) { // under the lock!!!
+        if (conn->ring)
+            drainReleases(conn);
+        uint64_t expired = 0;
+        for (auto l = conn->samples.begin(); l != conn->samples.end();) {
+            if (now - l->second.since >= m_leaseTimeout) {
+                conn->reclaimed.insert(l->first);
+                conn->heldBytes -= l->second.bytes;
+                l = conn->samples.erase(l);
+                ++expired;
+            }
+            else
+                ++l;
+        }
+        if (0 == expired)
+            return;
+        conn->reclaimedTotal += expired;
+        if (!conn->lagging)
+            VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "CLocalVideoProvider::reclaimExpired: Client " << conn->id << " of " << m_address
+                << " is lagging, " << expired << " frames reclaimed";
+        conn->lagging = true;
+        // rings bound the number of reclaimed frames by their capacity
+        if (!conn->ring && conn->reclaimed.size() > MAX_RECLAIMED)
+            conn->reclaimed.clear();
+    }
+    void setRate(std::shared_ptr<SConnection> conn, uint64_t rate) {
+        const uint64_t maxMilliFps = rate & 0xffffffff;
+        const uint64_t minIntervalUs = rate >> 32;
+        std::chrono::microseconds interval(minIntervalUs);
+        if (maxMilliFps > 0)
+            interval = std::max(interval, std::chrono::microseconds(1000000000ull / maxMilliFps));
+        std::unique_lock<std::mutex> lock(m_mutex);
+        conn->minInterval = interval;
+        conn->nextDue = std::chrono::steady_clock::now();
+        VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "CLocalVideoProvider::setRate: Client " << conn->id << " of " << m_address
+            << " gets a frame at most every " << interval.count() << " us";
+    }
+    bool due(std::shared_ptr<SConnection> conn) { // under the lock!!!
+        return conn->minInterval.count() == 0 || std::chrono::steady_clock::now() >= conn->nextDue;
+    }
+    void scheduleNext(std::shared_ptr<SConnection> conn) { // under the lock!!!
+        if (conn->minInterval.count() == 0)
+            return;
+        // keep to the grid so that the rate does not drift down with the source jitter,
+        // but do not let the client catch up after a pause
+        const auto now = std::chrono::steady_clock::now();
+        conn->nextDue += conn->minInterval;
+        if (conn->nextDue <= now)
+            conn->nextDue = now + conn->minInterval;
+    }
+    void setupRing(std::shared_ptr<SConnection> conn, uint64_t requestedCapacity) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        SRawSampleMsg m;
+        memset(&m, 0, sizeof m);
+        m.format = EMF_NONE;
+#ifdef __linux__
+        if (!conn->ring) {
+            uint32_t capacity = 1;
+            while (capacity < requestedCapacity && capacity < MAX_RING_CAPACITY)
+                capacity *= 2;
+            const std::string name(ringShmName(m_address, conn->id));
+            try {
+                using namespace boost::interprocess;
+                shared_memory_object::remove(name.c_str());
+                // clients of other users write releases to the ring too, like the main segment is open to them
+                permissions perm;
+                perm.set_unrestricted();
+                shared_memory_object shm(create_only, name.c_str(), read_write, perm);
+                shm.truncate(CSampleRing::Size(capacity));
+                conn->ringRegion.reset(new mapped_region(shm, read_write));
+                conn->ring.reset(new CSampleRing(conn->ringRegion->get_address(), capacity));
+                conn->ring->Init(capacity);
+                conn->ringCapacity = capacity;
+                m.pointer = conn->id;
+                m.nplanes = (int)capacity;
+                m_ringConnections.insert(conn);
+                m_starving.erase(conn);
+            }
+            catch (const std::exception& x) {
+                VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalVideoProvider::setupRing: caught exception: " << x.what();
+                conn->ring.reset();
+                conn->ringRegion.reset();
+                boost::interprocess::shared_memory_object::remove(name.c_str());
+            }
+        }
+#endif
+        if (0 == m.nplanes)
+            VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalVideoProvider::setupRing: Shared memory ring is not available on " << m_address;
+        enqueueMessage(conn, m);
+    }
+    void fillMessage(SRawSampleMsg& m) { // under the lock!!!
         uint8_t* planes[4];
         m.timestamp = m_timestamp;
         m_sample->GetFormat(m.format, m.param1, m.param2);
@@ -233,20 +544,58 @@ public:
         uint8_t* p0 = planes[0];
         for (int k = 0; k < 4; ++k)
             m.offsets[k] = (int)(planes[k] - p0);
-
+        m.pointer = m_allocator->FromPointer(planes[0]);
+    }
+    void drainReleases(std::shared_ptr<SConnection> conn) { // under the lock!!!
+        uint64_t released;
+        while (conn->ring->PopRelease(released))
+            releaseFrame(conn, released);
+    }
+    void pushCurrentFrame(std::shared_ptr<SConnection> conn) { // under the lock!!!
+        drainReleases(conn);
+        // the bound on frames held or still to be freed is what keeps the release ring from overflowing
+        if (conn->samples.size() + conn->reclaimed.size() >= conn->ringCapacity || !due(conn) || !admit(conn))
+            return;
         try {
-            uint64_t pointer = m_allocator->FromPointer(planes[0]);
-            m.pointer = pointer;
-            conn->samples[pointer] = m_sample;
+            SRawSampleMsg m;
+            fillMessage(m);
+            if (conn->samples.find(m.pointer) != conn->samples.end())
+                return; // same memory is still held by the client
+            if (conn->ring->PushDesc(m)) {
+                lease(conn, m.pointer);
+                ++conn->delivered;
+                scheduleNext(conn);
+            }
+        }
+        catch (const std::exception& x) {
+            VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalVideoProvider::pushCurrentFrame: caught exception: " << x.what();
+        }
+    }
+    void sendCurrentFrame(std::shared_ptr<SConnection> conn) { // under the lock!!!
+        conn->lastSeenIndex = m_currentIndex;
 
-            conn->written = 0;
-            // kick off writing by calling handler as if 0 bytes were successfully written
-            writeHandler(conn, boost::system::error_code(), 0);
+        SRawSampleMsg m;
+        try {
+            fillMessage(m);
+            lease(conn, m.pointer);
+            ++conn->delivered;
+            scheduleNext(conn);
+            enqueueMessage(conn, m);
         }
         catch (const std::exception& x) {
             VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalVideoProvider::sendCurrentFrame: caught exception: " << x.what();
         }
     }
+    void enqueueMessage(std::shared_ptr<SConnection> conn, const SRawSampleMsg& m) { // under the lock!!!
+        conn->out.push_back(m);
+        if (conn->out.size() == 1)
+            startWrite(conn);
+    }
+    void startWrite(std::shared_ptr<SConnection> conn) { // under the lock!!!
+        boost::asio::async_write(conn->pipe,
+            boost::asio::buffer(&conn->out.front(), sizeof(SRawSampleMsg)),
+            m_strand.Wrap(boost::bind(&CLocalVideoProvider::writeHandler, this, conn, _1, _2)));
+    }
     void writeHandler(std::shared_ptr<SConnection> conn, const boost::system::error_code & ec, size_t n) {
         if (ec){
             if (ec != boost::system::errc::operation_canceled) {
@@ -256,14 +605,10 @@ public:
             // otherwise it's canceled and we do nothing
         }
         else {
-            conn->written += n;
-            if (conn->written < sizeof(conn->out)) {
-                boost::asio::async_write(conn->pipe,
-                    boost::asio::buffer(reinterpret_cast<uint8_t*>(&conn->out) + conn->written,
-                        sizeof(conn->out) - conn->written),
-                    boost::bind(&CLocalVideoProvider::writeHandler, this, conn, _1, _2));
-            }
-            // else write is complete for this frame
+            std::unique_lock<std::mutex> lock(m_mutex);
+            conn->out.pop_front();
+            if (!conn->out.empty())
+                startWrite(conn);
         }
     }
 
@@ -271,6 +616,12 @@ public:
         std::unique_lock<std::mutex> lock(m_mutex);
         m_connections.erase(conn);
         m_starving.erase(conn);
+        m_creditConnections.erase(conn);
+        if (conn->ring) {
+            m_ringConnections.erase(conn);
+            conn->ring->Close();
+            boost::interprocess::shared_memory_object::remove(ringShmName(m_address, conn->id).c_str());
+        }
         try {
             conn->pipe.cancel();
             conn->pipe.close();
@@ -280,6 +631,15 @@ public:
     }
 
     ~CLocalVideoProvider() {
+        {
+            SLocalProviderRegistry& registry = localProviderRegistry();
+            std::unique_lock<std::mutex> lock(registry.mutex);
+            registry.providers.erase(this);
+        }
+        m_strand.Post([this]() { shutdown(); });
+        m_strand.Wait();
+    }
+    void shutdown() {
         std::unique_lock<std::mutex> lock(m_mutex);
         m_shutdown = true;
 #ifndef _WIN32
@@ -290,14 +650,15 @@ public:
         }
 #endif
         for (auto p : m_connections) {
+            if (p->ring) {
+                p->ring->Close();
+                boost::interprocess::shared_memory_object::remove(ringShmName(m_address, p->id).c_str());
+            }
             if(p->pipe.is_open()){
                 p->pipe.cancel();
                 p->pipe.close();
             }
         }
-        lock.unlock();
-        if(m_thread.get_id()!=std::thread().get_id())
-            m_thread.join();
     }
 public:
     void SetFormat(ERawMediaFormat emf, int x, int y) {
@@ -307,30 +668,70 @@ public:
         }
     }
     void Process(VnxVideo::IRawSample* sample, uint64_t timestamp) {
+        VNXVIDEO_TRACE_SCOPE("local_transport.send");
         std::unique_lock<std::mutex> lock(m_mutex);
-        m_sample.reset(sample->Dup());
+        m_sample = MakeRawSamplePtr(sample->Dup());
         ++m_currentIndex;
         m_timestamp = timestamp;
+        ERawMediaFormat emf;
+        int x, y;
+        m_sample->GetFormat(emf, x, y);
+        m_sampleBytes = CRawSample::AllocationSize(emf, x, y);
 
+        if (m_leaseTimeout.count() > 0) {
+            const auto now = std::chrono::steady_clock::now();
+            for (auto& c : m_connections)
+                reclaimExpired(c, now);
+        }
         for (auto c = m_starving.begin(); c != m_starving.end();) {
-            if ((*c)->lastSeenIndex < m_currentIndex) {
+            if ((*c)->lastSeenIndex < m_currentIndex && due(*c) && admit(*c)) {
                 sendCurrentFrame(*c);
                 c = m_starving.erase(c);
             }
             else
                 ++c;
         }
+        for (auto& c : m_creditConnections) {
+            if (c->credits > 0 && due(c) && admit(c)) {
+                --c->credits;
+                sendCurrentFrame(c);
+            }
+        }
+        for (auto& c : m_ringConnections)
+            pushCurrentFrame(c);
     }
     void Flush() {}
+
+    void GetStats(std::vector<SLocalClientStats>& stats) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto& conn : m_connections) {
+            if (!conn->accepted)
+                continue;
+            SLocalClientStats s;
+            s.address = m_address;
+            s.client = conn->id;
+            s.pinnedFrames = (int)conn->samples.size();
+            s.deliveredFrames = conn->delivered;
+            const uint64_t published = m_currentIndex - std::min(conn->startIndex, m_currentIndex);
+            s.skippedFrames = (published > conn->delivered) ? published - conn->delivered : 0;
+            s.credits = conn->credits;
+            s.pinnedBytes = conn->heldBytes;
+            s.rejectedFrames = conn->rejected;
+            s.reclaimedFrames = conn->reclaimedTotal;
+            s.lagging = conn->lagging;
+            stats.push_back(s);
+        }
+    }
 private:
-    boost::asio::io_service m_ios;
+    CEndpointStrand m_strand;
 #ifndef _WIN32
     boost::asio::local::stream_protocol::acceptor m_acceptor;
 #endif
     std::mutex m_mutex;
     std::set<std::shared_ptr<SConnection> > m_connections;
     std::set<std::shared_ptr<SConnection> > m_starving;
-    std::thread m_thread;
+    std::set<std::shared_ptr<SConnection> > m_ringConnections;
+    std::set<std::shared_ptr<SConnection> > m_creditConnections;
     const std::string m_address;
     PShmAllocator m_allocator;
 
@@ -340,17 +741,63 @@ private:
     bool m_shutdown;
 
     int m_audioSampleRateShl4;
+    int m_nextConnectionId;
+
+    int64_t m_sampleBytes; // size of the current sample
+    int m_maxHeldFrames; // per client, 0 for no limit
+    int64_t m_maxHeldBytes; // per client, 0 for no limit
+    std::chrono::milliseconds m_leaseTimeout; // 0 to never reclaim frames
+};
+
+std::vector<SLocalClientStats> GetLocalTransportStats() {
+    std::vector<SLocalClientStats> res;
+    SLocalProviderRegistry& registry = localProviderRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    for (auto p : registry.providers)
+        p->GetStats(res);
+    return res;
+}
+
+// Client side of a shared memory ring. Samples released after the connection
+// is gone must not touch the ring, hence the detached flag.
+struct SRingConsumer {
+    std::mutex mutex; // serializes pushes to the release ring
+    boost::interprocess::mapped_region region;
+    CSampleRing ring;
+    bool detached;
+    SRingConsumer(const boost::interprocess::shared_memory_object& shm, uint32_t capacity)
+        : region(shm, boost::interprocess::read_write)
+        , ring(region.get_address(), capacity)
+        , detached(false)
+    {
+    }
 };
 
 // INPUT video channel. A local named pipe client
 // which acquires a raw video stream from a CLocalVideoProvider.
 // In own process represents (makes a proxy to) the original video source.
+// VNX_LOCAL_TRANSPORT environment variable set to "ring" makes the client ask the provider
+// to pass samples via shared memory rings instead of the pipe; VNX_LOCAL_RING_SIZE sets the ring capacity.
+// Otherwise, VNX_LOCAL_CREDITS set to N > 0 lets the provider push up to N frames ahead of their delivery,
+// instead of sending one frame per request, so that a consumer which is slow at times does not lose bursts.
 class CLocalVideoClient : public VnxVideo::IVideoSource {
 public:
-    CLocalVideoClient(const std::string& address)
+    CLocalVideoClient(const std::string& address, double maxFps = 0, int minIntervalMs = 0)
         : m_address(address)
-        , m_timer(m_ios)
-        , m_pipe(m_ios)
+        , m_timer(LocalTransportIoService())
+        , m_pipe(LocalTransportIoService())
+        , m_useRing(false)
+        , m_ringCapacity(4)
+        , m_ringRequested(false)
+        , m_ringStop(false)
+        , m_credits(0)
+        , m_pendingCredits(0)
+        , m_writing(false)
+        , m_maxFps(maxFps)
+        , m_minIntervalMs(minIntervalMs)
+        , m_rateSent(false)
+        , m_awaitingFrame(false)
+        , m_requestDeferred(false)
 
         , m_width(0)
         , m_height(0)
@@ -362,6 +809,16 @@ public:
 
         , m_running(false)
     {
+#ifdef __linux__
+        const char* const transportEnv = getenv("VNX_LOCAL_TRANSPORT");
+        m_useRing = transportEnv != nullptr && std::string("ring") == transportEnv;
+        const char* const ringSizeEnv = getenv("VNX_LOCAL_RING_SIZE");
+        if (ringSizeEnv != nullptr)
+            m_ringCapacity = std::max(1, std::min((int)MAX_RING_CAPACITY, atoi(ringSizeEnv)));
+#endif
+        const char* const creditsEnv = getenv("VNX_LOCAL_CREDITS");
+        if (creditsEnv != nullptr)
+            m_credits = std::max(0, std::min(MAX_CREDITS, atoi(creditsEnv)));
     }
 #ifdef _WIN32
     void openPipe() {
@@ -372,20 +829,68 @@ public:
             DWORD err = GetLastError();
             throw std::system_error(err, std::system_category());
         }
-        m_pipe = pipe_t(m_ios, pipeh);
+        m_pipe = pipe_t(LocalTransportIoService(), pipeh);
     }
 #else
     void openPipe() {
         boost::asio::local::stream_protocol::endpoint endpoint(PIPE_PATH_PREFIX + m_address);
-        pipe_t pipe(m_ios);
+        pipe_t pipe(LocalTransportIoService());
         pipe.connect(endpoint);
         m_pipe = std::move(pipe);
     }
 #endif
     void openShm() {
         m_mapping.reset(CreateShmMapping(m_address.c_str()));
+        detachShared();
         m_shared.reset(new SFree());
         m_shared->mapping = m_mapping;
+        // the provider may hold back frames until these are freed, so they should not wait for the next request
+        m_shared->wake = [this]() { m_strand.Post([this]() { flushFrees(); }); };
+    }
+    void detachShared() {
+        if (m_shared) {
+            std::unique_lock<std::mutex> lock(m_shared->mutex);
+            m_shared->wake = nullptr;
+        }
+    }
+    // send frees of samples released while the client waits for a frame
+    void flushFrees() {
+        if (!m_pipe.is_open() || m_ringRequested || m_consumer)
+            return;
+        if (m_credits > 0) {
+            flushCommands();
+            return;
+        }
+        if (!m_awaitingFrame || m_writing)
+            return; // otherwise they go along with the next request
+        m_freeBuffer.clear();
+        {
+            std::unique_lock<std::mutex> lock(m_shared->mutex);
+            if (m_shared->free.empty())
+                return;
+            m_freeBuffer.push_back(CMD_FREE_BATCH);
+            m_freeBuffer.push_back(m_shared->free.size());
+            m_freeBuffer.insert(m_freeBuffer.end(), m_shared->free.begin(), m_shared->free.end());
+            m_shared->free.clear();
+        }
+        m_writing = true;
+        boost::asio::async_write(m_pipe, boost::asio::buffer(m_freeBuffer),
+            m_strand.Wrap(boost::bind(&CLocalVideoClient::freesWriteHandler, this, _1, _2)));
+    }
+    void freesWriteHandler(const boost::system::error_code & ec, size_t n) {
+        m_writing = false;
+        if (ec) {
+            if (ec != boost::system::errc::operation_canceled) {
+                VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalVideoClient::freesWriteHandler: Error on writing to named pipe: " << ec;
+                scheduleReconnect();
+            }
+        }
+        else if (m_requestDeferred) {
+            m_requestDeferred = false;
+            scheduleWriteCommandBuffer();
+        }
+        else
+            flushFrees();
     }
   
     // prepare command buffer and schedule sending it to the server.
@@ -394,6 +899,7 @@ public:
     void scheduleWriteCommandBuffer() {
         m_commandBuffer.clear();
         m_commandBufferBytesSent = 0;
+        appendRate();
         std::unique_lock<std::mutex> lock(m_shared->mutex);
         for (uint64_t ptr : m_shared->free) {
             m_commandBuffer.push_back(CMD_FREE);
@@ -406,13 +912,151 @@ public:
         writeHandler(boost::system::error_code(), 0);
     }
 
+    // the rate limit goes ahead of the first command after connection
+    void appendRate() {
+        if (m_rateSent || (m_maxFps <= 0 && m_minIntervalMs <= 0))
+            return;
+        const uint64_t maxMilliFps = (uint64_t)std::max(0.0, m_maxFps * 1000);
+        const uint64_t minIntervalUs = (uint64_t)std::max(0, m_minIntervalMs) * 1000;
+        m_commandBuffer.push_back(CMD_RATE);
+        m_commandBuffer.push_back((std::min<uint64_t>(minIntervalUs, 0xffffffff) << 32) | std::min<uint64_t>(maxMilliFps, 0xffffffff));
+        m_rateSent = true;
+    }
     void connect() {
+        m_rateSent = false;
+        m_writing = false;
+        m_awaitingFrame = false;
+        m_requestDeferred = false;
         VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "CLocalVideoClient::connect: About to connect";
         openPipe();
         VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "CLocalVideoClient::connect: Pipe/socket opened";
         openShm();
         VNXVIDEO_LOG(VNXLOG_DEBUG, "vnxvideo") << "CLocalVideoClient::connect: Shared memory segment opened";
-        scheduleWriteCommandBuffer(); // it's always free what has to be freed, and then request
+        if (m_useRing)
+            requestRing();
+        else if (m_credits > 0)
+            startCredits();
+        else
+            scheduleWriteCommandBuffer(); // it's always free what has to be freed, and then request
+    }
+    void startCredits() {
+        m_writing = false;
+        m_pendingCredits = m_credits;
+        flushCommands();
+        m_sampleBytesRead = 0;
+        readHandler(boost::system::error_code(), 0);
+    }
+    // send frees and returned credits, unless a previous batch is still being written
+    void flushCommands() {
+        if (m_writing)
+            return;
+        m_commandBuffer.clear();
+        m_commandBufferBytesSent = 0;
+        appendRate();
+        {
+            std::unique_lock<std::mutex> lock(m_shared->mutex);
+            if (!m_shared->free.empty()) {
+                m_commandBuffer.push_back(CMD_FREE_BATCH);
+                m_commandBuffer.push_back(m_shared->free.size());
+                m_commandBuffer.insert(m_commandBuffer.end(), m_shared->free.begin(), m_shared->free.end());
+                m_shared->free.clear();
+            }
+        }
+        if (m_pendingCredits > 0) {
+            m_commandBuffer.push_back(CMD_CREDIT);
+            m_commandBuffer.push_back(m_pendingCredits);
+            m_pendingCredits = 0;
+        }
+        if (m_commandBuffer.empty())
+            return;
+        m_writing = true;
+        boost::asio::async_write(m_pipe, boost::asio::buffer(m_commandBuffer),
+            m_strand.Wrap(boost::bind(&CLocalVideoClient::commandsWriteHandler, this, _1, _2)));
+    }
+    void commandsWriteHandler(const boost::system::error_code & ec, size_t n) {
+        m_writing = false;
+        if (ec) {
+            if (ec != boost::system::errc::operation_canceled) {
+                VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalVideoClient::commandsWriteHandler: Error on writing to named pipe: " << ec;
+                scheduleReconnect();
+            }
+        }
+        else
+            flushCommands(); // whatever has been collected while writing
+    }
+    void requestRing() {
+        m_ringRequested = true;
+        m_commandBuffer.clear();
+        m_commandBufferBytesSent = 0;
+        appendRate();
+        m_commandBuffer.push_back(CMD_RING);
+        m_commandBuffer.push_back(m_ringCapacity);
+        writeHandler(boost::system::error_code(), 0);
+    }
+    void startRing() {
+        m_ringRequested = false;
+        const uint32_t capacity = (uint32_t)m_sample.nplanes;
+        if (0 == capacity) {
+            VNXVIDEO_LOG(VNXLOG_INFO, "vnxvideo") << "CLocalVideoClient::startRing: Provider " << m_address
+                << " does not support shared memory rings, falling back to pipe transport";
+            scheduleWriteCommandBuffer();
+            return;
+        }
+        std::shared_ptr<SRingConsumer> consumer;
+        try {
+            using namespace boost::interprocess;
+            shared_memory_object shm(open_only, ringShmName(m_address, m_sample.pointer).c_str(), read_write);
+            consumer = std::make_shared<SRingConsumer>(shm, capacity);
+        }
+        catch (const std::exception& e) {
+            VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalVideoClient::startRing: Could not open ring of " << m_address
+                << ", falling back to pipe transport: " << e.what();
+            fallBackFromRing();
+            return;
+        }
+        if (consumer->region.get_size() < CSampleRing::Size(capacity) || !consumer->ring.Valid(capacity)) {
+            VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalVideoClient::startRing: Invalid ring received from " << m_address
+                << ", falling back to pipe transport";
+            fallBackFromRing();
+            return;
+        }
+        m_ringStop = false;
+        m_ringThread = std::thread([this, consumer]() { ringLoop(consumer); });
+        m_consumer = consumer;
+        // nothing is expected from the provider anymore, the read only completes on disconnection
+        boost::asio::async_read(m_pipe, boost::asio::buffer(&m_sample, sizeof(m_sample)),
+            m_strand.Wrap(boost::bind(&CLocalVideoClient::readHandler, this, _1, _2)));
+    }
+    // a plain request makes the provider drop the ring; reconnections do not ask for it again,
+    // as whatever kept the ring from opening is not going to go away
+    void fallBackFromRing() {
+        m_useRing = false;
+        if (m_credits > 0)
+            startCredits();
+        else
+            scheduleWriteCommandBuffer();
+    }
+    void ringLoop(std::shared_ptr<SRingConsumer> consumer) {
+        SRawSampleMsg sample;
+        while (!m_ringStop) {
+            if (consumer->ring.PopDesc(sample))
+                sendSample(sample, consumer);
+            else if (consumer->ring.Closed())
+                break; // the pipe is going to be closed as well, which triggers reconnection
+            else
+                consumer->ring.WaitDesc(100);
+        }
+    }
+    void stopRing() {
+        m_ringStop = true;
+        if (m_ringThread.joinable())
+            m_ringThread.join();
+        if (m_consumer) {
+            std::unique_lock<std::mutex> lock(m_consumer->mutex);
+            m_consumer->detached = true;
+        }
+        m_consumer.reset();
+        m_ringRequested = false;
     }
     void writeHandler(const boost::system::error_code & ec, size_t n) {
         if (ec && ec != boost::system::errc::operation_canceled) {
@@ -425,12 +1069,14 @@ public:
                 boost::asio::async_write(m_pipe,
                     boost::asio::buffer(reinterpret_cast<uint8_t*>(&m_commandBuffer[0]) + m_commandBufferBytesSent, 
                         m_commandBuffer.size() * sizeof(uint64_t) - m_commandBufferBytesSent),
-                    boost::bind(&CLocalVideoClient::writeHandler, this, _1, _2));
+                    m_strand.Wrap(boost::bind(&CLocalVideoClient::writeHandler, this, _1, _2)));
             }
             else {
                 m_sampleBytesRead = 0;
+                m_awaitingFrame = !m_ringRequested;
                 // kick off reading by calling the readHandler as if it has read 0 bytes
                 readHandler(boost::system::error_code(), 0);
+                flushFrees(); // whatever has been released while the request was written
             }
         }
         else {
@@ -448,11 +1094,28 @@ public:
                 boost::asio::async_read(m_pipe,
                     boost::asio::buffer(reinterpret_cast<uint8_t*>(&m_sample) + m_sampleBytesRead, 
                         sizeof(m_sample) - m_sampleBytesRead),
-                    boost::bind(&CLocalVideoClient::readHandler, this, _1, _2));
+                    m_strand.Wrap(boost::bind(&CLocalVideoClient::readHandler, this, _1, _2)));
+            }
+            else if (m_ringRequested)
+                startRing();
+            else if (m_consumer) {
+                VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CLocalVideoClient::readHandler: Unexpected data from provider in ring mode";
+                scheduleReconnect();
+            }
+            else if (m_credits > 0) {
+                sendSample(m_sample, std::shared_ptr<SRingConsumer>());
+                ++m_pendingCredits; // the frame is delivered, the client can take one more
+                flushCommands();
+                m_sampleBytesRead = 0;
+                readHandler(boost::system::error_code(), 0);
             }
             else {
-                sendSample();
-                scheduleWriteCommandBuffer();
+                m_awaitingFrame = false;
+                sendSample(m_sample, std::shared_ptr<SRingConsumer>());
+                if (m_writing)
+                    m_requestDeferred = true; // frees are being written, the request follows them
+                else
+                    scheduleWriteCommandBuffer();
             }
         }
         else {
@@ -466,13 +1129,14 @@ public:
         }
         catch (const boost::system::system_error&) {
         }
+        stopRing();
         {
             std::unique_lock<std::mutex> lock(m_mutex);
             if (!m_running)
                 return;
         }
         m_timer.expires_from_now(std::chrono::nanoseconds(1000000000));
-        m_timer.async_wait([this](const boost::system::error_code & ec) {
+        m_timer.async_wait(m_strand.Wrap([this](const boost::system::error_code & ec) {
             if (!ec) {
                 try {
                     connect();
@@ -482,30 +1146,28 @@ public:
                     scheduleReconnect();
                 }
             }
-        });
+        }));
     }
 
-    void sendSample() {
+    void sendSample(SRawSampleMsg msg, std::shared_ptr<SRingConsumer> consumer) {
+        VNXVIDEO_TRACE_SCOPE("local_transport.receive");
         std::unique_lock<std::mutex> lock(m_mutex);
-        const bool formatUnchangedVideo = !vnxvideo_emf_is_video(m_sample.format) ||
-            ((m_width == m_sample.width) 
-                && (m_height == m_sample.height) && (m_formatVideo == m_sample.format));
-        const bool formatUnchangedAudio = !vnxvideo_emf_is_audio(m_sample.format) ||
-            ((m_sampleRateShl4 == (m_sample.param2 & 0xfffffff0))
-                && (m_channels == (m_sample.param2 & 0x0000000f)) 
-                && (m_formatAudio == m_sample.format));
+        const bool formatUnchangedVideo = !vnxvideo_emf_is_video(msg.format) ||
+            ((m_width == msg.width) 
+                && (m_height == msg.height) && (m_formatVideo == msg.format));
+        const bool formatUnchangedAudio = !vnxvideo_emf_is_audio(msg.format) ||
+            ((m_sampleRateShl4 == (msg.param2 & 0xfffffff0))
+                && (m_channels == (msg.param2 & 0x0000000f)) 
+                && (m_formatAudio == msg.format));
         if (!formatUnchangedVideo) {
-            m_width = m_sample.width;
-            m_height = m_sample.height;
-            m_formatVideo = m_sample.format;
+            m_width = msg.width;
+            m_height = msg.height;
+            m_formatVideo = msg.format;
         }
         if (!formatUnchangedAudio) {
-            m_sampleRateShl4 = m_sample.param2 & 0xfffffff0;
-            m_channels = m_sample.param2 & 0x0000000f;
-            m_formatAudio = m_sample.format;
-        }
-        if (vnxvideo_emf_is_audio(m_sample.format)) {
-            m_sample.param2 &= 0x0000000f;
+            m_sampleRateShl4 = msg.param2 & 0xfffffff0;
+            m_channels = msg.param2 & 0x0000000f;
+            m_formatAudio = msg.format;
         }
         auto onFrame(m_onFrame);
         auto onFormat(m_onFormat);
@@ -518,20 +1180,31 @@ public:
         uint8_t *planes[4];
         memset(planes, 0, sizeof planes);
         // fill samples in here.
-        uint8_t* pointer((uint8_t*)m_mapping->ToPointer(m_sample.pointer));
+        uint8_t* pointer((uint8_t*)m_mapping->ToPointer(msg.pointer));
         for (int k = 0; k < 4; ++k) {
-            planes[k] = pointer + m_sample.offsets[k];
+            planes[k] = pointer + msg.offsets[k];
         }
 
         // free the memory in dtor (return it to server) (not really return immediately but schedule to return)
         auto shared(m_shared);
-        std::shared_ptr<void> sharedDtor((void*)m_sample.pointer, [shared](void* p) {
+        auto segment(m_mapping->Retain(msg.pointer));
+        std::shared_ptr<void> sharedDtor((void*)msg.pointer, [shared, segment, consumer](void* p) {
             uint64_t s = (uint64_t)p;
+            if (consumer) {
+                std::unique_lock<std::mutex> lock(consumer->mutex);
+                if (!consumer->detached)
+                    consumer->ring.PushRelease(s);
+                return;
+            }
             std::unique_lock<std::mutex> lock(shared->mutex);
             shared->free.push_back(s);
+            if (1 == shared->free.size() && shared->wake)
+                shared->wake();
         }); 
-        CRawSample sample(m_sample.format, m_sample.param1, m_sample.param2, m_sample.strides, planes, sharedDtor);
-        uint64_t timestamp = m_sample.timestamp;
+        const int param2 = vnxvideo_emf_is_audio(msg.format) ? (msg.param2 & 0x0000000f) : msg.param2;
+        CRawSample sample(msg.format, msg.param1, param2, msg.strides, planes, sharedDtor);
+        sample.SetTrace(NewFrameTrace()); // frames of other processes enter this one here
+        uint64_t timestamp = msg.timestamp;
         onFrame(&sample, timestamp);
     }
 
@@ -540,13 +1213,27 @@ public:
     }
 private:
     const std::string m_address;
-    boost::asio::io_service m_ios;
+    CEndpointStrand m_strand;
     boost::asio::steady_timer m_timer;
     pipe_t m_pipe;
     std::shared_ptr<IShmMapping> m_mapping;
     bool m_running;
     std::mutex m_mutex;
-    std::thread m_thread;
+
+    bool m_useRing;
+    int m_ringCapacity;
+    bool m_ringRequested; // waiting for the reply to CMD_RING
+    std::atomic<bool> m_ringStop;
+    std::thread m_ringThread;
+    std::shared_ptr<SRingConsumer> m_consumer;
+
+    int m_credits; // window size, 0 to request frames one by one
+    uint64_t m_pendingCredits; // credits to be returned to the provider
+    bool m_writing; // commands are being written in credit mode
+
+    const double m_maxFps; // requested from the provider, 0 for the full rate
+    const int m_minIntervalMs;
+    bool m_rateSent;
 
     // IDs of samples to be freed on next interaction with server.
     // access this vector with m_mutex locked.
@@ -556,8 +1243,12 @@ private:
         std::shared_ptr<IShmMapping> mapping;
         std::mutex mutex;
         std::vector<uint64_t> free;
+        std::function<void()> wake; // asks the client to flush frees, reset when the client is done with them
     };
     std::shared_ptr<SFree> m_shared;
+    std::vector<uint64_t> m_freeBuffer; // frees sent while waiting for a frame
+    bool m_awaitingFrame; // a frame is requested and not received yet
+    bool m_requestDeferred; // the next request waits for frees being written
 
     SRawSampleMsg m_sample; // frame received from the server
     size_t m_sampleBytesRead;
@@ -586,31 +1277,34 @@ public: // IVideoSource
             std::unique_lock<std::mutex> lock(m_mutex);
             m_running = true;
         }
-        try {
-            connect();
-        }
-        catch (const std::exception&) {
-            scheduleReconnect();
-        }
-        auto pios(&m_ios);
-        m_thread = std::move(std::thread([pios]() {pios->run(); }));
+        m_strand.Post([this]() {
+            try {
+                connect();
+            }
+            catch (const std::exception&) {
+                scheduleReconnect();
+            }
+        });
     }
     virtual void Stop() {
         {
             std::unique_lock<std::mutex> lock(m_mutex);
             m_running = false;
         }
-        m_timer.cancel();
-        try {
-            if (m_pipe.is_open()) {
-                m_pipe.cancel();
-                m_pipe.close();
+        detachShared();
+        m_strand.Post([this]() {
+            m_timer.cancel();
+            try {
+                if (m_pipe.is_open()) {
+                    m_pipe.cancel();
+                    m_pipe.close();
+                }
             }
-        }
-        catch (const std::exception&) {
-        }
-        if (m_thread.get_id() != std::thread().get_id())
-            m_thread.join();
+            catch (const std::exception&) {
+            }
+        });
+        m_strand.Wait();
+        stopRing();
     }
 
 };
@@ -620,6 +1314,10 @@ namespace VnxVideo {
         return new CLocalVideoClient(name);
     }
 
+    IVideoSource *CreateLocalVideoClient(const char* name, double maxFps, int minIntervalMs) {
+        return new CLocalVideoClient(name, maxFps, minIntervalMs);
+    }
+
     IRawProc *CreateLocalVideoProvider(const char* name, int maxSizeMB) {
         return new CLocalVideoProvider(name, maxSizeMB, DupPreferredShmAllocator());
     }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <boost/asio.hpp>
+#ifdef _WIN32
+#include <boost/asio/windows/stream_handle.hpp>
+#else
+#include <boost/asio/local/stream_protocol.hpp>
+#endif
+
+// Definitions shared by local transports of raw samples and of coded media.
+// Both kinds of providers use the same namespace of pipe names.
+
+#ifdef _WIN32
+typedef boost::asio::windows::stream_handle pipe_t;
+const std::string PIPE_PATH_PREFIX = "\\\\.\\pipe\\viinex_pipe_";
+#else
+typedef boost::asio::local::stream_protocol::socket pipe_t;
+const std::string PIPE_PATH_PREFIX = "/tmp/viinex_pipe_";
+#endif
+
+// Process-wide pool of io threads which serves all local transport endpoints
+// (epoll on Linux, IOCP on Windows). VNX_LOCAL_IO_THREADS sets the number of threads, 4 at most by default.
+boost::asio::io_service& LocalTransportIoService();
+
+// Runs the handlers of one endpoint on the shared pool one at a time, as a dedicated thread would,
+// and lets the endpoint wait for its outstanding handlers before it goes away.
+class CEndpointStrand {
+public:
+    CEndpointStrand()
+        : m_strand(LocalTransportIoService())
+        , m_pending(0)
+    {
+    }
+    // every async operation of the endpoint must complete through a wrapped handler
+    template<typename THandler>
+    auto Wrap(THandler handler) {
+        auto ticket(acquire());
+        return m_strand.wrap([handler, ticket](auto&&... args) { handler(std::forward<decltype(args)>(args)...); });
+    }
+    template<typename TFunc>
+    void Post(TFunc f) {
+        auto ticket(acquire());
+        m_strand.post([f, ticket]() { f(); });
+    }
+    // blocks until every wrapped handler is invoked or destroyed. Must not be called from a handler.
+    void Wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return 0 == m_pending; });
+    }
+private:
+    std::shared_ptr<void> acquire() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_pending;
+        return std::shared_ptr<void>(static_cast<void*>(this), [this](void*) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (0 == --m_pending)
+                m_idle.notify_all();
+        });
+    }
+
+    boost::asio::io_service::strand m_strand;
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    int m_pending;
+};
@@ -0,0 +1,540 @@
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#include "vnxvideoimpl.h"
+#include "vnxvideologimpl.h"
+#include "RawSample.h"
+#include "Executor.h"
+#include "jget.h"
+
+using json = nlohmann::json;
+
+// samples or buffers a pipeline node got, and the time it spent on them
+class CPipelineNodeCounters {
+public:
+    CPipelineNodeCounters()
+        : m_processed(0)
+        , m_totalUs(0)
+        , m_maxUs(0)
+        , m_lastUs(0)
+    {
+    }
+    void Add(std::chrono::steady_clock::time_point start) {
+        const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_processed;
+        m_totalUs += us;
+        m_maxUs = std::max(m_maxUs, us);
+        m_lastUs = us;
+    }
+    void Add() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_processed;
+    }
+    void ToJson(json& j) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        j["processed"] = m_processed;
+        j["total_us"] = m_totalUs;
+        j["max_us"] = m_maxUs;
+        j["last_us"] = m_lastUs;
+    }
+private:
+    std::mutex m_mutex;
+    uint64_t m_processed;
+    uint64_t m_totalUs;
+    uint64_t m_maxUs;
+    uint64_t m_lastUs;
+};
+
+// what upstream nodes feed with raw video: the node itself, measured
+class CPipelineNodeInput : public VnxVideo::IRawProc {
+public:
+    CPipelineNodeInput(VnxVideo::PRawProc impl, CPipelineNodeCounters& counters)
+        : m_impl(impl)
+        , m_counters(counters)
+    {
+    }
+    virtual void SetFormat(ERawMediaFormat csp, int width, int height) {
+        m_impl->SetFormat(csp, width, height);
+    }
+    virtual void Process(VnxVideo::IRawSample* sample, uint64_t timestamp) {
+        const auto start = std::chrono::steady_clock::now();
+        m_impl->Process(sample, timestamp);
+        m_counters.Add(start);
+    }
+    virtual void Flush() {
+        m_impl->Flush();
+    }
+private:
+    VnxVideo::PRawProc m_impl;
+    CPipelineNodeCounters& m_counters;
+};
+
+// local video provider only publishes frames of its own shared memory, others are copied there
+class CPipelineShmInput : public VnxVideo::IRawProc {
+public:
+    CPipelineShmInput(const std::string& name, int maxSizeMB)
+        : m_allocator(CreateShmAllocator(name.c_str(), maxSizeMB))
+    {
+        WithPreferredShmAllocator(m_allocator.get(), [&]() {
+            m_provider.reset(VnxVideo::CreateLocalVideoProvider(name.c_str(), maxSizeMB));
+        });
+    }
+    virtual void SetFormat(ERawMediaFormat csp, int width, int height) {
+        m_provider->SetFormat(csp, width, height);
+    }
+    virtual void Process(VnxVideo::IRawSample* sample, uint64_t timestamp) {
+        if (sample == nullptr || inShm(sample)) {
+            m_provider->Process(sample, timestamp);
+            return;
+        }
+        VnxVideo::PRawSample copy;
+        WithPreferredShmAllocator(m_allocator.get(), [&]() {
+            copy = MakeRawSamplePtr(VnxVideo::CopyRawToI420(sample));
+        });
+        m_provider->Process(copy.get(), timestamp);
+    }
+    virtual void Flush() {
+        m_provider->Flush();
+    }
+private:
+    bool inShm(VnxVideo::IRawSample* sample) {
+        int strides[4];
+        uint8_t* planes[4];
+        sample->GetData(strides, planes);
+        return m_allocator->Contains(planes[0]);
+    }
+    PShmAllocator m_allocator;
+    std::unique_ptr<VnxVideo::IRawProc> m_provider;
+};
+
+struct SPipelineNode {
+    std::string id;
+    std::string type;
+    std::string group;
+    CPipelineNodeCounters counters;
+
+    // raw video produced by the node goes to the chain, coded media to the handlers
+    std::unique_ptr<VnxVideo::IRawProcChain> rawOutput;
+    bool producesCoded;
+    EMediaSubtype codedSubtype; // of media produced; EMST_ANY for a media client which produces several
+    std::map<EMediaSubtype, std::vector<VnxVideo::TOnBufferCallback> > codedOutputs;
+
+    // what upstream nodes feed
+    VnxVideo::PRawProc rawInput;
+    VnxVideo::TOnBufferCallback codedInput;
+    EMediaSubtype codedInputSubtype;
+    VnxVideo::IAsyncQueue* queue; // in front of the raw input, if any
+
+    // objects of the node, whichever apply
+    VnxVideo::PVideoSource source;
+    std::shared_ptr<VnxVideo::IMediaSource> mediaSource;
+    std::shared_ptr<VnxVideo::IRenderer> renderer;
+    std::shared_ptr<VnxVideo::IAnalytics> analytics; // subscribed by the pipeline's user, if needed
+    VnxVideo::PMediaDecoder decoder;
+    VnxVideo::PRawProc proc;
+    std::shared_ptr<VnxVideo::ILocalMediaProvider> mediaProvider;
+
+    SPipelineNode()
+        : producesCoded(false)
+        , codedSubtype(EMST_ANY)
+        , codedInputSubtype(EMST_ANY)
+        , queue(nullptr)
+    {
+    }
+    void Output(EMediaSubtype subtype, VnxVideo::IBuffer* buffer, uint64_t timestamp) {
+        auto outputs = codedOutputs.find(subtype);
+        if (outputs == codedOutputs.end())
+            return;
+        for (auto& output : outputs->second)
+            output(buffer, timestamp);
+    }
+    // the queue drains into the node, the node into its outputs
+    void Release() {
+        codedInput = VnxVideo::TOnBufferCallback();
+        queue = nullptr;
+        rawInput.reset();
+        proc.reset();
+        analytics.reset();
+        decoder.reset();
+        mediaProvider.reset();
+        source.reset();
+        mediaSource.reset();
+        renderer.reset();
+        rawOutput.reset();
+        codedOutputs.clear();
+    }
+};
+
+static EMediaSubtype parseMediaSubtype(const std::string& subtype) {
+    static const std::map<std::string, EMediaSubtype> subtypes = {
+        { "h264", EMST_H264 }, { "hevc", EMST_HEVC }, { "pcmu", EMST_PCMU }, { "pcma", EMST_PCMA },
+        { "opus", EMST_OPUS }, { "aac", EMST_AAC }, { "lpcm", EMST_LPCM }, { "g726", EMST_G726 }
+    };
+    auto s = subtypes.find(subtype);
+    if (s == subtypes.end())
+        throw std::runtime_error("unknown media subtype: " + subtype);
+    return s->second;
+}
+
+class CPipeline : public VnxVideo::IPipeline {
+public:
+    CPipeline(const json& config)
+        : m_running(false)
+    {
+        json executor(jget<json>(config, "executor"));
+        if (!executor.is_null()) {
+            if (!ConfigureExecutor(jget<int>(executor, "threads", EXECUTOR_KEEP_WORKERS), jget<std::string>(executor, "affinity")))
+                VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "Pipeline executor settings are ignored, async processing has already started";
+        }
+        m_groups = jget<json>(config, "groups", json::object());
+        json nodes(jget<json>(config, "nodes"));
+        if (!nodes.is_array() || nodes.empty())
+            throw std::runtime_error("pipeline nodes should be a non-empty json array");
+        try {
+            for (const auto& n : nodes)
+                createNode(n);
+            for (auto& n : m_nodes)
+                subscribeCodedOutputs(*n);
+        }
+        catch (...) {
+            release();
+            throw;
+        }
+    }
+    ~CPipeline() {
+        Stop();
+        release();
+    }
+    virtual void Run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_running)
+            return;
+        for (auto& n : m_nodes) {
+            if (n->renderer)
+                rendererSource(*n)->Run();
+            if (n->source)
+                n->source->Run();
+            if (n->mediaSource)
+                n->mediaSource->Run();
+        }
+        m_running = true;
+    }
+    virtual void Stop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        for (auto n = m_nodes.rbegin(); n != m_nodes.rend(); ++n) {
+            if ((*n)->mediaSource)
+                (*n)->mediaSource->Stop();
+            if ((*n)->source)
+                (*n)->source->Stop();
+            if ((*n)->renderer)
+                rendererSource(**n)->Stop();
+        }
+        m_running = false;
+    }
+    virtual VnxVideo::IRenderer* GetRenderer(const std::string& id) {
+        for (auto& n : m_nodes) {
+            if (n->id == id)
+                return n->renderer.get();
+        }
+        return nullptr;
+    }
+    virtual VnxVideo::IAnalytics* GetAnalytics(const std::string& id) {
+        for (auto& n : m_nodes) {
+            if (n->id == id)
+                return n->analytics.get();
+        }
+        return nullptr;
+    }
+    virtual json GetStats() {
+        json nodes = json::array();
+        for (auto& n : m_nodes) {
+            json node = {
+                { "id", n->id },
+                { "type", n->type },
+                { "group", n->group }
+            };
+            n->counters.ToJson(node);
+            if (n->queue != nullptr) {
+                VnxVideo::SAsyncQueueStats stats(n->queue->GetQueueStats());
+                node["queue"] = {
+                    { "depth", stats.depth },
+                    { "queued", stats.queued },
+                    { "max_queued", stats.maxQueued },
+                    { "processed", stats.processed },
+                    { "dropped", stats.dropped },
+                    { "blocked", stats.blocked },
+                    { "expired", stats.expired }
+                };
+            }
+            nodes.push_back(node);
+        }
+        return json{ { "nodes", nodes } };
+    }
+private:
+    SPipelineNode* findNode(const std::string& id) {
+        for (auto& n : m_nodes) {
+            if (n->id == id)
+                return n.get();
+        }
+        return nullptr;
+    }
+    // IRenderer inherits IVideoSource privately, vnxvideo_renderer_to_videosource does the same
+    static VnxVideo::IVideoSource* rendererSource(SPipelineNode& n) {
+        return reinterpret_cast<VnxVideo::IVideoSource*>(n.renderer.get());
+    }
+
+    void createNode(const json& j) {
+        std::unique_ptr<SPipelineNode> node(new SPipelineNode);
+        SPipelineNode& n(*node);
+        n.id = jget<std::string>(j, "id");
+        n.type = jget<std::string>(j, "type");
+        n.group = jget<std::string>(j, "group");
+        if (n.id.empty() || findNode(n.id) != nullptr)
+            throw std::runtime_error("pipeline node id should be unique and not empty: " + n.id);
+        if (!n.group.empty() && m_groups.find(n.group) == m_groups.end())
+            throw std::runtime_error("pipeline node " + n.id + " refers to unknown group " + n.group);
+
+        SPipelineNode* input = nullptr;
+        const std::string inputId(jget<std::string>(j, "input"));
+        if (!inputId.empty()) {
+            input = findNode(inputId);
+            if (input == nullptr)
+                throw std::runtime_error("pipeline node " + n.id + " refers to unknown input " + inputId + ", which should be declared before");
+        }
+
+        bool consumesRaw = false;
+        if (n.type == "local_client") {
+            n.source.reset(VnxVideo::CreateLocalVideoClient(jget<std::string>(j, "name").c_str(),
+                jget<double>(j, "max_fps", 0), jget<int>(j, "min_interval_ms", 0)));
+        }
+        else if (n.type == "media_client") {
+            n.mediaSource.reset(VnxVideo::CreateLocalMediaClient(jget<std::string>(j, "name").c_str(),
+                jget<bool>(j, "join_at_keyframe", true)));
+            n.producesCoded = true;
+        }
+        else if (n.type == "renderer") {
+            n.renderer.reset(VnxVideo::CreateRenderer(jget<int>(j, "refresh_rate", 25)));
+            n.renderer->SetMaxFrameAge(jget<int>(j, "max_age_ms", 0));
+            n.renderer->SetRenderWorkers(jget<int>(j, "workers", 1));
+        }
+        else if (n.type == "decoder") {
+            const std::string codec(jget<std::string>(j, "codec"));
+            EMediaSubtype subtype = codec.empty() ? EMST_ANY : parseMediaSubtype(codec);
+            if (subtype == EMST_ANY && input != nullptr)
+                subtype = input->codedSubtype;
+            n.decoder.reset(VnxVideo::CreateVideoDecoder(subtype == EMST_ANY ? EMST_H264 : subtype, jget<bool>(j, "cpu_only", false)));
+            VnxVideo::PMediaDecoder decoder(n.decoder);
+            CPipelineNodeCounters& counters(n.counters);
+            n.codedInputSubtype = subtype == EMST_ANY ? EMST_H264 : subtype;
+            n.codedInput = [decoder, &counters](VnxVideo::IBuffer* buffer, uint64_t timestamp) {
+                const auto start = std::chrono::steady_clock::now();
+                decoder->Decode(buffer, timestamp);
+                counters.Add(start);
+            };
+        }
+        else if (n.type == "transform") {
+#ifndef __aarch64__
+            VnxVideo::PRawTransform transform(VnxVideo::CreateRawTransform(jget<json>(j, "config")));
+            n.proc = transform;
+            subscribeRawOutput(n, j, [transform](VnxVideo::TOnFormatCallback onFormat, VnxVideo::TOnFrameCallback onFrame) {
+                transform->Subscribe(onFormat, onFrame);
+            });
+#else
+            throw std::runtime_error("Raw transforms not implemented on aarch64");
+#endif
+            consumesRaw = true;
+        }
+        else if (n.type == "analytics") {
+            n.analytics.reset(VnxVideo::CreateAnalytics(jget<json>(j, "config")));
+            n.analytics->Subscribe([](const std::string&, uint64_t) {}, [](VnxVideo::IBuffer*, uint64_t) {});
+            n.proc = n.analytics;
+            consumesRaw = true;
+        }
+        else if (n.type == "encoder") {
+            VnxVideo::PMediaEncoder encoder(VnxVideo::CreateVideoEncoder(jget<json>(j, "config")));
+            n.proc = encoder;
+            n.producesCoded = true;
+            n.codedSubtype = EMST_H264;
+            SPipelineNode* self = &n;
+            encoder->Subscribe([self](VnxVideo::IBuffer* buffer, uint64_t timestamp) {
+                self->Output(EMST_H264, buffer, timestamp);
+            });
+            consumesRaw = true;
+        }
+        else if (n.type == "renderer_input") {
+            SPipelineNode* renderer = findNode(jget<std::string>(j, "renderer"));
+            if (renderer == nullptr || !renderer->renderer)
+                throw std::runtime_error("pipeline node " + n.id + " should refer to a renderer declared before");
+            VnxVideo::PRawTransform transform;
+            json transformConfig(jget<json>(j, "transform"));
+            if (!transformConfig.is_null()) {
+#ifndef __aarch64__
+                transform.reset(VnxVideo::CreateRawTransform(transformConfig));
+#else
+                throw std::runtime_error("Raw transforms not supported on aarch64");
+#endif
+            }
+            n.proc.reset(renderer->renderer->CreateInput(jget<int>(j, "index"), transform));
+            consumesRaw = true;
+        }
+        else if (n.type == "local_provider") {
+            n.proc.reset(new CPipelineShmInput(jget<std::string>(j, "name"), jget<int>(j, "max_size_mb", 64)));
+            consumesRaw = true;
+        }
+        else if (n.type == "media_provider") {
+            n.mediaProvider.reset(VnxVideo::CreateLocalMediaProvider(jget<std::string>(j, "name").c_str(), jget<int>(j, "max_size_mb", 64)));
+            const std::string subtypeName(jget<std::string>(j, "subtype"));
+            EMediaSubtype subtype = subtypeName.empty() ? EMST_ANY : parseMediaSubtype(subtypeName);
+            if (subtype == EMST_ANY && input != nullptr)
+                subtype = input->codedSubtype;
+            if (subtype == EMST_ANY)
+                throw std::runtime_error("pipeline node " + n.id + " should have the subtype of media to publish");
+            std::shared_ptr<VnxVideo::ILocalMediaProvider> provider(n.mediaProvider);
+            CPipelineNodeCounters& counters(n.counters);
+            n.codedInputSubtype = subtype;
+            n.codedInput = [provider, subtype, &counters](VnxVideo::IBuffer* buffer, uint64_t timestamp) {
+                const auto start = std::chrono::steady_clock::now();
+                provider->Process(subtype, buffer, timestamp);
+                counters.Add(start);
+            };
+        }
+        else
+            throw std::runtime_error("unknown pipeline node type: " + n.type);
+
+        if (n.source) {
+            VnxVideo::PVideoSource source(n.source);
+            subscribeRawOutput(n, j, [source](VnxVideo::TOnFormatCallback onFormat, VnxVideo::TOnFrameCallback onFrame) {
+                source->Subscribe(onFormat, onFrame);
+            });
+        }
+        else if (n.renderer) {
+            VnxVideo::IVideoSource* source = rendererSource(n);
+            subscribeRawOutput(n, j, [source](VnxVideo::TOnFormatCallback onFormat, VnxVideo::TOnFrameCallback onFrame) {
+                source->Subscribe(onFormat, onFrame);
+            });
+        }
+        else if (n.decoder) {
+            VnxVideo::PMediaDecoder decoder(n.decoder);
+            subscribeRawOutput(n, j, [decoder](VnxVideo::TOnFormatCallback onFormat, VnxVideo::TOnFrameCallback onFrame) {
+                decoder->Subscribe(onFormat, onFrame);
+            });
+        }
+
+        if (consumesRaw) {
+            n.rawInput.reset(new CPipelineNodeInput(n.proc, n.counters));
+            SAsyncQueuePlacement placement(placeNode(n, j, input));
+            if (placement.queued) {
+                n.rawInput.reset(VnxVideo::CreateAsyncProc(n.rawInput, placement.config));
+                n.queue = dynamic_cast<VnxVideo::IAsyncQueue*>(n.rawInput.get());
+            }
+        }
+        else if (placeNode(n, j, input).queued)
+            throw std::runtime_error("pipeline node " + n.id + " cannot have a queue, only nodes taking raw video can");
+
+        if (input != nullptr) {
+            if (n.rawInput) {
+                if (!input->rawOutput)
+                    throw std::runtime_error("pipeline node " + n.id + " takes raw video, which " + input->id + " does not produce");
+                input->rawOutput->Link(n.rawInput.get());
+            }
+            else if (n.codedInput) {
+                if (!input->producesCoded)
+                    throw std::runtime_error("pipeline node " + n.id + " takes coded media, which " + input->id + " does not produce");
+                if (input->codedSubtype != EMST_ANY && input->codedSubtype != n.codedInputSubtype)
+                    throw std::runtime_error("pipeline node " + n.id + " takes other media than " + input->id + " produces");
+                input->codedOutputs[n.codedInputSubtype].push_back(n.codedInput);
+            }
+            else
+                throw std::runtime_error("pipeline node " + n.id + " takes no input");
+        }
+        else if (n.rawInput || n.codedInput)
+            throw std::runtime_error("pipeline node " + n.id + " should have an input");
+
+        m_nodes.push_back(std::move(node));
+    }
+
+    // raw video produced by the node is spread over its outputs by a chain, see ParseRawProcChainConfig for "fanout"
+    template<typename TSubscribe>
+    void subscribeRawOutput(SPipelineNode& n, const json& j, TSubscribe subscribe) {
+        n.rawOutput.reset(VnxVideo::CreateRawProcChain(VnxVideo::ParseRawProcChainConfig(jget<json>(j, "fanout"))));
+        VnxVideo::IRawProcChain* chain = n.rawOutput.get();
+        CPipelineNodeCounters& counters(n.counters);
+        const bool measured = !n.decoder && !n.proc; // sources count frames they produce
+        subscribe([chain](EColorspace csp, int width, int height) {
+            chain->SetFormat(csp, width, height);
+        }, [chain, &counters, measured](VnxVideo::IRawSample* sample, uint64_t timestamp) {
+            if (measured && sample != nullptr)
+                counters.Add();
+            chain->Process(sample, timestamp);
+        });
+    }
+
+    void subscribeCodedOutputs(SPipelineNode& n) {
+        if (!n.mediaSource)
+            return;
+        SPipelineNode* self = &n;
+        for (auto& outputs : n.codedOutputs) {
+            const EMediaSubtype subtype = outputs.first;
+            n.mediaSource->SubscribeMedia(subtype, [self, subtype](VnxVideo::IBuffer* buffer, uint64_t timestamp) {
+                if (buffer != nullptr)
+                    self->counters.Add();
+                self->Output(subtype, buffer, timestamp);
+            });
+        }
+    }
+
+    // nodes of a group run inline on the thread of the group's only entry node, which has the group's queue in front of it.
+    // nodes with no group run inline on the thread of their input, unless they have a queue of their own
+    struct SAsyncQueuePlacement {
+        bool queued;
+        VnxVideo::SAsyncQueueConfig config;
+    };
+    SAsyncQueuePlacement placeNode(SPipelineNode& n, const json& j, SPipelineNode* input) {
+        SAsyncQueuePlacement res;
+        res.queued = false;
+        json queue(jget<json>(j, "queue"));
+        if (!n.group.empty()) {
+            if (!queue.is_null())
+                throw std::runtime_error("pipeline node " + n.id + " is in a group and cannot have a queue of its own");
+            if (input == nullptr || input->group != n.group) {
+                if (!m_groupEntries.insert(std::make_pair(n.group, n.id)).second)
+                    throw std::runtime_error("pipeline group " + n.group + " should have only one entry node, like " + m_groupEntries[n.group]);
+                json groupQueue(jget<json>(m_groups[n.group], "queue"));
+                if (input != nullptr && !groupQueue.is_null()) {
+                    res.queued = true;
+                    res.config = VnxVideo::ParseAsyncQueueConfig(groupQueue);
+                }
+            }
+        }
+        else if (!queue.is_null()) {
+            res.queued = true;
+            res.config = VnxVideo::ParseAsyncQueueConfig(queue);
+        }
+        return res;
+    }
+
+    void release() {
+        for (auto& n : m_nodes)
+            n->Release();
+        m_nodes.clear();
+    }
+
+    std::mutex m_mutex;
+    bool m_running;
+    json m_groups;
+    std::map<std::string, std::string> m_groupEntries;
+    std::vector<std::unique_ptr<SPipelineNode> > m_nodes; // producers go before consumers
+};
+
+namespace VnxVideo {
+    IPipeline* CreatePipeline(const nlohmann::json& config) {
+        return new CPipeline(config);
+    }
+}
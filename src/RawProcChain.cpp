@@ -1,32 +1,204 @@
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
 
 #include "vnxvideoimpl.h"
 #include "vnxvideologimpl.h"
+#include "Executor.h"
+#include "FrameTrace.h"
+#include "jget.h"
+
+// measures the time a link spends in Process, and skips samples which are too old for the link to bother
+class CTimedLink : public VnxVideo::IRawProc {
+public:
+    CTimedLink(VnxVideo::IRawProc* link, int maxAgeMs)
+        : m_link(link)
+        , m_maxAgeMs(maxAgeMs)
+        , m_latency(maxAgeMs > 0 ? GetLatencyHistogram("chain") : nullptr)
+        , m_processed(0)
+        , m_expired(0)
+        , m_totalUs(0)
+        , m_maxUs(0)
+        , m_lastUs(0)
+    {
+    }
+    virtual void SetFormat(ERawMediaFormat csp, int width, int height) {
+        m_link->SetFormat(csp, width, height);
+    }
+    virtual void Process(VnxVideo::IRawSample * sample, uint64_t timestamp) {
+        if (IsFrameExpired(sample, timestamp, m_maxAgeMs)) {
+            RecordFrameExpired(m_latency);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            ++m_expired;
+            return;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        m_link->Process(sample, timestamp);
+        const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_processed;
+        m_totalUs += us;
+        m_maxUs = std::max(m_maxUs, us);
+        m_lastUs = us;
+    }
+    virtual void Flush() {
+        m_link->Flush();
+    }
+    VnxVideo::SRawProcLinkStats GetStats() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        VnxVideo::SRawProcLinkStats stats;
+        stats.processed = m_processed;
+        stats.totalUs = m_totalUs;
+        stats.maxUs = m_maxUs;
+        stats.lastUs = m_lastUs;
+        stats.expired = m_expired;
+        stats.queued = false;
+        stats.queue = VnxVideo::SAsyncQueueStats();
+        return stats;
+    }
+private:
+    VnxVideo::IRawProc* const m_link;
+    const int m_maxAgeMs;
+    CLatencyHistogram* const m_latency;
+    std::mutex m_mutex;
+    uint64_t m_processed;
+    uint64_t m_expired;
+    uint64_t m_totalUs;
+    uint64_t m_maxUs;
+    uint64_t m_lastUs;
+};
 
 class CRawProcChain : public virtual VnxVideo::IRawProcChain {
+public:
+    CRawProcChain(const VnxVideo::SRawProcChainConfig& config)
+        : m_config(config)
+    {
+    }
     virtual void SetFormat(ERawMediaFormat csp, int width, int height) {
-        for (auto link : m_links) {
-            link->SetFormat(csp, width, height);
+        for (const auto& link : m_links) {
+            link.entry->SetFormat(csp, width, height);
         }
     }
     virtual void Process(VnxVideo::IRawSample * sample, uint64_t timestamp) {
-        for (auto link : m_links) {
-            link->Process(sample, timestamp);
+        if (m_config.mode == VnxVideo::ERPCM_PARALLEL && m_links.size() > 1)
+            processParallel(sample, timestamp);
+        else {
+            for (const auto& link : m_links) {
+                link.entry->Process(sample, timestamp);
+            }
         }
     }
     virtual void Flush() {
-        for (auto link : m_links)
-            link->Flush();
+        for (const auto& link : m_links)
+            link.entry->Flush();
     }
     virtual void Link(VnxVideo::IRawProc *link) {
-        m_links.push_back(link);
+        SLink l;
+        l.timed.reset(new CTimedLink(link, m_config.maxAgeMs));
+        if (m_config.mode == VnxVideo::ERPCM_DETACHED) {
+            l.entry.reset(VnxVideo::CreateAsyncProc(l.timed, m_config.queue));
+            l.queue = dynamic_cast<VnxVideo::IAsyncQueue*>(l.entry.get());
+        }
+        else {
+            l.entry = l.timed;
+            l.queue = nullptr;
+        }
+        m_links.push_back(l);
+    }
+    virtual std::vector<VnxVideo::SRawProcLinkStats> GetLinkStats() {
+        std::vector<VnxVideo::SRawProcLinkStats> res;
+        for (const auto& link : m_links) {
+            VnxVideo::SRawProcLinkStats stats(link.timed->GetStats());
+            if (link.queue != nullptr) {
+                stats.queued = true;
+                stats.queue = link.queue->GetQueueStats();
+            }
+            res.push_back(stats);
+        }
+        return res;
     }
 private:
-    std::vector<VnxVideo::IRawProc*> m_links;
+    // the first link runs on the caller's thread, the others on the executor; the sample is only
+    // guaranteed to live until Process returns, so it returns after all of them
+    void processParallel(VnxVideo::IRawSample * sample, uint64_t timestamp) {
+        struct SJoin {
+            std::mutex mutex;
+            std::condition_variable cond;
+            size_t remaining;
+        };
+        auto join = std::make_shared<SJoin>();
+        join->remaining = m_links.size() - 1;
+        for (size_t k = 1; k < m_links.size(); ++k) {
+            std::shared_ptr<CTimedLink> link(m_links[k].timed);
+            ExecutorPost([join, link, sample, timestamp]() {
+                try {
+                    link->Process(sample, timestamp);
+                }
+                catch (const std::exception& e) {
+                    VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CRawProcChain: Exception while processing a sample: " << e.what();
+                }
+                std::unique_lock<std::mutex> lock(join->mutex);
+                if (0 == --join->remaining)
+                    join->cond.notify_all();
+            });
+        }
+        try {
+            m_links[0].timed->Process(sample, timestamp);
+        }
+        catch (const std::exception& e) {
+            VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "CRawProcChain: Exception while processing a sample: " << e.what();
+        }
+
+        // a worker which waits for its fellows might hold up the tasks it waits for
+        const bool worker = ExecutorIsWorkerThread();
+        std::unique_lock<std::mutex> lock(join->mutex);
+        while (join->remaining > 0) {
+            if (worker) {
+                lock.unlock();
+                const bool helped = ExecutorHelp();
+                lock.lock();
+                if (!helped && join->remaining > 0)
+                    join->cond.wait_for(lock, std::chrono::milliseconds(1));
+            }
+            else
+                join->cond.wait(lock);
+        }
+    }
+
+    struct SLink {
+        std::shared_ptr<CTimedLink> timed;
+        VnxVideo::PRawProc entry; // the timed link itself, or the queue in front of it
+        VnxVideo::IAsyncQueue* queue;
+    };
+    const VnxVideo::SRawProcChainConfig m_config;
+    std::vector<SLink> m_links;
 };
 
 namespace VnxVideo {
     VNXVIDEO_DECLSPEC IRawProcChain* CreateRawProcChain() {
-        return new CRawProcChain();
+        return new CRawProcChain(SRawProcChainConfig());
+    }
+    VNXVIDEO_DECLSPEC IRawProcChain* CreateRawProcChain(const SRawProcChainConfig& config) {
+        return new CRawProcChain(config);
+    }
+    SRawProcChainConfig ParseRawProcChainConfig(const nlohmann::json& config) {
+        SRawProcChainConfig res;
+        std::string mode(jget<std::string>(config, "mode"));
+        if (mode.empty() || mode == "sequential")
+            res.mode = ERPCM_SEQUENTIAL;
+        else if (mode == "parallel")
+            res.mode = ERPCM_PARALLEL;
+        else if (mode == "detached")
+            res.mode = ERPCM_DETACHED;
+        else
+            throw std::runtime_error("unknown raw proc chain mode: " + mode);
+        res.queue = ParseAsyncQueueConfig(jget<nlohmann::json>(config, "queue"));
+        res.maxAgeMs = jget<int>(config, "max_age_ms", 0);
+        if (res.maxAgeMs < 0)
+            throw std::runtime_error("raw proc chain max_age_ms should not be negative");
+        return res;
     }
 }
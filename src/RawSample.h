@@ -2,6 +2,8 @@
 
 #include <cstddef>
 #include <cstdlib>
+#include <atomic>
+#include <new>
 #include "vnxipp.h"
 #include "vnxvideoimpl.h"
 
@@ -15,8 +17,12 @@ typedef std::shared_ptr<IAllocator> PAllocator;
 class IShmMapping {
 public:
     virtual ~IShmMapping() {}
+    // whether ptr points into the mapped memory; FromPointer throws for pointers which do not
+    virtual bool Contains(void* ptr) = 0;
     virtual uint64_t FromPointer(void* ptr) = 0;
     virtual void* ToPointer(uint64_t offset) = 0;
+    // keeps the memory at given offset mapped while the result is alive
+    virtual std::shared_ptr<void> Retain(uint64_t offset) = 0;
 };
 
 class IShmAllocator : public virtual IAllocator, public virtual IShmMapping {
@@ -26,14 +32,222 @@ public:
 typedef std::shared_ptr<IShmAllocator> PShmAllocator;
 
 extern IAllocator* const g_privateAllocator;
+// Private heap allocations recycled through per-size-class free lists.
+// This is the default allocator for samples when no shm allocator is preferred.
+extern IAllocator* const g_framePoolAllocator;
 
+enum ENumaPolicy {
+    ENP_DEFAULT,        // memory is placed on the node of the thread which first touches it
+    ENP_PREFERRED_NODE, // on the given node when possible
+    ENP_INTERLEAVE      // interleaved across all allowed nodes
+};
+// Memory placement for frame buffers, both private and shared. Only supported on Linux.
+struct SFrameMemoryMode {
+    bool hugePages; // back frames with 2 MB pages: reserved huge pages if any, transparent otherwise
+    ENumaPolicy numaPolicy;
+    int numaNode;   // for ENP_PREFERRED_NODE
+};
+void SetFrameMemoryMode(const SFrameMemoryMode& mode);
+SFrameMemoryMode GetFrameMemoryMode();
+// Layout of video frames allocated by CRawSample. Strides and plane offsets are multiples
+// of the alignment, so that rows start at a cache line and wide vector loads are aligned.
+// Guard padding lets kernels read past the right edge of a row and below the last row
+// of a plane without tail handling.
+struct SFrameLayout {
+    int alignment;     // power of two from 16 to 4096
+    int paddingRight;  // bytes in every row past the plane width
+    int paddingBottom; // rows past the plane height
+};
+void SetFrameLayout(const SFrameLayout& layout);
+SFrameLayout GetFrameLayout();
+// VNX_HUGEPAGES=1 enables huge pages, VNX_NUMA_POLICY is either "interleave" or a node number.
+// VNX_FRAME_ALIGNMENT, VNX_FRAME_PADDING_RIGHT and VNX_FRAME_PADDING_BOTTOM set the frame layout.
+// Called from vnxvideo_init.
+void InitFrameMemoryModeFromEnvironment();
+
+struct SFramePoolStats {
+    uint64_t hits;          // allocations served from a free list
+    uint64_t misses;        // allocations which had to go to the heap
+    uint64_t idleBytes;     // bytes currently kept in free lists
+    uint64_t capacityBytes; // upper limit for idleBytes, 0 if pooling is disabled
+};
+SFramePoolStats GetFramePoolStats();
+// Put a few buffers suitable for a frame of given format and size into the frame pool,
+// so that the first frames after a format change do not have to hit the heap.
+// Does nothing if the calling thread has a preferred shm allocator.
+void PrewarmFramePool(ERawMediaFormat emf, int width, int height, int count = 3);
+
+// VNX_SHM_ALLOCATOR environment variable set to "slab" or "arena" makes it return respective allocator;
+// for the latter, VNX_SHM_MAX_SPILL_SEGMENTS sets the limit of spillover segments.
 IShmAllocator *CreateShmAllocator(const char* name, int maxSizeMB);
+// allocator for frames of a few fixed sizes without a lock on the hot path
+IShmAllocator *CreateShmSlabAllocator(const char* name, int maxSizeMB);
+// growable allocator which adds segments of the same size when the primary one is exhausted
+IShmAllocator *CreateShmArenaAllocator(const char* name, int segmentSizeMB, int maxSpillSegments);
 IShmMapping* CreateShmMapping(const char* name);
 
 void WithPreferredShmAllocator(IShmAllocator* allocator, std::function<void(void)> action);
 IShmAllocator* GetPreferredShmAllocator();
 PShmAllocator DupPreferredShmAllocator();
 
+// Counters of memory handed out by an allocator. The private allocator, the frame pool
+// and every shared memory segment created by the functions above have their own.
+struct SAllocatorStats {
+    std::string name;
+    int64_t liveBytes;  // allocated and not yet released
+    int64_t peakBytes;  // maximum of liveBytes
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failures;  // allocations which returned no memory
+};
+std::vector<SAllocatorStats> GetAllocatorStats();
+// Samples which could not be allocated because the preferred shm allocator was exhausted
+uint64_t GetPreferredAllocatorFailures();
+void CountPreferredAllocatorFailure();
+
+// Frames held by clients of local transport providers
+struct SLocalClientStats {
+    std::string address; // of the provider
+    int client;          // sequential number of the client connection
+    int pinnedFrames;    // sent to the client and not freed yet
+    int64_t pinnedBytes;
+    uint64_t deliveredFrames;
+    uint64_t skippedFrames; // published while the client could not take them
+    int credits;         // frames the provider may push to the client without a request
+    uint64_t rejectedFrames;  // not sent because the client held as much as it may
+    uint64_t reclaimedFrames; // taken back from the client after the lease timeout
+    bool lagging;        // the client has not freed frames which were reclaimed from it
+};
+std::vector<SLocalClientStats> GetLocalTransportStats();
+
+// Memory for small objects which are created and destroyed on every frame, like sample
+// objects and their shared_ptr control blocks. Released blocks are cached per thread,
+// and passed between threads in batches, so the heap is only used when the number
+// of such objects grows.
+void* SmallObjectAlloc(size_t size);
+void SmallObjectFree(void* ptr, size_t size);
+
+template <typename T>
+class CSmallObjectAllocator {
+public:
+    typedef T value_type;
+    CSmallObjectAllocator() {}
+    template <typename U> CSmallObjectAllocator(const CSmallObjectAllocator<U>&) {}
+    T* allocate(size_t n) {
+        return static_cast<T*>(SmallObjectAlloc(n * sizeof(T)));
+    }
+    void deallocate(T* ptr, size_t n) {
+        SmallObjectFree(ptr, n * sizeof(T));
+    }
+    template <typename U> bool operator==(const CSmallObjectAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const CSmallObjectAllocator<U>&) const { return false; }
+};
+
+// Take ownership of a sample, typically the result of IRawSample::Dup(),
+// without allocating the control block on the heap.
+inline VnxVideo::PRawSample MakeRawSamplePtr(VnxVideo::IRawSample* sample) {
+    return VnxVideo::PRawSample(sample, std::default_delete<VnxVideo::IRawSample>(), CSmallObjectAllocator<VnxVideo::IRawSample>());
+}
+
+// Header of a frame buffer with an intrusive reference count, shared by all duplicates of a sample.
+// It is placed in front of plane data when the sample allocates its buffer from private memory, and is
+// allocated on its own when the sample wraps memory owned by someone else or the buffer is in shared
+// memory, which other processes map and should not see the addresses of this one's heap in.
+struct SFrameHeader {
+    std::atomic<int> refs;
+    const bool separate;
+    std::shared_ptr<uint8_t> buffer;  // buffer the header and planes reside in
+    std::shared_ptr<void> underlying; // owner of wrapped memory, if any
+
+    // space reserved in front of plane data, keeps planes aligned
+    static const int Space = 64;
+
+    static SFrameHeader* Create(std::shared_ptr<uint8_t> buffer) {
+        SFrameHeader* h = new (buffer.get()) SFrameHeader(false);
+        h->buffer = std::move(buffer);
+        return h;
+    }
+    static SFrameHeader* CreateSeparate(std::shared_ptr<void> underlying) {
+        SFrameHeader* h = new (SmallObjectAlloc(sizeof(SFrameHeader))) SFrameHeader(true);
+        h->underlying = std::move(underlying);
+        return h;
+    }
+    static void Destroy(SFrameHeader* h) {
+        if (h->separate) {
+            h->~SFrameHeader();
+            SmallObjectFree(h, sizeof(SFrameHeader));
+        }
+        else {
+            std::shared_ptr<uint8_t> buffer(std::move(h->buffer));
+            h->~SFrameHeader();
+        } // the buffer the header resides in is released here
+    }
+private:
+    SFrameHeader(bool separate)
+        : refs(1)
+        , separate(separate)
+    {
+    }
+};
+
+static_assert(sizeof(SFrameHeader) <= SFrameHeader::Space, "frame header does not fit into the space reserved for it");
+
+// Reference to a frame header. Copying is an atomic increment of the reference count.
+class CFrameRef {
+public:
+    CFrameRef()
+        : m_header(nullptr)
+    {
+    }
+    explicit CFrameRef(SFrameHeader* header) // takes over the initial reference
+        : m_header(header)
+    {
+    }
+    CFrameRef(const CFrameRef& other)
+        : m_header(other.m_header)
+    {
+        if (m_header)
+            m_header->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    CFrameRef& operator=(CFrameRef other) {
+        std::swap(m_header, other.m_header);
+        return *this;
+    }
+    ~CFrameRef() {
+        if (m_header && m_header->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            SFrameHeader::Destroy(m_header);
+    }
+private:
+    SFrameHeader* m_header;
+};
+
+// Handle of a frame: a reference to its buffer along with its format, planes and trace. Copying a handle
+// is an atomic increment of the reference count, with no allocation. CRawSample adapts a handle to IRawSample.
+struct SRawFrame {
+    CFrameRef ref;
+    EColorspace csp;
+    int width;  // or number of samples, for audio
+    int height; // or number of channels
+    int nplanes;
+    int strides[4];
+    uint8_t* planes[4];
+    VnxVideo::SFrameTrace trace;
+    SRawFrame()
+        : csp(EMF_NONE)
+        , width(0)
+        , height(0)
+        , nplanes(0)
+        , strides{ 0, 0, 0, 0 }
+        , planes{ nullptr, nullptr, nullptr, nullptr }
+    {
+    }
+};
+
+// Sample objects are allocated from per-thread caches, so that Dup() does not go to the heap.
+#define VNX_SMALL_OBJECT_NEW_DELETE \
+    static void* operator new(size_t size) { return SmallObjectAlloc(size); } \
+    static void operator delete(void* ptr, size_t size) { SmallObjectFree(ptr, size); }
+
 
 class CRawSample : public VnxVideo::IRawSample
 {
@@ -47,20 +261,24 @@ private:
         const int m_height;
         const int m_nchannels;
     };
-    std::shared_ptr<uint8_t> m_data;
+    CFrameRef m_frame;
+    uint8_t* m_data;
 
     int m_nplanes;
     int m_strides[4];
     ptrdiff_t m_offsets[4];
-
-    std::shared_ptr<void> m_underlying;
+    VnxVideo::SFrameTrace m_trace;
 
     static int ceil16(int v) {
         return (v & 0x0000000f) ? ((v & 0x0ffffff0) + 0x10) : v;
     }
+    static int alignUp(int v, int alignment) {
+        return (v + alignment - 1) & ~(alignment - 1);
+    }
 public:
 private:
-    void Init(ERawMediaFormat csp, int width, int height, int* strides, uint8_t **planes, IAllocator* allocate)
+    void Init(ERawMediaFormat csp, int width, int height, int* strides, uint8_t **planes, IAllocator* allocate,
+        std::shared_ptr<void> underlying = std::shared_ptr<void>())
     {
         // NB: for video formats, it could be that csp!=m_csp inside of this call.
         // which means that format conversion should be performed.
@@ -70,61 +288,37 @@ private:
             throw std::logic_error("Sample format other than I420, NV12 or GRAY is only supported when wrapping or allocating a frame");
 
         if (allocate) {
-            FillStridesOffsets(m_csp, m_width, m_height, m_nplanes, m_strides, m_offsets, true);
-            int size=0;
-            if (csp < EMF_AUDIO) {
-                for (int k = 0; k < m_nplanes; ++k)
-                    m_strides[k] = ceil16(m_strides[k]);
-
-                int height2 = m_height;
-                int height3 = m_height;
-                if (m_csp == EMF_I420 || m_csp == EMF_P440) {
-                    height2 /= 2;
-                    height3 = height2;
-                }
-                if (m_csp == EMF_NV12 || m_csp == EMF_NV21) {
-                    height2 /= 2;
-                    height3 = 0;
-                }
-                int heights[4] = { m_height, height2, height3, 0 };
-                // how did it come to this:
-                // see https://github.com/mozilla/mozjpeg/blob/master/turbojpeg.c#L630
-                // function tjBufSize. Both width and height are rounded up to MCU size (which is at most 16).
-                // 2048 is added then (in advance?).
-                size = 2048;
-                for (int k = 0; k < m_nplanes; ++k)
-                    size += m_strides[k] * ceil16(heights[k]);
-            }
-            else {
-                switch (m_csp) {
-                case EMF_LPCM16: 
-                case EMF_LPCM16P:
-                    size = m_nsamples * m_nchannels * 2;
-                    break;
-                case EMF_LPCM32:
-                case EMF_LPCM32P:
-                case EMF_LPCMF:
-                case EMF_LPCMFP:
-                    size = m_nsamples * m_nchannels * 4;
-                    break;
-                }
-            }
-            m_data = allocate->Alloc(size);
-            if (nullptr == m_data)
+            const SFrameLayout layout(GetFrameLayout());
+            FillStridesOffsets(m_csp, m_width, m_height, m_nplanes, m_strides, m_offsets, &layout);
+            const int size = AllocationSize(m_csp, m_width, m_height, layout);
+            std::shared_ptr<uint8_t> buffer(allocate->Alloc(size));
+            if (nullptr == buffer && allocate == GetPreferredShmAllocator())
+                CountPreferredAllocatorFailure(); // shared memory is exhausted
+            if (nullptr == buffer)
                 throw std::runtime_error("CRawSample::Init(): Cannot allocate data buffer");
+            // allocators only guarantee 16 byte alignment, AllocationSize reserves space for more
+            m_data = buffer.get() + SFrameHeader::Space;
+            const int misalignment = (int)((uintptr_t)m_data & (layout.alignment - 1));
+            if (misalignment != 0)
+                m_data += layout.alignment - misalignment;
+            if (dynamic_cast<IShmAllocator*>(allocate) != nullptr)
+                m_frame = CFrameRef(SFrameHeader::CreateSeparate(std::move(buffer)));
+            else
+                m_frame = CFrameRef(SFrameHeader::Create(std::move(buffer)));
 
             if (strides && planes) {
-                uint8_t* my_planes[4] = { m_data.get() + m_offsets[0], m_data.get() + m_offsets[1], m_data.get() + m_offsets[2], m_data.get() + m_offsets[3] };
+                uint8_t* my_planes[4] = { m_data + m_offsets[0], m_data + m_offsets[1], m_data + m_offsets[2], m_data + m_offsets[3] };
                 if(m_csp==EMF_I420) // the only case we can handle when copying video data with format conversion
                     CopyRawToI420(width, height, csp, planes, strides, my_planes, m_strides);
             }
         }
         else {
             FillStridesOffsets(m_csp, m_width, m_height, m_nplanes, nullptr, nullptr, false);
-            m_data.reset(planes[0], [](void*) {});
+            m_data = planes[0];
+            m_frame = CFrameRef(SFrameHeader::CreateSeparate(std::move(underlying)));
             for (int k = 0; k < m_nplanes; ++k) {
                 m_strides[k] = strides[k];
-                m_offsets[k] = planes[k] - m_data.get();
+                m_offsets[k] = planes[k] - m_data;
             }
         }
     }
@@ -138,7 +332,7 @@ public:
         if (a == nullptr)
             a = GetPreferredShmAllocator();
         if (a == nullptr)
-            a = g_privateAllocator;
+            a = g_framePoolAllocator;
         Init(emf, width, height, nullptr, nullptr, a);
     }
     // for backwards compatibility, deprecated
@@ -151,7 +345,7 @@ public:
         if (a == nullptr)
             a = GetPreferredShmAllocator();
         if (a == nullptr)
-            a = g_privateAllocator;
+            a = g_framePoolAllocator;
 
         Init(m_csp, width, height, nullptr, nullptr, a);
     }
@@ -167,7 +361,7 @@ public:
         if (copyData || (strides == nullptr && planes == nullptr)) {
             a = GetPreferredShmAllocator();
             if (a == nullptr)
-                a = g_privateAllocator;
+                a = g_framePoolAllocator;
         }
 
         Init(csp, width, height, strides, planes, a);
@@ -181,7 +375,7 @@ public:
         if (a == nullptr)
             a = GetPreferredShmAllocator();
         if (a == nullptr)
-            a = g_privateAllocator;
+            a = g_framePoolAllocator;
 
         Init(csp, width, height, strides, planes, a);
     }
@@ -190,9 +384,36 @@ public:
         : m_csp(csp)
         , m_width(width)
         , m_height(height)
-        , m_underlying(underlying)
     {
-        Init(csp, width, height, strides, planes, nullptr);
+        Init(csp, width, height, strides, planes, nullptr, underlying);
+    }
+    explicit CRawSample(const SRawFrame& frame)
+        : m_csp(frame.csp)
+        , m_width(frame.width)
+        , m_height(frame.height)
+        , m_frame(frame.ref)
+        , m_data(frame.planes[0])
+        , m_nplanes(frame.nplanes)
+        , m_trace(frame.trace)
+    {
+        for (int k = 0; k < 4; ++k) {
+            m_strides[k] = frame.strides[k];
+            m_offsets[k] = (k < m_nplanes) ? frame.planes[k] - m_data : 0;
+        }
+    }
+    SRawFrame GetFrame() const {
+        SRawFrame frame;
+        frame.ref = m_frame;
+        frame.csp = m_csp;
+        frame.width = m_width;
+        frame.height = m_height;
+        frame.nplanes = m_nplanes;
+        for (int k = 0; k < m_nplanes; ++k) {
+            frame.strides[k] = m_strides[k];
+            frame.planes[k] = m_data + m_offsets[k];
+        }
+        frame.trace = m_trace;
+        return frame;
     }
     void GetFormat(EColorspace &csp, int &width, int &height) {
         csp = m_csp;
@@ -205,20 +426,54 @@ public:
     void GetData(int* strides, uint8_t** planes) {
         for (int k = 0; k < m_nplanes; ++k) {
             strides[k] = m_strides[k];
-            planes[k] = m_data.get() + m_offsets[k];
+            planes[k] = m_data + m_offsets[k];
         }
     }
     VnxVideo::IRawSample* Dup() {
-        return new CRawSample(*this); // copy constructor will do as CComPtr copy ctor provides behaviour we need
+        return new CRawSample(*this); // copy constructor will do as CFrameRef copy ctor provides behaviour we need
     }
+    bool GetTrace(VnxVideo::SFrameTrace& trace) {
+        trace = m_trace;
+        return m_trace.ingestNs != 0;
+    }
+    void SetTrace(const VnxVideo::SFrameTrace& trace) {
+        m_trace = trace;
+    }
+    VNX_SMALL_OBJECT_NEW_DELETE
 
 public:
+    // size of the data buffer which Init() allocates for a sample of given format
+    static int AllocationSize(ERawMediaFormat emf, int p1, int p2) {
+        return AllocationSize(emf, p1, p2, GetFrameLayout());
+    }
+    static int AllocationSize(ERawMediaFormat emf, int p1, int p2, const SFrameLayout& layout) {
+        int nplanes;
+        int size = FillStridesOffsets(emf, p1, p2, nplanes, nullptr, nullptr, &layout);
+        if (emf < EMF_AUDIO) {
+            // how did it come to this:
+            // see https://github.com/mozilla/mozjpeg/blob/master/turbojpeg.c#L630
+            // function tjBufSize. Both width and height are rounded up to MCU size (which is at most 16).
+            // 2048 is added then (in advance?).
+            size += 2048;
+        }
+        return size + SFrameHeader::Space + layout.alignment;
+    }
     static void FillStridesOffsets(ERawMediaFormat emf, int p1, int p2, int& nplanes, int* strides, ptrdiff_t* offsets, bool alignStridesAndHeights) {
+        if (alignStridesAndHeights) {
+            const SFrameLayout layout(GetFrameLayout());
+            FillStridesOffsets(emf, p1, p2, nplanes, strides, offsets, &layout);
+        }
+        else
+            FillStridesOffsets(emf, p1, p2, nplanes, strides, offsets, nullptr);
+    }
+    // Without a layout, planes are packed tightly, the way capture devices provide them.
+    // With a layout, strides and offsets are aligned, and heights are rounded up to 16 and padded.
+    // Returns the size of memory the planes occupy.
+    static int FillStridesOffsets(ERawMediaFormat emf, int p1, int p2, int& nplanes, int* strides, ptrdiff_t* offsets, const SFrameLayout* layout) {
         const int width = p1;
         const int height = p2;
         const int nsamples = p1;
         const int nchannels = p2;
-        auto ceilDim = alignStridesAndHeights ? ceil16 : [](int x) {return x; };
         int stridesDummy[4];
         ptrdiff_t offsetsDummy[4];
         if (strides == nullptr) {
@@ -229,92 +484,104 @@ public:
         }
         memset(strides, 0, sizeof(int) * 4);
         memset(offsets, 0, sizeof(ptrdiff_t) * 4);
+        nplanes = 0;
+        if (emf < EMF_AUDIO) {
+            int rowBytes[4] = { 0,0,0,0 };
+            int rows[4] = { 0,0,0,0 };
+            int order[4] = { 0,1,2,3 }; // order of planes in memory
+            switch (emf) {
+            case EMF_I420:
+            case EMF_YV12:
+                nplanes = 3;
+                rowBytes[0] = width;
+                rowBytes[1] = rowBytes[2] = width / 2;
+                rows[0] = height;
+                rows[1] = rows[2] = height / 2;
+                if (emf == EMF_YV12)
+                    std::swap(order[1], order[2]);
+                break;
+            case EMF_NV12:
+            case EMF_NV21:
+                nplanes = 2;
+                rowBytes[0] = rowBytes[1] = width;
+                rows[0] = height;
+                rows[1] = height / 2;
+                break;
+            case EMF_YUY2:
+            case EMF_UYVY:
+                nplanes = 1;
+                rowBytes[0] = width * 2;
+                rows[0] = height;
+                break;
+            case EMF_I444:
+                nplanes = 3;
+                rowBytes[0] = rowBytes[1] = rowBytes[2] = width;
+                rows[0] = rows[1] = rows[2] = height;
+                break;
+            case EMF_P422:
+                nplanes = 3;
+                rowBytes[0] = width;
+                rowBytes[1] = rowBytes[2] = width / 2;
+                rows[0] = rows[1] = rows[2] = height;
+                break;
+            case EMF_P440:
+                nplanes = 3;
+                rowBytes[0] = rowBytes[1] = rowBytes[2] = width;
+                rows[0] = height;
+                rows[1] = rows[2] = height / 2;
+                break;
+            case EMF_GRAY:
+                nplanes = 1;
+                rowBytes[0] = width;
+                rows[0] = height;
+                break;
+            default:
+                break;
+            }
+            int offset = 0;
+            for (int n = 0; n < nplanes; ++n) {
+                const int k = order[n];
+                int planeRows = rows[k];
+                if (layout) {
+                    strides[k] = alignUp(rowBytes[k] + layout->paddingRight, layout->alignment);
+                    planeRows = ceil16(planeRows) + layout->paddingBottom;
+                }
+                else
+                    strides[k] = rowBytes[k];
+                offsets[k] = offset;
+                offset += strides[k] * planeRows;
+            }
+            return offset;
+        }
         switch (emf) {
-        case EMF_I420:
-            nplanes = 3;
-            strides[0] = ceilDim(width);
-            strides[1] = strides[2] = ceilDim(width / 2);
-            offsets[0] = 0;
-            offsets[1] = strides[0] * ceilDim(height);
-            offsets[2] = offsets[1] + strides[1] * ceilDim(height / 2);
-            break;
-        case EMF_YV12:
-            nplanes = 3;
-            strides[0] = ceilDim(width);
-            strides[1] = strides[2] = ceilDim(width / 2);
-            offsets[0] = 0;
-            offsets[2] = strides[0] * ceilDim(height);
-            offsets[1] = offsets[1] + strides[1] * ceilDim(height / 2);
-            break;
-        case EMF_NV12:
-        case EMF_NV21:
-            nplanes = 2;
-            strides[0] = width;
-            strides[1] = width;
-            offsets[0] = 0;
-            offsets[1] = width*height;
-            break;
-        case EMF_YUY2:
-        case EMF_UYVY:
-            nplanes = 1;
-            strides[0] = width*2;
-            offsets[0] = 0;
-            break;
-        case EMF_I444:
-            nplanes = 3;
-            strides[0] = strides[1] = strides[2] = ceilDim(width);
-            offsets[0] = 0;
-            offsets[1] = strides[0] * ceilDim(height);
-            offsets[2] = offsets[1] + strides[1] * ceilDim(height);
-            break;
-        case EMF_P422:
-            nplanes = 3;
-            strides[0] = ceilDim(width);
-            strides[1] = strides[2] = ceilDim(width) / 2;
-            offsets[0] = 0;
-            offsets[1] = strides[0] * ceilDim(height);
-            offsets[2] = offsets[1] + strides[1] * ceilDim(height);
-            break;
-        case EMF_P440:
-            nplanes = 3;
-            strides[0] = strides[1] = strides[2] = ceilDim(width);
-            offsets[0] = 0;
-            offsets[1] = strides[0] * ceilDim(height/2);
-            offsets[2] = offsets[1] + strides[1] * ceilDim(height/2);
-            break;
-        case EMF_GRAY:
-            nplanes = 1;
-            strides[0] = ceilDim(width);
-            strides[1] = strides[2] = 0;
-            offsets[0] = 0;
-            offsets[1] = strides[0] * ceilDim(height);
-            offsets[2] = offsets[1] + strides[1] * ceilDim(height);
-            break;
         case EMF_LPCM16:
             nplanes = 1;
             strides[0] = nsamples * nchannels * 2;
             offsets[0] = 0;
-            break;
+            return strides[0];
         case EMF_LPCM32:
         case EMF_LPCMF:
             nplanes = 1;
             strides[0] = nsamples * nchannels * 4;
             offsets[0] = 0;
-            break;
+            return strides[0];
         case EMF_LPCM16P:
             nplanes = nchannels;
             strides[0] = nsamples * 2; // FFmpeg convention: only first stride is set
             for(int k=0; k < std::min<int>(nchannels, 4); ++k)
                 offsets[k] = k * nsamples * 2;
-            break;
+            return nsamples * nchannels * 2;
         case EMF_LPCM32P:
         case EMF_LPCMFP:
             nplanes = nchannels;
             strides[0] = nsamples * 4;
             for (int k = 0; k < std::min<int>(nchannels, 4); ++k)
                 offsets[k] = k * nsamples * 4;
+            return nsamples * nchannels * 4;
+        default:
             break;
         }
+        return 0;
     }
     /*
     never tested
@@ -449,12 +716,29 @@ public:
     }
 };
 
+// Handle of the frame of any sample: that of a CRawSample is shared, other samples are duplicated
+// and kept alive by the handle.
+inline SRawFrame RawFrameOf(VnxVideo::IRawSample* sample) {
+    if (CRawSample* raw = dynamic_cast<CRawSample*>(sample))
+        return raw->GetFrame();
+    SRawFrame frame;
+    VnxVideo::PRawSample dup(MakeRawSamplePtr(sample->Dup()));
+    dup->GetFormat(frame.csp, frame.width, frame.height);
+    dup->GetData(frame.strides, frame.planes);
+    while (frame.nplanes < 4 && frame.planes[frame.nplanes] != nullptr)
+        ++frame.nplanes;
+    dup->GetTrace(frame.trace);
+    frame.ref = CFrameRef(SFrameHeader::CreateSeparate(std::move(dup)));
+    return frame;
+}
+
 // A sample created from another sample by selecting a specific ROI. Shares same underlying memory with original sample.
+// Supports all video formats. For formats with subsampled chroma the origin of the ROI is moved left and up to the nearest
+// position where luma and chroma samples are co-sited. ROI of an ROI refers to the original sample.
 class CRawSampleRoi : public VnxVideo::IRawSample {
 public:
     CRawSampleRoi(VnxVideo::IRawSample* sample, int left, int top, int width, int height) 
-        : m_sample(sample->Dup())
-        , m_left(left)
+        : m_left(left)
         , m_top(top)
         , m_width(width)
         , m_height(height)
@@ -463,7 +747,7 @@ public:
         int w;
         int h;
         sample->GetFormat(csp, w, h);
-        if (csp != EMF_I420 && csp != EMF_NV12) {
+        if (csp == EMF_NONE || csp >= EMF_AUDIO) {
             throw std::logic_error("CRawSampleRoi ctor: colorspace format not supported for selecting ROI");
         }
         if (left < 0 || top < 0 || width <= 0 || height <= 0) {
@@ -473,33 +757,127 @@ public:
             throw std::logic_error("CRawSampleRoi ctor: roi exceeds original sample size");
         }
         m_csp = csp;
+        int alignX, alignY;
+        originAlignment(csp, alignX, alignY);
+        m_left -= m_left % alignX;
+        m_top -= m_top % alignY;
+
+        CRawSampleRoi* roi = dynamic_cast<CRawSampleRoi*>(sample);
+        if (roi) {
+            m_frame = roi->m_frame;
+            m_left += roi->m_left;
+            m_top += roi->m_top;
+        }
+        else
+            m_frame = RawFrameOf(sample);
+        sample->GetTrace(m_trace);
     }
     VnxVideo::IRawSample* Dup() {
-        return new CRawSampleRoi(*this); // copy constructor will do as underlying shared_ptr provides behaviour we need
+        return new CRawSampleRoi(*this); // copy constructor will do as the frame handle provides behaviour we need
+    }
+    bool GetTrace(VnxVideo::SFrameTrace& trace) {
+        trace = m_trace;
+        return m_trace.ingestNs != 0;
+    }
+    void SetTrace(const VnxVideo::SFrameTrace& trace) {
+        m_trace = trace;
     }
+    VNX_SMALL_OBJECT_NEW_DELETE
     void GetFormat(EColorspace &csp, int &width, int &height) {
         csp = m_csp;
         width = m_width;
         height = m_height;
     }
     void GetData(int* strides, uint8_t** planes) {
-        m_sample->GetData(strides, planes);
-        if (m_csp == EMF_I420) {
-            planes[0] += m_top*strides[0] + m_left;
-            planes[1] += (m_top / 2)*strides[1] + m_left / 2;
-            planes[2] += (m_top / 2)*strides[2] + m_left / 2;
+        const int nplanes = numPlanes(m_csp);
+        for (int k = 0; k < nplanes; ++k) {
+            strides[k] = m_frame.strides[k];
+            planes[k] = m_frame.planes[k];
         }
-        else if(m_csp==EMF_NV12) {
-            planes[0] += m_top*strides[0] + m_left;
-            planes[1] += (m_top / 2)*strides[1] + (m_left & 0xfffffffe);
+        for (int k = 0; k < nplanes; ++k) {
+            int shiftX, shiftY, bytesPerPixel;
+            planeSubsampling(m_csp, k, shiftX, shiftY, bytesPerPixel);
+            planes[k] += (m_top >> shiftY)*strides[k] + (m_left >> shiftX)*bytesPerPixel;
         }
     }
 private:
-    std::shared_ptr<VnxVideo::IRawSample> m_sample;
+    static int numPlanes(EColorspace csp) {
+        switch (csp) {
+        case EMF_I420: case EMF_YV12: case EMF_YVU9: case EMF_I444: case EMF_P422: case EMF_P440:
+            return 3;
+        case EMF_NV12: case EMF_NV21:
+            return 2;
+        default:
+            return 1;
+        }
+    }
+    // subsampling of a plane relative to luma, as shifts of coordinates, and size of a (sub)sampled pixel in the plane
+    static void planeSubsampling(EColorspace csp, int plane, int& shiftX, int& shiftY, int& bytesPerPixel) {
+        shiftX = shiftY = 0;
+        bytesPerPixel = 1;
+        switch (csp) {
+        case EMF_I420:
+        case EMF_YV12:
+            shiftX = shiftY = (plane > 0) ? 1 : 0;
+            break;
+        case EMF_NV12:
+        case EMF_NV21:
+            if (plane > 0) {
+                shiftX = shiftY = 1;
+                bytesPerPixel = 2; // interleaved chroma pair
+            }
+            break;
+        case EMF_P422:
+            shiftX = (plane > 0) ? 1 : 0;
+            break;
+        case EMF_P440:
+            shiftY = (plane > 0) ? 1 : 0;
+            break;
+        case EMF_YVU9:
+            shiftX = shiftY = (plane > 0) ? 2 : 0;
+            break;
+        case EMF_YUY2:
+        case EMF_UYVY:
+        case EMF_RGB16:
+            bytesPerPixel = 2;
+            break;
+        case EMF_RGB24:
+            bytesPerPixel = 3;
+            break;
+        case EMF_RGB32:
+            bytesPerPixel = 4;
+            break;
+        default:
+            break;
+        }
+    }
+    // alignment of ROI origin needed to keep chroma co-sited with luma
+    static void originAlignment(EColorspace csp, int& alignX, int& alignY) {
+        alignX = alignY = 1;
+        switch (csp) {
+        case EMF_I420: case EMF_YV12: case EMF_NV12: case EMF_NV21:
+            alignX = alignY = 2;
+            break;
+        case EMF_P422: case EMF_YUY2: case EMF_UYVY: // in packed 4:2:2 a pair of pixels shares chroma
+            alignX = 2;
+            break;
+        case EMF_P440:
+            alignY = 2;
+            break;
+        case EMF_YVU9:
+            alignX = alignY = 4;
+            break;
+        default:
+            break;
+        }
+    }
+
+    SRawFrame m_frame; // of the original sample
     EColorspace m_csp;
-    const int m_left;
-    const int m_top;
+    int m_left;
+    int m_top;
     const int m_width;
     const int m_height;
+    VnxVideo::SFrameTrace m_trace;
 };
 
@@ -3,6 +3,7 @@
 #include <thread>
 #include <chrono>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
 
@@ -17,11 +18,16 @@ extern "C" {
 #include "vnxvideologimpl.h"
 #include "RawSample.h"
 #include "FFmpegUtils.h"
+#include "FrameTrace.h"
+#include "EventTrace.h"
+#include "Executor.h"
 
 class CRendererImplMixin {
 public:
     virtual void InputSetFormat(int input, EColorspace csp, int width, int height) = 0;
     virtual void InputSetSample(int input, VnxVideo::IRawSample* sample, uint64_t timestamp) = 0;
+    virtual int InputMaxFrameAge() = 0;
+    virtual void InputHoldSample(int input) = 0;
 };
 
 class CRendererImplMixinProxy: public CRendererImplMixin {
@@ -47,15 +53,44 @@ public:
             m_impl->InputSetSample(input, sample, timestamp);
         }
     }
+    virtual int InputMaxFrameAge() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (nullptr != m_impl) {
+            return m_impl->InputMaxFrameAge();
+        }
+        return 0;
+    }
+    virtual void InputHoldSample(int input) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (nullptr != m_impl) {
+            m_impl->InputHoldSample(input);
+        }
+    }
 };
 
+// A video frame which is older than the max frame age when it comes to an input is held here instead of being
+// transformed and rendered. A newer frame of the input replaces it, as it would replace the rendered one anyway;
+// if none comes by the next refresh, the renderer processes the held frame, so that the viewport does not stay
+// on an even older one.
+struct SRendererInputState {
+    std::mutex mutex;
+    VnxVideo::PRawTransform transform;
+    VnxVideo::PRawSample late;
+    uint64_t lateTimestamp;
+    SRendererInputState(VnxVideo::PRawTransform t) : transform(t), lateTimestamp(0) {}
+};
+typedef std::shared_ptr<SRendererInputState> PRendererInputState;
+
 // this class contains no logic, it's just a proxy for binding an "input" argument to produce a RawProc interface
 class CRendererInput : public VnxVideo::IRawProc {
 public:
-    CRendererInput(std::shared_ptr<CRendererImplMixin> renderer, int input, VnxVideo::PRawTransform transform)
+    CRendererInput(std::shared_ptr<CRendererImplMixin> renderer, int input, VnxVideo::PRawTransform transform,
+        PRendererInputState state)
         : m_renderer(renderer)
         , m_input(input)
         , m_transform(transform)
+        , m_state(state)
+        , m_latency(GetLatencyHistogram("renderer_input"))
     {
         if (m_transform) {
             m_transform->Subscribe([renderer,input](ERawMediaFormat emf, int w, int h) {
@@ -73,15 +108,28 @@ public:
             m_renderer->InputSetFormat(m_input, emf, width, height);
     }
     virtual void Process(VnxVideo::IRawSample* sample, uint64_t timestamp) {
-        if (m_transform) {
-            ERawMediaFormat emf;
-            int x, y;
-            sample->GetFormat(emf, x, y);
-            if (vnxvideo_emf_is_video(emf))
-                m_transform->Process(sample, timestamp);
-            else
-                m_renderer->InputSetSample(m_input, sample, timestamp);
+        ERawMediaFormat emf;
+        int x, y;
+        sample->GetFormat(emf, x, y);
+        if (!vnxvideo_emf_is_video(emf)) {
+            m_renderer->InputSetSample(m_input, sample, timestamp);
+            return;
         }
+        const int maxAgeMs = m_renderer->InputMaxFrameAge();
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        if (m_state->late) { // superseded by this one
+            m_state->late.reset();
+            RecordFrameExpired(m_latency);
+        }
+        // a late frame is checked before the transform, which would be wasted on a frame replaced right away
+        if (IsFrameExpired(sample, timestamp, maxAgeMs)) {
+            m_state->late = MakeRawSamplePtr(sample->Dup());
+            m_state->lateTimestamp = timestamp;
+            m_renderer->InputHoldSample(m_input);
+            return;
+        }
+        if (m_transform)
+            m_transform->Process(sample, timestamp);
         else
             m_renderer->InputSetSample(m_input, sample, timestamp);
     }
@@ -92,11 +140,16 @@ public:
         if (m_transform) {
             m_transform->Subscribe([](EColorspace, int, int) {}, [](VnxVideo::IRawSample*, uint64_t) {});
         }
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        m_state->late.reset();
+        m_state->transform.reset();
     }
 private:
     VnxVideo::PRawTransform m_transform;
     std::shared_ptr<CRendererImplMixin> m_renderer;
     const int m_input;
+    PRendererInputState m_state;
+    CLatencyHistogram* const m_latency;
 };
 
 struct SAudioFormat {
@@ -128,6 +181,11 @@ public:
         , m_allocator(allocator)
         , m_selectedAudioSource(-1)
         , m_audioOnFormatCalled(false)
+        , m_heldSamples(false)
+        , m_maxAgeMs(0)
+        , m_workers(1)
+        , m_inputLatency(GetLatencyHistogram("renderer_input"))
+        , m_latency(GetLatencyHistogram("renderer"))
     {
 
     }
@@ -220,6 +278,18 @@ public:
         }
         m_cond.notify_all();
     }
+    void SetMaxFrameAge(int maxAgeMs) {
+        if (maxAgeMs < 0)
+            throw std::runtime_error("CRenderer::SetMaxFrameAge(): max frame age should not be negative");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_maxAgeMs = maxAgeMs;
+    }
+    void SetRenderWorkers(int workers) {
+        if (workers < 1 || workers > MaxRenderWorkers)
+            throw std::runtime_error("CRenderer::SetRenderWorkers(): number of workers should be from 1 to 64");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_workers = workers;
+    }
     void SetBackground(uint8_t* backgroundColor, VnxVideo::IRawSample* backgroundImage) {
         std::unique_lock<std::mutex> lock(m_mutex);
         if(nullptr != backgroundImage){
@@ -268,8 +338,11 @@ public:
             m_samples.resize(index+1);
         if (m_audioFormats.size() < index + 1)
             m_audioFormats.resize(index + 1);
+        if (m_inputStates.size() < index + 1)
+            m_inputStates.resize(index + 1);
         m_samples[index]={ VnxVideo::PRawSample(), 0 };
-        return new CRendererInput(m_rendererImplMixinProxy, index, transform);
+        m_inputStates[index] = std::make_shared<SRendererInputState>(transform);
+        return new CRendererInput(m_rendererImplMixinProxy, index, transform, m_inputStates[index]);
     }
     virtual void InputSetFormat(int input, ERawMediaFormat emf, int x, int y) {
         std::unique_lock<std::mutex> lock(m_mutex);
@@ -296,15 +369,24 @@ public:
         int x, y;
         sample->GetFormat(emf, x, y);
         if (vnxvideo_emf_is_video(emf)) {
-            m_samples[input] = { VnxVideo::PRawSample(sample->Dup()), timestamp };
+            RecordFrameLatency(m_inputLatency, sample);
+            m_samples[input] = { MakeRawSamplePtr(sample->Dup()), timestamp };
             m_dirty = true;
             m_cond.notify_all();
         }
         else if (vnxvideo_emf_is_audio(emf) && input == m_selectedAudioSource) {
-            m_audioSamples.push_back({ VnxVideo::PRawSample(sample->Dup()), timestamp });
+            m_audioSamples.push_back({ MakeRawSamplePtr(sample->Dup()), timestamp });
             m_cond.notify_all();
         }
     }
+    virtual int InputMaxFrameAge() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_maxAgeMs;
+    }
+    virtual void InputHoldSample(int input) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_heldSamples = true;
+    }
 
     virtual void Subscribe(VnxVideo::TOnFormatCallback onFormat, VnxVideo::TOnFrameCallback onFrame) {
         std::unique_lock<std::mutex> lock(m_mutex);
@@ -349,9 +431,14 @@ private:
         while (m_run) {
             if (!m_run)
                 break;
-            while (m_run && !m_dirty && !m_formatDirty && m_audioSamples.empty()) {
+            while (m_run && !m_dirty && !m_formatDirty && m_audioSamples.empty()
+                && !(m_heldSamples && std::chrono::high_resolution_clock::now() >= prev + period)) {
                 m_cond.wait_for(lock, std::chrono::milliseconds(1));
             }
+            if (!m_run)
+                break;
+            if (m_heldSamples && std::chrono::high_resolution_clock::now() >= prev + period)
+                processHeldSamples(lock);
             if (!m_run)
                 break;
             processAudio(lock);
@@ -370,6 +457,7 @@ private:
             auto onFrame = m_onFrame;
             auto onFormat = m_onFormat;
             auto checkFormat = m_formatDirty;
+            const int workers = m_workers;
             m_dirty = false;
             m_formatDirty = false;
 
@@ -390,14 +478,17 @@ private:
                 continue;
             lock.unlock();
             if (checkFormat) {
+                if (!m_allocator)
+                    PrewarmFramePool(EMF_I420, width, height);
                 onFormat(EMF_I420, width, height);
             }
             if (layout) {
                 try{
                     std::pair<VnxVideo::PRawSample, uint64_t> res =
                         doRender(width, height, backgroundColor, backgroundImage, nosignalImage,
-                                 *layout.get(), *swsContexts.get(), m_allocator.get(), samples);
+                                 *layout.get(), *swsContexts.get(), m_allocator.get(), samples, workers);
                     if(res.second != 0) { // res.second == 0 means no samples were received yet
+                        RecordFrameLatency(m_latency, res.first.get());
                         onFrame(res.first.get(), res.second);
                     }
                 }
@@ -425,6 +516,32 @@ private:
         }
     }
 
+    // late frames which were not replaced by newer ones since the last refresh, see SRendererInputState
+    void processHeldSamples(std::unique_lock<std::mutex> &lock) {
+        m_heldSamples = false;
+        std::vector<PRendererInputState> states(m_inputStates);
+        lock.unlock();
+        for (size_t k = 0; k < states.size(); ++k) {
+            if (!states[k])
+                continue;
+            std::unique_lock<std::mutex> stateLock(states[k]->mutex);
+            VnxVideo::PRawSample sample;
+            sample.swap(states[k]->late);
+            if (!sample)
+                continue;
+            try {
+                if (states[k]->transform)
+                    states[k]->transform->Process(sample.get(), states[k]->lateTimestamp);
+                else
+                    InputSetSample((int)k, sample.get(), states[k]->lateTimestamp);
+            }
+            catch (const std::exception& e) {
+                VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "CRenderer::processHeldSamples(): " << e.what();
+            }
+        }
+        lock.lock();
+    }
+
     void processAudio(std::unique_lock<std::mutex> &lock) {
         if (m_audioSamples.empty())
             return;
@@ -523,8 +640,159 @@ private:
         yuv[2] = std::min<int>(255, std::max<int>(0, round(v)));
     }
 
-    typedef std::vector<std::shared_ptr<SwsContext>> TSwsContexts;
+    // A horizontal band of a viewport, with a scaling context of its own so that the bands of a frame
+    // can be scaled concurrently. The context is made for the whole viewport and only produces the rows
+    // of the band, so that bands make exactly the image of a single context, without seams where the filter
+    // would meet band edges. Bands are kept per viewport between frames, along with the geometry their
+    // contexts were made for.
+    struct SSwsBand {
+        std::shared_ptr<SwsContext> sws;
+        int srcW;
+        int srcH;
+        AVPixelFormat srcFormat;
+        int dstW;
+        int dstH;
+        SSwsBand()
+            : srcW(0)
+            , srcH(0)
+            , srcFormat(AV_PIX_FMT_NONE)
+            , dstW(0)
+            , dstH(0)
+        {
+        }
+    };
+    typedef std::vector<std::vector<SSwsBand> > TSwsContexts; // bands of every viewport of the layout
+
+    struct SScaleJob {
+        SSwsBand* band;
+        int bandIndex;
+        int bands;
+        // the whole viewport
+        const uint8_t* src[4];
+        int srcStrides[4];
+        int srcW;
+        int srcH;
+        AVPixelFormat srcFormat;
+        uint8_t* dst[4];
+        int dstStrides[4];
+        int dstW;
+        int dstH;
+    };
+    struct SScaleJobs {
+        std::vector<SScaleJob> jobs;
+        std::atomic<size_t> next;
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t done;
+        SScaleJobs()
+            : next(0)
+            , done(0)
+        {
+        }
+    };
+
+    static const int MaxRenderWorkers = 64;
+    static const int MinBandHeight = 64; // narrower bands are not worth handing to another thread
 
+    static void keepData(void*, uint8_t*) {
+    }
+    // a frame referring to the memory of the job without owning it, for the frame api of swscale
+    static std::shared_ptr<AVFrame> wrapFrame(const uint8_t* const planes[4], const int strides[4], int w, int h, AVPixelFormat format) {
+        std::shared_ptr<AVFrame> frame(avframeAlloc());
+        if (!frame)
+            return frame;
+        frame->format = format;
+        frame->width = w;
+        frame->height = h;
+        for (int k = 0; k < 4; ++k) {
+            frame->data[k] = const_cast<uint8_t*>(planes[k]);
+            frame->linesize[k] = strides[k];
+        }
+        frame->buf[0] = av_buffer_create(frame->data[0], (size_t)strides[0] * h, keepData, nullptr, 0);
+        if (!frame->buf[0])
+            frame.reset();
+        return frame;
+    }
+    static void scaleBand(SScaleJob& job) {
+        VNXVIDEO_TRACE_SCOPE("renderer.scale");
+        SSwsBand& band(*job.band);
+        if (!band.sws || band.srcW != job.srcW || band.srcH != job.srcH || band.srcFormat != job.srcFormat
+            || band.dstW != job.dstW || band.dstH != job.dstH) {
+            band.sws = getCachedSwsContext(job.srcW, job.srcH, job.srcFormat,
+                job.dstW, job.dstH, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR);
+            band.srcW = job.srcW;
+            band.srcH = job.srcH;
+            band.srcFormat = job.srcFormat;
+            band.dstW = job.dstW;
+            band.dstH = job.dstH;
+        }
+        if (!band.sws) {
+            VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "sws_getContext failed";
+            return;
+        }
+        // bands are cut at the rows the context can start an output slice at, the same for every band
+        const int align = std::max(1, (int)sws_receive_slice_alignment(band.sws.get()));
+        if (job.bands == 1 || job.dstH % align != 0) {
+            if (job.bandIndex != 0)
+                return;
+            int res = sws_scale(band.sws.get(), job.src, job.srcStrides, 0, job.srcH, job.dst, job.dstStrides);
+            if (res != job.dstH)
+                VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "sws_scale failed";
+            return;
+        }
+        const int dstY0 = (job.dstH*job.bandIndex / job.bands) / align * align;
+        const int dstY1 = (job.bandIndex + 1 == job.bands) ? job.dstH : (job.dstH*(job.bandIndex + 1) / job.bands) / align * align;
+        if (dstY1 <= dstY0)
+            return;
+        std::shared_ptr<AVFrame> src(wrapFrame(job.src, job.srcStrides, job.srcW, job.srcH, job.srcFormat));
+        std::shared_ptr<AVFrame> dst(wrapFrame(job.dst, job.dstStrides, job.dstW, job.dstH, AV_PIX_FMT_YUV420P));
+        if (!src || !dst) {
+            VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "Failed to set up frames for scaling";
+            return;
+        }
+        int res = sws_frame_start(band.sws.get(), dst.get(), src.get());
+        if (res >= 0)
+            res = sws_send_slice(band.sws.get(), 0, job.srcH);
+        if (res >= 0)
+            res = sws_receive_slice(band.sws.get(), dstY0, dstY1 - dstY0);
+        sws_frame_end(band.sws.get());
+        if (res < 0)
+            VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "sws_receive_slice failed: " << fferr2str(res);
+    }
+    // takes jobs until there are none left; the jobs are only touched while some are left, so that
+    // a worker which comes late does not hold up the frame
+    static void scaleBands(SScaleJobs& jobs) {
+        for (size_t k = jobs.next++; k < jobs.jobs.size(); k = jobs.next++) {
+            try {
+                scaleBand(jobs.jobs[k]);
+            }
+            catch (const std::exception& e) {
+                VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "CRenderer::scaleBands(): " << e.what();
+            }
+            std::unique_lock<std::mutex> lock(jobs.mutex);
+            if (++jobs.done == jobs.jobs.size())
+                jobs.cond.notify_all();
+        }
+    }
+    // the calling thread and up to workers-1 threads of the shared executor scale the bands concurrently
+    static void scaleBandsConcurrently(const std::shared_ptr<SScaleJobs>& jobs, int workers) {
+        const size_t helpers = std::min<size_t>(workers, jobs->jobs.size());
+        for (size_t k = 1; k < helpers; ++k)
+            ExecutorPost([jobs]() { scaleBands(*jobs); });
+        scaleBands(*jobs);
+        std::unique_lock<std::mutex> lock(jobs->mutex);
+        while (jobs->done < jobs->jobs.size())
+            jobs->cond.wait(lock);
+    }
+
+    static bool intersect(const VnxIppiRect& a, const VnxIppiRect& b) {
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+
+    // Viewports are scaled by bands: one per viewport unless workers is more than 1, in which case viewports get
+    // bands in proportion to their areas, so that a single large viewport keeps all the workers busy too.
+    // The bands of all viewports are scaled concurrently, and borders are drawn once they are done. Layouts with
+    // overlapping viewports are rendered one viewport after another, as later viewports are drawn on top.
     static std::pair<VnxVideo::PRawSample, uint64_t> doRender(int width, int height,
         uint8_t *backgroundColorRgb,
         VnxVideo::PRawSample backgroundImage,
@@ -532,8 +800,10 @@ private:
         const VnxVideo::TLayout& layout,
         TSwsContexts& swsContexts,
         IAllocator *allocator,
-        std::vector<std::pair<VnxVideo::PRawSample, uint64_t> > samples) 
+        std::vector<std::pair<VnxVideo::PRawSample, uint64_t> > samples,
+        int workers)
     {
+        VNXVIDEO_TRACE_SCOPE("renderer.render");
         int strides[4];
         uint8_t* planes[4];
 
@@ -541,6 +811,7 @@ private:
 
         VnxVideo::PRawSample res;
         uint64_t ts=0;
+        VnxVideo::SFrameTrace trace; // of the latest input frame composed, to be passed on with the result
         if (backgroundImage.get() != nullptr) {
             EColorspace csp;
             int w;
@@ -576,6 +847,18 @@ private:
             }	
         }
 
+        struct SViewport {
+            size_t index;
+            VnxVideo::PRawSample src;
+            AVPixelFormat avPixFmt;
+            VnxIppiRect srcRoi;
+            VnxIppiRect dstRoi;
+            uint8_t border_yuv[3];
+            size_t firstJob;
+            size_t endJob;
+        };
+        std::vector<SViewport> viewports;
+        int64_t totalArea = 0;
         for (size_t k = 0; k < layout.size(); ++k) {
             if (layout[k].input != -1 && (layout[k].input < 0 || layout[k].input >= samples.size())) {
                 VNXVIDEO_LOG(VNXLOG_DEBUG, "renderer") << "CRenderer::doRender(): input index out of range: " << layout[k].input;
@@ -595,6 +878,9 @@ private:
 
             if(layout[k].input != -1)
                 ts = std::max(ts, samples[layout[k].input].second);
+            VnxVideo::SFrameTrace srcTrace;
+            if (src->GetTrace(srcTrace) && srcTrace.ingestNs > trace.ingestNs)
+                trace = srcTrace;
 
             EColorspace csp;
             int w;
@@ -615,10 +901,6 @@ private:
                     avPixFmt = AV_PIX_FMT_NV12;
             }
 
-            int src_strides[4];
-            uint8_t* src_planes[4];
-            src->GetData(src_strides, src_planes);
-
             const int RoundSizeX = 16; // swscale works incorrectly if sizes not rounded to 16
             const int RoundSizeY = 4; // y coordinates should be at lease event as well
 
@@ -663,47 +945,91 @@ private:
             if (dstRoi.width < RoundSizeX || dstRoi.height < RoundSizeY)
                 continue;
 
-            uint8_t border_yuv[3];
+            SViewport v;
+            v.index = k;
+            v.src = src;
+            v.avPixFmt = avPixFmt;
+            v.srcRoi = srcRoi;
+            v.dstRoi = dstRoi;
             if (layout[k].border) {
-                rgb2yuv(layout[k].border_rgb, border_yuv);
+                rgb2yuv(layout[k].border_rgb, v.border_yuv);
             }
+            viewports.push_back(v);
+            totalArea += (int64_t)dstRoi.width*dstRoi.height;
+        }
+
+        bool overlapping = false;
+        for (size_t k = 0; k < viewports.size() && !overlapping; ++k)
+            for (size_t j = k + 1; j < viewports.size() && !overlapping; ++j)
+                overlapping = intersect(viewports[k].dstRoi, viewports[j].dstRoi);
+        if (overlapping)
+            workers = 1;
 
-            std::shared_ptr<SwsContext> sws;
-            if (swsContexts[k].get() == nullptr) {
-                sws.reset(sws_getContext(srcRoi.width, srcRoi.height, avPixFmt,
-                    dstRoi.width, dstRoi.height, AV_PIX_FMT_YUV420P, 
-                    SWS_FAST_BILINEAR, nullptr, nullptr, nullptr), sws_freeContext);
-                swsContexts[k] = sws;
+        auto jobs = std::make_shared<SScaleJobs>();
+        for (auto& v : viewports) {
+            const VnxIppiRect& srcRoi(v.srcRoi);
+            const VnxIppiRect& dstRoi(v.dstRoi);
+            int bands = 1;
+            if (workers > 1) {
+                const int64_t area = (int64_t)dstRoi.width*dstRoi.height;
+                bands = (int)std::min<int64_t>(workers, (workers*area + totalArea / 2) / totalArea);
+                bands = std::max(1, std::min(bands, dstRoi.height / MinBandHeight));
             }
-            else
-                sws=swsContexts[k];
-            const uint8_t* src_planes_roi[3] = {
-                src_planes[0] + srcRoi.y*src_strides[0] + srcRoi.x,
-                src_planes[1] + srcRoi.y*src_strides[1] / 2 + srcRoi.x / 2,
-                src_planes[2] + srcRoi.y*src_strides[2] / 2 + srcRoi.x / 2
-            };
-            uint8_t* planes_roi[3] = {
-                planes[0] + dstRoi.y*strides[0] + dstRoi.x,
-                planes[1] + dstRoi.y*strides[1] / 2 + dstRoi.x / 2,
-                planes[2] + dstRoi.y*strides[2] / 2 + dstRoi.x / 2
-            };
-            int res=sws_scale(sws.get(), src_planes_roi, src_strides, 0, srcRoi.height, planes_roi, strides);
-            if (res != dstRoi.height)
-                VNXVIDEO_LOG(VNXLOG_WARNING, "renderer") << "sws_scale failed";
+            std::vector<SSwsBand>& swsBands(swsContexts[v.index]);
+            if (swsBands.size() != (size_t)bands)
+                swsBands.resize(bands);
 
-            if (layout[k].border) {
+            int src_strides[4];
+            uint8_t* src_planes[4];
+            v.src->GetData(src_strides, src_planes);
+
+            v.firstJob = jobs->jobs.size();
+            for (int b = 0; b < bands; ++b) {
+                SScaleJob job;
+                job.band = &swsBands[b];
+                job.bandIndex = b;
+                job.bands = bands;
+                job.src[0] = src_planes[0] + srcRoi.y*src_strides[0] + srcRoi.x;
+                job.src[1] = src_planes[1] + srcRoi.y*src_strides[1] / 2 + srcRoi.x / 2;
+                job.src[2] = src_planes[2] + srcRoi.y*src_strides[2] / 2 + srcRoi.x / 2;
+                job.src[3] = nullptr;
+                std::copy(src_strides, src_strides + 4, job.srcStrides);
+                job.srcW = srcRoi.width;
+                job.srcH = srcRoi.height;
+                job.srcFormat = v.avPixFmt;
+                job.dst[0] = planes[0] + dstRoi.y*strides[0] + dstRoi.x;
+                job.dst[1] = planes[1] + dstRoi.y*strides[1] / 2 + dstRoi.x / 2;
+                job.dst[2] = planes[2] + dstRoi.y*strides[2] / 2 + dstRoi.x / 2;
+                job.dst[3] = nullptr;
+                std::copy(strides, strides + 4, job.dstStrides);
+                job.dstW = dstRoi.width;
+                job.dstH = dstRoi.height;
+                jobs->jobs.push_back(job);
+            }
+            v.endJob = jobs->jobs.size();
+        }
+
+        if (workers > 1)
+            scaleBandsConcurrently(jobs, workers);
+        for (const auto& v : viewports) {
+            if (workers <= 1) {
+                for (size_t j = v.firstJob; j < v.endJob; ++j)
+                    scaleBand(jobs->jobs[j]);
+            }
+            if (layout[v.index].border) {
                 for (int j = 0; j < 3; ++j) {
                     VnxIppiRect planeRoiDst = {
-                        dstRoi.x / planeSizeDiv[j],
-                        dstRoi.y / planeSizeDiv[j],
-                        dstRoi.width / planeSizeDiv[j],
-                        dstRoi.height / planeSizeDiv[j]
+                        v.dstRoi.x / planeSizeDiv[j],
+                        v.dstRoi.y / planeSizeDiv[j],
+                        v.dstRoi.width / planeSizeDiv[j],
+                        v.dstRoi.height / planeSizeDiv[j]
                     };
                     DrawRect_8u_C1(planes[j], { width / planeSizeDiv[j], height / planeSizeDiv[j] }, strides[j],
-                        planeRoiDst, border_yuv[j]);
+                        planeRoiDst, v.border_yuv[j]);
                 }
             }
         }
+        res->SetTrace(trace);
         return{ res,ts };
     }
 private:
@@ -727,6 +1053,8 @@ private:
     std::shared_ptr<TSwsContexts> m_swsContexts;
     // that's one VIDEO sample per input
     std::vector<std::pair<VnxVideo::PRawSample, uint64_t> > m_samples;
+    std::vector<PRendererInputState> m_inputStates;
+    bool m_heldSamples; // a late frame is held by some input
 
     // cached formats of audio streams from attached media sources;
     // we need that when layout changes but we don't get a formatchange call from 
@@ -748,6 +1076,11 @@ private:
     bool m_run;
     std::thread m_thread;
 
+    int m_maxAgeMs;
+    int m_workers; // concurrent scaling of viewports, see doRender
+    CLatencyHistogram* const m_inputLatency;
+    CLatencyHistogram* const m_latency;
+
     std::shared_ptr<CRendererImplMixinProxy> m_rendererImplMixinProxy;
 };
 
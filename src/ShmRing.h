@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+// Single-producer single-consumer rings living in a shared memory block, used by the
+// local transport to pass sample descriptors from a provider to one client, and to pass
+// released descriptors back. Both processes only touch the block through the atomics
+// below, which are lock free and therefore address free, so the block may be mapped at
+// different addresses. Indices are free running 32-bit counters; capacity is a power of two.
+//
+// Layout: SShmRingHeader, then capacity descriptors of type TDesc, then capacity uint64_t release slots.
+// A provider never has more than capacity descriptors outstanding (pushed and not released yet),
+// so the release ring can never overflow.
+
+struct SShmRingIndex {
+    std::atomic<uint32_t> value;
+    std::atomic<uint32_t> waiting; // set by a consumer before it blocks on value
+    uint8_t pad[56];
+};
+
+struct SShmRingHeader {
+    static const uint32_t Magic = 0x676e6972; // "ring"
+    uint32_t magic;
+    uint32_t capacity;
+    std::atomic<uint32_t> closed;
+    uint8_t pad[52];
+    SShmRingIndex descHead; // written by the provider
+    SShmRingIndex descTail; // written by the client
+    SShmRingIndex relHead;  // written by the client
+    SShmRingIndex relTail;  // written by the provider
+};
+static_assert(sizeof(SShmRingHeader) == 5 * 64, "SShmRingHeader layout must not depend on the compiler");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "shared atomics must have no extra state");
+
+inline void shmRingWake(std::atomic<uint32_t>* addr) {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+}
+// returns when *addr differs from value, on a spurious wakeup, or after timeoutMs
+inline void shmRingWait(std::atomic<uint32_t>* addr, uint32_t value, int timeoutMs) {
+#ifdef __linux__
+    timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, value, &ts, nullptr, 0);
+#endif
+}
+
+template<typename TDesc>
+class CShmRing {
+public:
+    static size_t Size(uint32_t capacity) {
+        return sizeof(SShmRingHeader) + capacity * (sizeof(TDesc) + sizeof(uint64_t));
+    }
+    // Attach to the block which is initialized (by the provider) or not (by the client)
+    CShmRing(void* block, uint32_t capacity)
+        : m_header(reinterpret_cast<SShmRingHeader*>(block))
+        , m_desc(reinterpret_cast<TDesc*>(m_header + 1))
+        , m_rel(reinterpret_cast<uint64_t*>(m_desc + capacity))
+        , m_mask(capacity - 1)
+    {
+    }
+    void Init(uint32_t capacity) {
+        memset(static_cast<void*>(m_header), 0, Size(capacity));
+        m_header->magic = SShmRingHeader::Magic;
+        m_header->capacity = capacity;
+    }
+    bool Valid(uint32_t capacity) const {
+        return m_header->magic == SShmRingHeader::Magic && m_header->capacity == capacity && (capacity & (capacity - 1)) == 0;
+    }
+
+    // provider side
+    bool PushDesc(const TDesc& desc) {
+        const uint32_t head = m_header->descHead.value.load(std::memory_order_relaxed);
+        if (head - m_header->descTail.value.load(std::memory_order_acquire) > m_mask)
+            return false;
+        m_desc[head & m_mask] = desc;
+        m_header->descHead.value.store(head + 1, std::memory_order_seq_cst);
+        // seq_cst store then load pairs with the consumer's seq_cst store to waiting then load of head
+        if (m_header->descHead.waiting.load(std::memory_order_seq_cst))
+            shmRingWake(&m_header->descHead.value);
+        return true;
+    }
+    bool PopRelease(uint64_t& pointer) {
+        const uint32_t tail = m_header->relTail.value.load(std::memory_order_relaxed);
+        if (tail == m_header->relHead.value.load(std::memory_order_acquire))
+            return false;
+        pointer = m_rel[tail & m_mask];
+        m_header->relTail.value.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    void Close() {
+        m_header->closed = 1;
+        m_header->descHead.value.fetch_add(0x80000000u); // make a sleeping consumer see a changed value
+        shmRingWake(&m_header->descHead.value);
+    }
+
+    // client side
+    bool Closed() const {
+        return m_header->closed.load() != 0;
+    }
+    bool PopDesc(TDesc& desc) {
+        const uint32_t tail = m_header->descTail.value.load(std::memory_order_relaxed);
+        if (tail == m_header->descHead.value.load(std::memory_order_acquire) || Closed())
+            return false;
+        desc = m_desc[tail & m_mask];
+        m_header->descTail.value.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    // block until there is a descriptor to pop, the ring is closed, or the timeout expires
+    void WaitDesc(int timeoutMs) {
+        const uint32_t tail = m_header->descTail.value.load(std::memory_order_relaxed);
+        m_header->descHead.waiting.store(1, std::memory_order_seq_cst);
+        const uint32_t head = m_header->descHead.value.load(std::memory_order_seq_cst);
+        if (head == tail && !Closed())
+            shmRingWait(&m_header->descHead.value, head, timeoutMs);
+        m_header->descHead.waiting.store(0, std::memory_order_relaxed);
+    }
+    // only one thread at a time may push releases
+    void PushRelease(uint64_t pointer) {
+        const uint32_t head = m_header->relHead.value.load(std::memory_order_relaxed);
+        m_rel[head & m_mask] = pointer;
+        m_header->relHead.value.store(head + 1, std::memory_order_release);
+    }
+private:
+    SShmRingHeader* const m_header;
+    TDesc* const m_desc;
+    uint64_t* const m_rel;
+    const uint32_t m_mask;
+};
@@ -38,6 +38,7 @@ using json = nlohmann::json;
 #include <ipp/ippcv.h>
 
 #include "../RawSample.h"
+#include "../FrameTrace.h"
 
 #ifdef WITH_IDS_UEYE
 #include "uEyeCaptureInterface.h"
@@ -77,6 +78,7 @@ private:
     int m_nplanes;
     int m_strides[4];
     ptrdiff_t m_offsets[4];
+    VnxVideo::SFrameTrace m_trace;
 public:
     CDxRawSample(EColorspace csp, int width, int height, EColorspace cspOrig, int bppOrig, IMediaSample* sample, PShmAllocator allocator)
         :m_csp(csp)
@@ -85,6 +87,7 @@ public:
         ,m_sample(sample)
         ,m_size(0)
         ,m_nplanes(0)
+        ,m_trace(NewFrameTrace())
     {
         if (cspOrig != csp || allocator.get()!=nullptr) {
             if (csp != EMF_I420)
@@ -140,6 +143,13 @@ public:
     VnxVideo::IRawSample* Dup() {
         return new CDxRawSample(*this); // copy constructor will do as CComPtr copy ctor provides behaviour we need
     }
+    bool GetTrace(VnxVideo::SFrameTrace& trace) {
+        trace = m_trace;
+        return m_trace.ingestNs != 0;
+    }
+    void SetTrace(const VnxVideo::SFrameTrace& trace) {
+        m_trace = trace;
+    }
 private:
     static void copyRawToI420(uint8_t* dest, EColorspace emf,
         int width, int height, int stride, const uint8_t* source)
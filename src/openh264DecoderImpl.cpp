@@ -5,6 +5,7 @@
 
 #include "openh264Common.h"
 #include "RawSample.h"
+#include "FrameTrace.h"
 
 class COpenH264Decoder : public VnxVideo::IMediaDecoder
 {
@@ -14,8 +15,12 @@ class COpenH264Decoder : public VnxVideo::IMediaDecoder
     int m_width, m_height;
 
     std::shared_ptr<ISVCDecoder> m_decoder;
+    CFrameTraceCarrier m_traces; // from coded to decoded frames, by timestamp
+    CLatencyHistogram* const m_latency;
 public:
-    COpenH264Decoder() {
+    COpenH264Decoder()
+        : m_latency(GetLatencyHistogram("decoder"))
+    {
         bool allowCorruptOutput = false;
         const char* const allowCorruptOutputStr = getenv("VNX_DECODE_OUTPUT_CORRUPT");
         if (allowCorruptOutputStr != nullptr && strncmp(allowCorruptOutputStr, "0", 1) != 0)
@@ -55,6 +60,7 @@ public:
         uint8_t* data;
         int dataSize;
         nalu->GetData(data, dataSize);
+        m_traces.Push(nalu, timestamp);
 
         SBufferInfo bufferInfo;
         memset(&bufferInfo, 0, sizeof bufferInfo);
@@ -100,7 +106,10 @@ private:
                 bufferInfo.UsrData.sSystemBuffer.iStride[1],bufferInfo.UsrData.sSystemBuffer.iStride[1],
                 0 };
             CRawSample sample(EMF_I420, width, height, strides, dst, m_decoder); // m_decoder actually holds the memory buffer
-            m_onFrame(&sample, bufferInfo.uiOutYuvTimeStamp);
+            // consumers which need the frame in another format convert it once and share the result
+            std::unique_ptr<VnxVideo::IRawSample> lazy(VnxVideo::ConvertOnDemand(&sample));
+            m_traces.Pass(lazy.get(), bufferInfo.uiOutYuvTimeStamp, m_latency);
+            m_onFrame(lazy.get(), bufferInfo.uiOutYuvTimeStamp);
             break;
         }
         default: VNXVIDEO_LOG(VNXLOG_WARNING, "openh264decoder") << "Unsupported format of decoded frame: " << bufferInfo.UsrData.sSystemBuffer.iFormat;
@@ -6,10 +6,7 @@
 #include "openh264Common.h"
 #include "RawSample.h"
 #include "FFmpegUtils.h"
-
-extern "C" {
-#include <libswscale/swscale.h>
-}
+#include "FrameTrace.h"
 
 
 class COpenH264Encoder : public VnxVideo::IMediaEncoder
@@ -21,18 +18,21 @@ private:
     const int m_fps;
     VnxVideo::TOnBufferCallback m_onBuffer;
 
-    std::shared_ptr<SwsContext> m_swsc;
     std::shared_ptr<ISVCEncoder> m_encoder;
 
     EColorspace m_csp;
     int m_width;
     int m_height;
+
+    CFrameTraceCarrier m_traces; // from raw to encoded frames, by timestamp
+    CLatencyHistogram* const m_latency;
 public:
     COpenH264Encoder(const char* profile, const char* preset, int fps, const VnxVideo::TEncoderQuality quality)
         : m_profile(profile)
         , m_preset(preset)
         , m_fps(fps)
         , m_quality(quality)
+        , m_latency(GetLatencyHistogram("encoder"))
     {
     }
     virtual void Subscribe(VnxVideo::TOnBufferCallback onBuffer) {
@@ -46,19 +46,15 @@ public:
         m_height = height;
         init();
 
-        if (csp != EMF_I420) {
-            m_swsc.reset(sws_getContext(width, height, toAVPixelFormat(csp),
-                width, height, AV_PIX_FMT_YUV420P, SWS_BILINEAR,
-                nullptr, nullptr, nullptr), sws_freeContext);
-        }
-        else
-            m_swsc.reset();
+        if (csp != EMF_I420)
+            PrewarmFramePool(EMF_I420, width, height);
 
         EVideoFormatType videoFormat = videoFormatI420;
         m_encoder->SetOption(ENCODER_OPTION_DATAFORMAT, &videoFormat);
     }
     void OutputNAL(uint8_t *data, int size, uint64_t ts) {
         CNoOwnershipNalBuffer b(data, size);
+        m_traces.Pass(&b, ts, m_latency);
         m_onBuffer(&b, ts);
     }
     virtual void Process(VnxVideo::IRawSample* sample, uint64_t timestamp) {
@@ -68,6 +64,7 @@ public:
         if (!vnxvideo_emf_is_video(emf)) {
             return;
         }
+        m_traces.Push(sample, timestamp);
 
         if (!m_encoder.get())
             return;
@@ -82,18 +79,17 @@ public:
         uint8_t** planes = planes_src;
         int* strides = strides_src;
         
-        if (m_swsc.get()) {
-            sampleI420.reset(new CRawSample(EMF_I420, m_width, m_height));
-            sampleI420->GetData(strides_dst, planes_dst);
-            int res = sws_scale(m_swsc.get(), planes, strides, 0, m_height, planes_dst, strides_dst);
-            if (res != m_height) {
-                VNXVIDEO_LOG(VNXLOG_WARNING, "openh264") << "COpenH264::Encoder: sws_scale failed";
-                return;
+        if (emf != EMF_I420) {
+            try {
+                sampleI420 = VnxVideo::ConvertRawSample(sample, EMF_I420);
             }
-            else {
-                planes = planes_dst;
-                strides = strides_dst;
+            catch (const std::exception& e) {
+                VNXVIDEO_LOG(VNXLOG_WARNING, "openh264") << "COpenH264::Encoder: format conversion failed: " << e.what();
+                return;
             }
+            sampleI420->GetData(strides_dst, planes_dst);
+            planes = planes_dst;
+            strides = strides_dst;
         }
 
         SSourcePicture pic;
@@ -35,6 +35,7 @@ using json = nlohmann::json;
 #include "vnxipp.h"
 
 #include "RawSample.h"
+#include "FrameTrace.h"
 
 #if defined(__APPLE__)
 namespace VnxVideo
@@ -314,6 +315,7 @@ private:
                 continue;
 
             uint64_t timestamp=v4l2_timestamp_to_epoch_ms(buf.timestamp);
+            const VnxVideo::SFrameTrace trace(NewFrameTrace());
 
             if(callFormat){
                 onFormat(EMF_I420, m_width, m_height); // not m_csp, because we convert to I420 upon receiving
@@ -339,6 +341,7 @@ private:
                     int err=errno;
                     VNXVIDEO_LOG(VNXLOG_WARNING, "v4lcapture") << "Error on ioctl VIDIOC_QBUF: " << strerror(err);
                 }
+                sample.SetTrace(trace);
                 onFrame(&sample, timestamp);
             }
             else{
@@ -350,6 +353,7 @@ private:
                     }
                 };
                 CRawSample sample(m_csp, m_width, m_height, m_strides, planes, std::shared_ptr<void>(planes, dtor));
+                sample.SetTrace(trace);
                 onFrame(&sample, timestamp);
             }
         }        
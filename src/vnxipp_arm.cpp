@@ -5,6 +5,7 @@
 #include <memory>
 #include <algorithm>
 #include "vnxipp.h"
+#include "FFmpegUtils.h"
 #include <arm_neon.h>
 
 extern "C"{
@@ -104,32 +105,32 @@ VnxippApi vnxippiCopyWrapBorder_32s_C1R(const int32_t* pSrc, int srcStep, VnxIpp
 
 VnxippApi vnxippiBGRToYCbCr420_8u_C3P3R(const uint8_t*  pSrc, int srcStep, uint8_t* pDst[3], int dstStep[3], VnxIppiSize roiSize)
 {
-    std::shared_ptr<SwsContext> ctx(sws_getContext(roiSize.width, roiSize.height, AV_PIX_FMT_BGR24,
-        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr), sws_freeContext);
+    std::shared_ptr<SwsContext> ctx(getCachedSwsContext(roiSize.width, roiSize.height, AV_PIX_FMT_BGR24,
+        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR));
     sws_scale(ctx.get(), &pSrc, &srcStep, 0, roiSize.height, pDst, dstStep);
     return vnxippStsNoErr;
 }
 
 VnxippApi vnxippiYCbCr422ToYCbCr420_8u_C2P3R(const uint8_t* pSrc, int srcStep, uint8_t* pDst[3], int dstStep[3], VnxIppiSize roiSize)
 {
-    std::shared_ptr<SwsContext> ctx(sws_getContext(roiSize.width, roiSize.height, AV_PIX_FMT_YUYV422,
-        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr), sws_freeContext);
+    std::shared_ptr<SwsContext> ctx(getCachedSwsContext(roiSize.width, roiSize.height, AV_PIX_FMT_YUYV422,
+        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR));
     sws_scale(ctx.get(), &pSrc, &srcStep, 0, roiSize.height, pDst, dstStep);
     return vnxippStsNoErr;
 }
 
 VnxippApi vnxippiCbYCr422ToYCrCb420_8u_C2P3R(const uint8_t* pSrc, int srcStep, uint8_t* pDst[3], int dstStep[3], VnxIppiSize roiSize)
 {
-    std::shared_ptr<SwsContext> ctx(sws_getContext(roiSize.width, roiSize.height, AV_PIX_FMT_UYVY422,
-        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr), sws_freeContext);
+    std::shared_ptr<SwsContext> ctx(getCachedSwsContext(roiSize.width, roiSize.height, AV_PIX_FMT_UYVY422,
+        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR));
     sws_scale(ctx.get(), &pSrc, &srcStep, 0, roiSize.height, pDst, dstStep);
     return vnxippStsNoErr;
 }
 
 VnxippApi vnxippiBGRToYCbCr420_8u_AC4P3R(const uint8_t*  pSrc, int srcStep, uint8_t* pDst[3], int dstStep[3], VnxIppiSize roiSize)
 {
-    std::shared_ptr<SwsContext> ctx(sws_getContext(roiSize.width, roiSize.height, AV_PIX_FMT_BGRA,
-        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr), sws_freeContext);
+    std::shared_ptr<SwsContext> ctx(getCachedSwsContext(roiSize.width, roiSize.height, AV_PIX_FMT_BGRA,
+        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR));
     sws_scale(ctx.get(), &pSrc, &srcStep, 0, roiSize.height, pDst, dstStep);
     return vnxippStsNoErr;
 }
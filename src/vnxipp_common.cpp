@@ -4,6 +4,7 @@
 #include <memory>
 #include <algorithm>
 #include "vnxipp.h"
+#include "FFmpegUtils.h"
 
 extern "C"{
 #include <libswscale/swscale.h>
@@ -11,8 +12,8 @@ extern "C"{
 
 int vnxippiBGR565ToYCbCr420_16u8u_C3P3R(const uint16_t* pSrc, int srcStep, uint8_t* pDst[3], int dstStep[3], VnxIppiSize roiSize)
 {
-    std::shared_ptr<SwsContext> ctx(sws_getContext(roiSize.width, roiSize.height, AV_PIX_FMT_BGR565LE,
-        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr), sws_freeContext);
+    std::shared_ptr<SwsContext> ctx(getCachedSwsContext(roiSize.width, roiSize.height, AV_PIX_FMT_BGR565LE,
+        roiSize.width, roiSize.height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR));
     sws_scale(ctx.get(), (const uint8_t**)&pSrc, &srcStep, 0, roiSize.height, pDst, dstStep);
     return 0;
 }
@@ -22,8 +23,8 @@ int vnxippiResize_8u_C1R(const uint8_t* pSrc, VnxIppiSize srcSize, int srcStep,
     double xFactor, double yFactor, int interpolation)
 {
     int swsInterpolation = (interpolation == VNXIPPI_INTER_NN) ? SWS_POINT : SWS_FAST_BILINEAR;
-    std::shared_ptr<SwsContext> ctx(sws_getContext(srcRoi.width, srcRoi.height, AV_PIX_FMT_GRAY8,
-        dstRoiSize.width, dstRoiSize.height, AV_PIX_FMT_GRAY8, swsInterpolation, nullptr, nullptr, nullptr), sws_freeContext);
+    std::shared_ptr<SwsContext> ctx(getCachedSwsContext(srcRoi.width, srcRoi.height, AV_PIX_FMT_GRAY8,
+        dstRoiSize.width, dstRoiSize.height, AV_PIX_FMT_GRAY8, swsInterpolation));
     const uint8_t* srcs = pSrc + srcRoi.y*srcStep + srcRoi.x;
     sws_scale(ctx.get(), &srcs, &srcStep, 0, srcRoi.height, &pDst, &dstStep);
     return 0;
@@ -35,8 +36,8 @@ int vnxippiResize_8u_P2P3R(const uint8_t* const* pSrc, VnxIppiSize srcSize, cons
     double xFactor, double yFactor, int interpolation)
 {
     int swsInterpolation = (interpolation == VNXIPPI_INTER_NN) ? SWS_POINT : SWS_FAST_BILINEAR;
-    std::shared_ptr<SwsContext> ctx(sws_getContext(srcRoi.width, srcRoi.height, AV_PIX_FMT_NV12,
-        dstRoi.width, dstRoi.height, AV_PIX_FMT_YUV420P, swsInterpolation, nullptr, nullptr, nullptr), sws_freeContext);
+    std::shared_ptr<SwsContext> ctx(getCachedSwsContext(srcRoi.width, srcRoi.height, AV_PIX_FMT_NV12,
+        dstRoi.width, dstRoi.height, AV_PIX_FMT_YUV420P, swsInterpolation));
 
     const uint8_t* src_planes_roi[2] = {
         pSrc[0] + srcRoi.y*srcStep[0] + srcRoi.x,
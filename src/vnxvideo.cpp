@@ -1,5 +1,8 @@
 #include <sstream>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
 #include <sstream>
 #include <codecvt>
 #include <locale>
@@ -20,6 +23,9 @@ using json = nlohmann::json;
 #include "RawSample.h"
 #include "BufferImpl.h"
 #include "VmsChannelSelector.h"
+#include "Executor.h"
+#include "FrameTrace.h"
+#include "EventTrace.h"
 
 namespace NVnxVideoLogImpl {
     vnxvideo_log_t g_logHandler = nullptr;
@@ -46,6 +52,9 @@ int vnxvideo_init(vnxvideo_log_t log_handler, void* usrptr, ELogLevel max_level)
     NVnxVideoLogImpl::g_logUsrptr = usrptr;
     NVnxVideoLogImpl::g_maxLogLevel = max_level;
 
+    InitFrameMemoryModeFromEnvironment();
+    InitEventTraceFromEnvironment();
+
 #ifndef __aarch64__
     VnxIppStatus ipps=vnxippInit();
     if (ipps != vnxippStsNoErr && ipps != vnxippStsNonIntelCpu) {
@@ -63,6 +72,176 @@ int vnxvideo_init(vnxvideo_log_t log_handler, void* usrptr, ELogLevel max_level)
     return vnxvideo_err_ok;
 }
 
+int vnxvideo_get_memory_stats(char* json_buffer, int buffer_size) {
+    try {
+        // counters seen by the previous call, to report rates rather than totals
+        static std::mutex mutex;
+        static std::map<std::string, std::pair<uint64_t, uint64_t> > prevCounters;
+        static std::chrono::steady_clock::time_point prevTime;
+
+        std::vector<SAllocatorStats> allocators(GetAllocatorStats());
+        json jallocators = json::array();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            const auto now = std::chrono::steady_clock::now();
+            const double elapsed = std::chrono::duration<double>(now - prevTime).count();
+            const bool first = prevTime == std::chrono::steady_clock::time_point();
+            std::map<std::string, std::pair<uint64_t, uint64_t> > counters;
+            for (auto& a : allocators) {
+                auto prev = prevCounters.find(a.name);
+                double allocRate = 0, freeRate = 0;
+                if (!first && elapsed > 0 && prev != prevCounters.end()) {
+                    allocRate = (a.allocs - prev->second.first) / elapsed;
+                    freeRate = (a.frees - prev->second.second) / elapsed;
+                }
+                counters[a.name] = std::make_pair(a.allocs, a.frees);
+                jallocators.push_back({
+                    { "name", a.name },
+                    { "live_bytes", a.liveBytes },
+                    { "peak_bytes", a.peakBytes },
+                    { "allocs", a.allocs },
+                    { "frees", a.frees },
+                    { "failures", a.failures },
+                    { "alloc_rate", allocRate },
+                    { "free_rate", freeRate }
+                });
+            }
+            prevCounters.swap(counters);
+            prevTime = now;
+        }
+
+        SFramePoolStats pool(GetFramePoolStats());
+        json jclients = json::array();
+        for (auto& c : GetLocalTransportStats()) {
+            jclients.push_back({
+                { "address", c.address },
+                { "client", c.client },
+                { "pinned_frames", c.pinnedFrames },
+                { "pinned_bytes", c.pinnedBytes },
+                { "delivered_frames", c.deliveredFrames },
+                { "skipped_frames", c.skippedFrames },
+                { "credits", c.credits },
+                { "rejected_frames", c.rejectedFrames },
+                { "reclaimed_frames", c.reclaimedFrames },
+                { "lagging", c.lagging }
+            });
+        }
+        json res = {
+            { "allocators", jallocators },
+            { "frame_pool", {
+                { "hits", pool.hits },
+                { "misses", pool.misses },
+                { "idle_bytes", pool.idleBytes },
+                { "capacity_bytes", pool.capacityBytes } } },
+            { "preferred_allocator_failures", GetPreferredAllocatorFailures() },
+            { "local_transport", jclients }
+        };
+
+        std::stringstream wss;
+        wss << res << std::ends;
+        if (0 == json_buffer || 0 == buffer_size) {
+            return (int)wss.str().size();
+        }
+        if (wss.str().size() >= (size_t)buffer_size) {
+            return vnxvideo_err_invalid_parameter;
+        }
+        memcpy(json_buffer, wss.str().c_str(), wss.str().size());
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_get_memory_stats: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+
+int vnxvideo_configure_executor(int workers, const char* cpu_affinity) {
+    if (!ConfigureExecutor(workers, cpu_affinity ? cpu_affinity : "")) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "vnxvideo_configure_executor: invalid parameters, or async processing has already started";
+        return vnxvideo_err_invalid_parameter;
+    }
+    return vnxvideo_err_ok;
+}
+
+int vnxvideo_get_latency_stats(char* json_buffer, int buffer_size) {
+    try {
+        json res(GetLatencyStats());
+        std::stringstream wss;
+        wss << res << std::ends;
+        if (0 == json_buffer || 0 == buffer_size) {
+            return (int)wss.str().size();
+        }
+        if (wss.str().size() >= (size_t)buffer_size) {
+            return vnxvideo_err_invalid_parameter;
+        }
+        memcpy(json_buffer, wss.str().c_str(), wss.str().size());
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_get_latency_stats: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+int vnxvideo_reset_latency_stats() {
+    ResetLatencyStats();
+    return vnxvideo_err_ok;
+}
+
+int vnxvideo_event_trace_enable(int enable) {
+    EnableEventTrace(enable != 0);
+    return vnxvideo_err_ok;
+}
+// the trace keeps growing between the size query and the call which fills the buffer,
+// so the query takes a snapshot which the next call copies out
+struct SEventTraceSnapshot {
+    std::mutex mutex;
+    std::string json;
+};
+static SEventTraceSnapshot& eventTraceSnapshot() {
+    static SEventTraceSnapshot* snapshot = new SEventTraceSnapshot;
+    return *snapshot;
+}
+int vnxvideo_event_trace_dump(char* json_buffer, int buffer_size) {
+    try {
+        SEventTraceSnapshot& snapshot(eventTraceSnapshot());
+        std::unique_lock<std::mutex> lock(snapshot.mutex);
+        if (0 == json_buffer || 0 == buffer_size) {
+            std::stringstream wss;
+            wss << DumpEventTrace() << std::ends;
+            snapshot.json = wss.str();
+            return (int)snapshot.json.size();
+        }
+        if (snapshot.json.empty()) {
+            std::stringstream wss;
+            wss << DumpEventTrace() << std::ends;
+            snapshot.json = wss.str();
+        }
+        if (snapshot.json.size() > (size_t)buffer_size) {
+            return vnxvideo_err_invalid_parameter;
+        }
+        memcpy(json_buffer, snapshot.json.c_str(), snapshot.json.size());
+        snapshot.json.clear();
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_event_trace_dump: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+int vnxvideo_event_trace_dump_to_file(const char* path) {
+    if (nullptr == path || !DumpEventTraceToFile(path))
+        return vnxvideo_err_invalid_parameter;
+    return vnxvideo_err_ok;
+}
+int vnxvideo_event_trace_dump_on_signal(int signum, const char* path) {
+#ifdef _WIN32
+    return vnxvideo_err_not_implemented;
+#else
+    if (nullptr == path || !DumpEventTraceOnSignal(signum, path))
+        return vnxvideo_err_invalid_parameter;
+    return vnxvideo_err_ok;
+#endif
+}
+
 int vnxvideo_manager_dshow_create(vnxvideo_manager_t* mgr) {
 #if _WIN32
     VnxVideo::IVideoDeviceManager* dm = VnxVideo::CreateVideoDeviceManager_DirectShow();
@@ -306,6 +485,37 @@ int vnxvideo_rawproc_process(vnxvideo_rawproc_t proc, vnxvideo_raw_sample_t samp
         return vnxvideo_err_invalid_parameter;
     }
 }
+int vnxvideo_rawproc_get_queue_stats(vnxvideo_rawproc_t proc, char* json_buffer, int buffer_size) {
+    try {
+        VnxVideo::IAsyncQueue* queue = dynamic_cast<VnxVideo::IAsyncQueue*>(reinterpret_cast<VnxVideo::IRawProc*>(proc.ptr));
+        if (nullptr == queue)
+            return vnxvideo_err_invalid_parameter;
+        VnxVideo::SAsyncQueueStats stats(queue->GetQueueStats());
+        json res = {
+            { "depth", stats.depth },
+            { "queued", stats.queued },
+            { "max_queued", stats.maxQueued },
+            { "processed", stats.processed },
+            { "dropped", stats.dropped },
+            { "blocked", stats.blocked },
+            { "expired", stats.expired }
+        };
+        std::stringstream wss;
+        wss << res << std::ends;
+        if (0 == json_buffer || 0 == buffer_size) {
+            return (int)wss.str().size();
+        }
+        if (wss.str().size() >= (size_t)buffer_size) {
+            return vnxvideo_err_invalid_parameter;
+        }
+        memcpy(json_buffer, wss.str().c_str(), wss.str().size());
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_rawproc_get_queue_stats: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
 int vnxvideo_rawproc_flush(vnxvideo_rawproc_t proc) {
     auto p = reinterpret_cast<VnxVideo::IRawProc*>(proc.ptr);
     try {
@@ -358,58 +568,64 @@ int vnxvideo_rawproc_create_from_callbacks(
 }
 
 
-int vnxvideo_h264_encoder_create(const char* json_config, vnxvideo_encoder_t* encoder) {
-    try {
-        json j;
-        std::string s(json_config);
-        std::stringstream ss(s);
-        ss >> j;
+namespace VnxVideo {
+    IMediaEncoder* CreateVideoEncoder(const json& j) {
         std::string profile(jget<std::string>(j, "profile"));
         std::string preset(jget<std::string>(j,"preset"));
         int fps(jget<int>(j,"framerate", 25));
         auto quality(jget<VnxVideo::TEncoderQuality>(j, "quality"));
         std::string type(jget<std::string>(j, "type", "auto"));
+        // cpu encoders start a GOP every fps frames
+        VnxVideo::SAsyncQueueConfig queueDefaults;
+        queueDefaults.referenceInterval = fps;
+        VnxVideo::SAsyncQueueConfig queue(VnxVideo::ParseAsyncQueueConfig(jget<json>(j, "queue"), queueDefaults));
         if (type == "cpu") {
             VnxVideo::PMediaEncoder enc(VnxVideo::CreateVideoEncoder_OpenH264(profile.c_str(), preset.c_str(), fps, quality));
-            encoder->ptr = VnxVideo::CreateAsyncVideoEncoder(enc);
-            return vnxvideo_err_ok;
+            return VnxVideo::CreateAsyncVideoEncoder(enc, queue);
         }
         else if (type == "qsv") {
-            encoder->ptr = VnxVideo::CreateVideoEncoder_FFmpeg(profile.c_str(), preset.c_str(), fps, quality, VnxVideo::ECodecImpl::ECI_QSV);
-            return vnxvideo_err_ok;
+            return VnxVideo::CreateVideoEncoder_FFmpeg(profile.c_str(), preset.c_str(), fps, quality, VnxVideo::ECodecImpl::ECI_QSV);
         }
         else if (type == "cuda") {
-            encoder->ptr = VnxVideo::CreateVideoEncoder_FFmpeg(profile.c_str(), preset.c_str(), fps, quality, VnxVideo::ECodecImpl::ECI_CUDA);
-            return vnxvideo_err_ok;
+            return VnxVideo::CreateVideoEncoder_FFmpeg(profile.c_str(), preset.c_str(), fps, quality, VnxVideo::ECodecImpl::ECI_CUDA);
         }
 #if defined(__aarch64__)
         else if (type == "rkmpp") {
-            encoder->ptr = VnxVideo::CreateVideoEncoder_FFmpeg(profile.c_str(), preset.c_str(), fps, quality, VnxVideo::ECodecImpl::ECI_RKMPP);
-            return vnxvideo_err_ok;
+            return VnxVideo::CreateVideoEncoder_FFmpeg(profile.c_str(), preset.c_str(), fps, quality, VnxVideo::ECodecImpl::ECI_RKMPP);
         }
 #endif
         else if (type == "vaapi") {
-            encoder->ptr = VnxVideo::CreateVideoEncoder_FFmpeg(profile.c_str(), preset.c_str(), fps, quality, VnxVideo::ECodecImpl::ECI_VAAPI);
-            return vnxvideo_err_ok;
+            return VnxVideo::CreateVideoEncoder_FFmpeg(profile.c_str(), preset.c_str(), fps, quality, VnxVideo::ECodecImpl::ECI_VAAPI);
         }
         else if (type == "auto") {
             try {
-                encoder->ptr = VnxVideo::CreateVideoEncoder_FFmpeg_Auto(profile.c_str(), preset.c_str(), fps, quality);
-                if (encoder->ptr == nullptr) {
+                IMediaEncoder* res = VnxVideo::CreateVideoEncoder_FFmpeg_Auto(profile.c_str(), preset.c_str(), fps, quality);
+                if (res == nullptr) {
                     VnxVideo::PMediaEncoder enc(VnxVideo::CreateVideoEncoder_OpenH264(profile.c_str(), preset.c_str(), fps, quality));
-                    encoder->ptr = VnxVideo::CreateAsyncVideoEncoder(enc);
+                    res = VnxVideo::CreateAsyncVideoEncoder(enc, queue);
                 }
+                return res;
             }
             catch (const VnxVideo::XHWDeviceNotSupported&) {
                 VNXVIDEO_LOG(VNXLOG_WARNING, "vnxvideo") << "Failed to create hw accelerated video encoder, CPU encoder is going to be used";
                 VnxVideo::PMediaEncoder enc(VnxVideo::CreateVideoEncoder_OpenH264(profile.c_str(), preset.c_str(), fps, quality));
-                encoder->ptr = VnxVideo::CreateAsyncVideoEncoder(enc);
+                return VnxVideo::CreateAsyncVideoEncoder(enc, queue);
             }
-            return vnxvideo_err_ok;
         }
         else
             throw std::runtime_error("unsupported encoder type");
     }
+}
+
+int vnxvideo_h264_encoder_create(const char* json_config, vnxvideo_encoder_t* encoder) {
+    try {
+        json j;
+        std::string s(json_config);
+        std::stringstream ss(s);
+        ss >> j;
+        encoder->ptr = VnxVideo::CreateVideoEncoder(j);
+        return vnxvideo_err_ok;
+    }
     catch (const std::exception& e) {
         VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_h264_encoder_create: " << e.what();
         return vnxvideo_err_invalid_parameter;
@@ -647,18 +863,26 @@ int vnxvideo_raw_sample_from_bmp(const uint8_t* data, int size, vnxvideo_raw_sam
 }
 
 
+namespace VnxVideo {
+    IMediaDecoder* CreateVideoDecoder(EMediaSubtype subtype, bool cpuOnly) {
+        if (subtype == EMST_HEVC)
+            return VnxVideo::CreateVideoDecoder_FFmpegHEVC(cpuOnly);
+        else if (subtype != EMST_H264)
+            throw std::runtime_error("unsupported video decoder subtype");
+        const char* const hwDecoderEnv = getenv("VNX_HW_DECODER");
+        if (!cpuOnly && hwDecoderEnv != 0 && strncmp(hwDecoderEnv, "1", 1) == 0)
+            return VnxVideo::CreateVideoDecoder_FFmpegH264(false);
+        const char* const swDecoderEnv = getenv("VNX_SW_DECODER");
+        if (swDecoderEnv != 0 && strcmp(swDecoderEnv, "ffmpeg") == 0)
+            return VnxVideo::CreateVideoDecoder_FFmpegH264(true);
+        else
+            return VnxVideo::CreateVideoDecoder_OpenH264();
+    }
+}
+
 int vnxvideo_h264_decoder_create(vnxvideo_decoder_t* decoder) {
     try {
-        const char* const hwDecoderEnv = getenv("VNX_HW_DECODER");
-        if (hwDecoderEnv != 0 && strncmp(hwDecoderEnv, "1", 1) == 0)
-            decoder->ptr = VnxVideo::CreateVideoDecoder_FFmpegH264(false);
-        else {
-            const char* const swDecoderEnv = getenv("VNX_SW_DECODER");
-            if (swDecoderEnv != 0 && strcmp(swDecoderEnv, "ffmpeg") == 0)
-                decoder->ptr = VnxVideo::CreateVideoDecoder_FFmpegH264(true);
-            else
-                decoder->ptr = VnxVideo::CreateVideoDecoder_OpenH264();
-        }
+        decoder->ptr = VnxVideo::CreateVideoDecoder(EMST_H264, false);
         return vnxvideo_err_ok;
     }
     catch (const std::exception& e) {
@@ -668,11 +892,7 @@ int vnxvideo_h264_decoder_create(vnxvideo_decoder_t* decoder) {
 }
 int vnxvideo_h264_sw_decoder_create(vnxvideo_decoder_t* decoder) {
     try {
-        const char* const swDecoderEnv = getenv("VNX_SW_DECODER");
-        if (swDecoderEnv != 0 && strcmp(swDecoderEnv, "ffmpeg") == 0)
-            decoder->ptr = VnxVideo::CreateVideoDecoder_FFmpegH264(true);
-        else
-            decoder->ptr = VnxVideo::CreateVideoDecoder_OpenH264();
+        decoder->ptr = VnxVideo::CreateVideoDecoder(EMST_H264, true);
         return vnxvideo_err_ok;
     }
     catch (const std::exception& e) {
@@ -736,12 +956,8 @@ int vnxvideo_decoder_flush(vnxvideo_decoder_t decoder) {
     }
 }
 
-int vnxvideo_analytics_create(const char* json_config, vnxvideo_analytics_t* analytics) {
-    try {
-        json j;
-        std::string s(json_config);
-        std::stringstream ss(s);
-        ss >> j;
+namespace VnxVideo {
+    IAnalytics* CreateAnalytics(const json& j) {
         std::string type(jget<std::string>(j, "type"));
         std::vector<float> roi(jget<std::vector<float> >(j, "roi", { 0.0f,0.0f,1.0f,1.0f })); // L,T,R,B
 
@@ -758,12 +974,24 @@ int vnxvideo_analytics_create(const char* json_config, vnxvideo_analytics_t* ana
             bool too_blurry(jget<bool>(j, "too_blurry"));
             float motion(jget<float>(j, "motion"));
             bool scene_change(jget<bool>(j, "scene_change"));
-            analytics->ptr = VnxVideo::CreateAnalytics_Basic(roi, framerate, too_bright, too_dark, too_blurry, motion, scene_change);
+            IAnalytics* res = VnxVideo::CreateAnalytics_Basic(roi, framerate, too_bright, too_dark, too_blurry, motion, scene_change);
+            res->SetMaxFrameAge(jget<int>(j, "max_age_ms", 0));
+            return res;
         }
         else
 #endif
             throw std::runtime_error("unknown analytics type: " + type);
     }
+}
+
+int vnxvideo_analytics_create(const char* json_config, vnxvideo_analytics_t* analytics) {
+    try {
+        json j;
+        std::string s(json_config);
+        std::stringstream ss(s);
+        ss >> j;
+        analytics->ptr = VnxVideo::CreateAnalytics(j);
+    }
     catch (const std::exception& e) {
         VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_analytics_create: " << e.what();
         return vnxvideo_err_invalid_parameter;
@@ -806,6 +1034,20 @@ int vnxvideo_rawproc_chain_create(vnxvideo_rawproc_chain_t* chain) {
     }
     return vnxvideo_err_ok;
 }
+int vnxvideo_rawproc_chain_create_with_config(const char* json_config, vnxvideo_rawproc_chain_t* chain) {
+    try {
+        json j;
+        std::string s(json_config);
+        std::stringstream ss(s);
+        ss >> j;
+        chain->ptr = VnxVideo::CreateRawProcChain(VnxVideo::ParseRawProcChainConfig(j));
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_rawproc_chain_create_with_config: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+    return vnxvideo_err_ok;
+}
 VNXVIDEO_DECLSPEC vnxvideo_rawproc_t vnxvideo_rawproc_chain_to_rawproc(vnxvideo_rawproc_chain_t chain) {
     return vnxvideo_rawproc_t{
         static_cast<VnxVideo::IRawProc*>(reinterpret_cast<VnxVideo::IRawProcChain*>(chain.ptr))
@@ -823,6 +1065,47 @@ VNXVIDEO_DECLSPEC int vnxvideo_rawproc_chain_link(vnxvideo_rawproc_chain_t chain
     }
     return vnxvideo_err_ok;
 }
+int vnxvideo_rawproc_chain_get_stats(vnxvideo_rawproc_chain_t chain, char* json_buffer, int buffer_size) {
+    try {
+        auto c = reinterpret_cast<VnxVideo::IRawProcChain*>(chain.ptr);
+        json res = json::array();
+        for (const auto& stats : c->GetLinkStats()) {
+            json link = {
+                { "processed", stats.processed },
+                { "total_us", stats.totalUs },
+                { "max_us", stats.maxUs },
+                { "last_us", stats.lastUs },
+                { "expired", stats.expired }
+            };
+            if (stats.queued) {
+                link["queue"] = {
+                    { "depth", stats.queue.depth },
+                    { "queued", stats.queue.queued },
+                    { "max_queued", stats.queue.maxQueued },
+                    { "processed", stats.queue.processed },
+                    { "dropped", stats.queue.dropped },
+                    { "blocked", stats.queue.blocked },
+                    { "expired", stats.queue.expired }
+                };
+            }
+            res.push_back(link);
+        }
+        std::stringstream wss;
+        wss << res << std::ends;
+        if (0 == json_buffer || 0 == buffer_size) {
+            return (int)wss.str().size();
+        }
+        if (wss.str().size() >= (size_t)buffer_size) {
+            return vnxvideo_err_invalid_parameter;
+        }
+        memcpy(json_buffer, wss.str().c_str(), wss.str().size());
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_rawproc_chain_get_stats: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
 
 int vnxvideo_rawtransform_create(const char* json_config, vnxvideo_rawtransform_t* transform) {
     try {
@@ -1016,6 +1299,30 @@ VNXVIDEO_DECLSPEC int vnxvideo_renderer_update_audio_layout(vnxvideo_renderer_t
     }
 }
 
+VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_max_frame_age(vnxvideo_renderer_t renderer, int max_age_ms) {
+    VnxVideo::IRenderer* r(reinterpret_cast<VnxVideo::IRenderer*>(renderer.ptr));
+    try {
+        r->SetMaxFrameAge(max_age_ms);
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_renderer_set_max_frame_age: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+
+VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_workers(vnxvideo_renderer_t renderer, int workers) {
+    VnxVideo::IRenderer* r(reinterpret_cast<VnxVideo::IRenderer*>(renderer.ptr));
+    try {
+        r->SetRenderWorkers(workers);
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_renderer_set_workers: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+
 VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_background(vnxvideo_renderer_t renderer, 
     uint8_t* backgroundColor, vnxvideo_raw_sample_t backgroundImage) 
 {
@@ -1091,6 +1398,17 @@ VNXVIDEO_DECLSPEC int vnxvideo_local_client_create(const char* name, vnxvideo_vi
         return vnxvideo_err_invalid_parameter;
     }
 }
+VNXVIDEO_DECLSPEC int vnxvideo_local_client_create_decimated(const char* name, double max_fps, int min_interval_ms,
+    vnxvideo_videosource_t* out) {
+    try {
+        out->ptr = VnxVideo::CreateLocalVideoClient(name, max_fps, min_interval_ms);
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_local_client_create_decimated: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
 VNXVIDEO_DECLSPEC int vnxvideo_local_server_create(const char* name, int maxSizeMB, vnxvideo_rawproc_t* out) {
     try {
         out->ptr = VnxVideo::CreateLocalVideoProvider(name, maxSizeMB);
@@ -1102,6 +1420,77 @@ VNXVIDEO_DECLSPEC int vnxvideo_local_server_create(const char* name, int maxSize
     }
 }
 
+int vnxvideo_pipeline_create(const char* json_config, vnxvideo_pipeline_t* pipeline) {
+    try {
+        json j;
+        std::string s(json_config);
+        std::stringstream ss(s);
+        ss >> j;
+        pipeline->ptr = VnxVideo::CreatePipeline(j);
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_pipeline_create: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+void vnxvideo_pipeline_free(vnxvideo_pipeline_t pipeline) {
+    delete reinterpret_cast<VnxVideo::IPipeline*>(pipeline.ptr);
+}
+int vnxvideo_pipeline_start(vnxvideo_pipeline_t pipeline) {
+    try {
+        reinterpret_cast<VnxVideo::IPipeline*>(pipeline.ptr)->Run();
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_pipeline_start: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+int vnxvideo_pipeline_stop(vnxvideo_pipeline_t pipeline) {
+    try {
+        reinterpret_cast<VnxVideo::IPipeline*>(pipeline.ptr)->Stop();
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_pipeline_stop: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+int vnxvideo_pipeline_get_renderer(vnxvideo_pipeline_t pipeline, const char* id, vnxvideo_renderer_t* renderer) {
+    VnxVideo::IRenderer* r = reinterpret_cast<VnxVideo::IPipeline*>(pipeline.ptr)->GetRenderer(id);
+    if (nullptr == r)
+        return vnxvideo_err_invalid_parameter;
+    renderer->ptr = r;
+    return vnxvideo_err_ok;
+}
+int vnxvideo_pipeline_get_analytics(vnxvideo_pipeline_t pipeline, const char* id, vnxvideo_analytics_t* analytics) {
+    VnxVideo::IAnalytics* a = reinterpret_cast<VnxVideo::IPipeline*>(pipeline.ptr)->GetAnalytics(id);
+    if (nullptr == a)
+        return vnxvideo_err_invalid_parameter;
+    analytics->ptr = a;
+    return vnxvideo_err_ok;
+}
+int vnxvideo_pipeline_get_stats(vnxvideo_pipeline_t pipeline, char* json_buffer, int buffer_size) {
+    try {
+        json res(reinterpret_cast<VnxVideo::IPipeline*>(pipeline.ptr)->GetStats());
+        std::stringstream wss;
+        wss << res << std::ends;
+        if (0 == json_buffer || 0 == buffer_size) {
+            return (int)wss.str().size();
+        }
+        if (wss.str().size() >= (size_t)buffer_size) {
+            return vnxvideo_err_invalid_parameter;
+        }
+        memcpy(json_buffer, wss.str().c_str(), wss.str().size());
+        return vnxvideo_err_ok;
+    }
+    catch (const std::exception& e) {
+        VNXVIDEO_LOG(VNXLOG_ERROR, "vnxvideo") << "Exception on vnxvideo_pipeline_get_stats: " << e.what();
+        return vnxvideo_err_invalid_parameter;
+    }
+}
+
 nlohmann::json parseSelector(const std::string& channel_selector) {
     nlohmann::json js;
     std::string s(channel_selector);
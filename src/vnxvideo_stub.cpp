@@ -11,6 +11,38 @@ int vnxvideo_init(vnxvideo_log_t log_handler, void* usrptr, ELogLevel max_level)
     return vnxvideo_err_not_implemented;
 }
 
+int vnxvideo_get_sws_cache_stats(uint64_t* hits, uint64_t* misses, uint64_t* evictions) {
+    return vnxvideo_err_not_implemented;
+}
+
+int vnxvideo_get_memory_stats(char* json_buffer, int buffer_size) {
+    return vnxvideo_err_not_implemented;
+}
+
+int vnxvideo_configure_executor(int workers, const char* cpu_affinity) {
+    return vnxvideo_err_not_implemented;
+}
+
+int vnxvideo_get_latency_stats(char* json_buffer, int buffer_size) {
+    return vnxvideo_err_not_implemented;
+}
+int vnxvideo_reset_latency_stats() {
+    return vnxvideo_err_not_implemented;
+}
+
+int vnxvideo_event_trace_enable(int enable) {
+    return vnxvideo_err_not_implemented;
+}
+int vnxvideo_event_trace_dump(char* json_buffer, int buffer_size) {
+    return vnxvideo_err_not_implemented;
+}
+int vnxvideo_event_trace_dump_to_file(const char* path) {
+    return vnxvideo_err_not_implemented;
+}
+int vnxvideo_event_trace_dump_on_signal(int signum, const char* path) {
+    return vnxvideo_err_not_implemented;
+}
+
 int vnxvideo_manager_dshow_create(vnxvideo_manager_t* mgr) {
     return vnxvideo_err_not_implemented;
 }
@@ -82,6 +114,9 @@ int vnxvideo_rawproc_process(vnxvideo_rawproc_t proc, vnxvideo_raw_sample_t samp
 int vnxvideo_rawproc_flush(vnxvideo_rawproc_t proc) {
     return vnxvideo_err_not_implemented;
 }
+int vnxvideo_rawproc_get_queue_stats(vnxvideo_rawproc_t proc, char* json_buffer, int buffer_size) {
+    return vnxvideo_err_not_implemented;
+}
 
 int vnxvideo_rawproc_create_from_callbacks(
     vnxvideo_on_frame_format_t onFormat, void* usrptrOnFormat,
@@ -208,9 +243,15 @@ int vnxvideo_rawproc_chain_create(vnxvideo_rawproc_chain_t* chain) {
 VNXVIDEO_DECLSPEC vnxvideo_rawproc_t vnxvideo_rawproc_chain_to_rawproc(vnxvideo_rawproc_chain_t chain) {
     return vnxvideo_rawproc_t{nullptr};
 }
+int vnxvideo_rawproc_chain_create_with_config(const char* json_config, vnxvideo_rawproc_chain_t* chain) {
+    return vnxvideo_err_not_implemented;
+}
 VNXVIDEO_DECLSPEC int vnxvideo_rawproc_chain_link(vnxvideo_rawproc_chain_t chain, vnxvideo_rawproc_t link) {
     return vnxvideo_err_not_implemented;
 }
+int vnxvideo_rawproc_chain_get_stats(vnxvideo_rawproc_chain_t chain, char* json_buffer, int buffer_size) {
+    return vnxvideo_err_not_implemented;
+}
 
 int vnxvideo_rawtransform_create(const char* json_config, vnxvideo_rawtransform_t* transform) {
     return vnxvideo_err_not_implemented;
@@ -261,6 +302,14 @@ VNXVIDEO_DECLSPEC int vnxvideo_renderer_update_audio_layout(vnxvideo_renderer_t
     return vnxvideo_err_not_implemented;
 }
 
+VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_max_frame_age(vnxvideo_renderer_t renderer, int max_age_ms) {
+    return vnxvideo_err_not_implemented;
+}
+
+VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_workers(vnxvideo_renderer_t renderer, int workers) {
+    return vnxvideo_err_not_implemented;
+}
+
 VNXVIDEO_DECLSPEC int vnxvideo_renderer_set_background(vnxvideo_renderer_t renderer, 
     uint8_t* backgroundColor, vnxvideo_raw_sample_t backgroundImage) 
 {
@@ -290,10 +339,35 @@ VNXVIDEO_DECLSPEC void vnxvideo_shm_allocator_free(vnxvideo_allocator_t allocato
 VNXVIDEO_DECLSPEC int vnxvideo_local_client_create(const char* name, vnxvideo_videosource_t* out) {
     return vnxvideo_err_not_implemented;
 }
+VNXVIDEO_DECLSPEC int vnxvideo_local_client_create_decimated(const char* name, double max_fps, int min_interval_ms,
+    vnxvideo_videosource_t* out) {
+    return vnxvideo_err_not_implemented;
+}
 VNXVIDEO_DECLSPEC int vnxvideo_local_server_create(const char* name, int maxSizeMB, vnxvideo_rawproc_t* out) {
     return vnxvideo_err_not_implemented;
 }
 
+int vnxvideo_pipeline_create(const char* json_config, vnxvideo_pipeline_t* pipeline) {
+    return vnxvideo_err_not_implemented;
+}
+void vnxvideo_pipeline_free(vnxvideo_pipeline_t pipeline) {
+}
+int vnxvideo_pipeline_start(vnxvideo_pipeline_t pipeline) {
+    return vnxvideo_err_not_implemented;
+}
+int vnxvideo_pipeline_stop(vnxvideo_pipeline_t pipeline) {
+    return vnxvideo_err_not_implemented;
+}
+int vnxvideo_pipeline_get_renderer(vnxvideo_pipeline_t pipeline, const char* id, vnxvideo_renderer_t* renderer) {
+    return vnxvideo_err_not_implemented;
+}
+int vnxvideo_pipeline_get_analytics(vnxvideo_pipeline_t pipeline, const char* id, vnxvideo_analytics_t* analytics) {
+    return vnxvideo_err_not_implemented;
+}
+int vnxvideo_pipeline_get_stats(vnxvideo_pipeline_t pipeline, char* json_buffer, int buffer_size) {
+    return vnxvideo_err_not_implemented;
+}
+
 VNXVIDEO_DECLSPEC int vnxvideo_vmsplugin_free(vnxvideo_vmsplugin_t vmsplugin) {
     return vnxvideo_err_not_implemented;
 }
@@ -373,6 +447,14 @@ int vnxvideo_raw_sample_crop_resize(vnxvideo_raw_sample_t in,
 {
     return vnxvideo_err_not_implemented;
 }
+
+int vnxvideo_raw_sample_convert_on_demand(vnxvideo_raw_sample_t in, vnxvideo_raw_sample_t* out) {
+    return vnxvideo_err_not_implemented;
+}
+
+int vnxvideo_raw_sample_convert(vnxvideo_raw_sample_t in, EColorspace csp, vnxvideo_raw_sample_t* out) {
+    return vnxvideo_err_not_implemented;
+}
 int vnxvideo_raw_sample_wrap(EColorspace csp, int width, int height,
     int* strides, uint8_t **planes, vnxvideo_raw_sample_t* dst) {
     return vnxvideo_err_not_implemented;
@@ -7,6 +7,7 @@
 #include "vnxvideologimpl.h"
 
 #include "BufferImpl.h"
+#include "FrameTrace.h"
 
 #if 0
 
@@ -35,6 +36,9 @@ private:
     int m_width;
     int m_height;
     int m_nplanes;
+
+    CFrameTraceCarrier m_traces; // from raw to encoded frames, by timestamp
+    CLatencyHistogram* const m_latency;
 public:
     Cx264Encoder(const char* profile, const char* preset, int fps, int quality)
         : m_preset(preset)
@@ -44,6 +48,7 @@ public:
         , m_fps(fps)
         , m_quality(quality)
         , m_encoder(nullptr)
+        , m_latency(GetLatencyHistogram("encoder"))
     {
         x264_picture_init(&pic);
         x264_picture_init(&pic_out);
@@ -122,6 +127,7 @@ public:
         memcpy(pic.img.plane, planes, m_nplanes * sizeof(uint8_t*));
         pic.i_pts = timestamp;
         //pic.b_keyframe = 1;
+        m_traces.Push(sample, timestamp);
 
         i_frame_size = x264_encoder_encode(m_encoder.get(), &nal, &i_nal, &pic, &pic_out);
         if (i_frame_size < 0) {
@@ -155,6 +161,7 @@ public:
     }
     void OutputNAL(uint8_t *data, int size, uint64_t ts) {
         CNoOwnershipNalBuffer b(data, size);
+        m_traces.Pass(&b, ts, m_latency);
         m_onBuffer(&b, ts);
     }
 private:
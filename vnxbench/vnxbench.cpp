@@ -0,0 +1,512 @@
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <fstream>
+#include <ctime>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <vnxvideo/vnxvideo.h>
+#include <vnxvideo/vnxvideoimpl.h>
+#include <vnxvideo/vnxvideologimpl.h>
+
+#include "RawSample.h"
+
+// Micro benchmarks for vnxvideo internals which are not reachable via public API.
+// Usage: vnxbench <benchmark> [args...]; run without arguments to list the benchmarks.
+
+void log_handler(void* usrptr, ELogLevel level, const char* subsystem, const char* message) {
+    std::cerr << level << " " << subsystem << " " << message << std::endl;
+}
+
+static int intArg(int argc, char** argv, int index, int def) {
+    return (argc > index) ? atoi(argv[index]) : def;
+}
+
+// Every thread allocates frames of fixed size from a shared allocator, keeping
+// a few of them in flight, which is what decoder and renderer threads do.
+static double runShmAllocThreads(IShmAllocator* allocator, int nthreads, int seconds, int frameSize, int inFlight,
+    uint64_t& totalOps, uint64_t& failures)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> ops(0);
+    std::atomic<uint64_t> failed(0);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < nthreads; ++t) {
+        threads.emplace_back([&]() {
+            std::vector<std::shared_ptr<uint8_t>> held(inFlight);
+            uint64_t n = 0;
+            uint64_t f = 0;
+            size_t k = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                held[k].reset();
+                held[k] = allocator->Alloc(frameSize);
+                if (held[k])
+                    held[k].get()[0] = uint8_t(n); // touch the frame as a producer would
+                else
+                    ++f;
+                k = (k + 1) % held.size();
+                ++n;
+            }
+            ops += n;
+            failed += f;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& t : threads)
+        t.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    totalOps = ops;
+    failures = failed;
+    return elapsed;
+}
+
+// shmalloc [threads] [seconds] [frameSizeKB] [framesInFlightPerThread] [segmentSizeMB]
+static int benchShmAlloc(int argc, char** argv) {
+    const int nthreads = intArg(argc, argv, 0, 8);
+    const int seconds = intArg(argc, argv, 1, 3);
+    const int frameSize = intArg(argc, argv, 2, 3038) * 1024; // 1080p I420
+    const int inFlight = intArg(argc, argv, 3, 4);
+    const int segmentMB = intArg(argc, argv, 4, 1024);
+
+    std::cout << "shm alloc/free, " << nthreads << " threads, frame " << frameSize / 1024 << " KB, "
+        << inFlight << " frames in flight per thread, segment " << segmentMB << " MB" << std::endl;
+
+    struct SCase {
+        const char* name;
+        std::function<IShmAllocator*()> create;
+    };
+    std::string segmentName("vnxbench_" + std::to_string(getpid()));
+    SCase cases[] = {
+        { "boost", [&]() { return CreateShmAllocator(segmentName.c_str(), segmentMB); } },
+        { "slab", [&]() { return CreateShmSlabAllocator(segmentName.c_str(), segmentMB); } },
+    };
+    for (auto& c : cases) {
+        uint64_t ops = 0;
+        uint64_t failures = 0;
+        double elapsed;
+        {
+            PShmAllocator allocator(c.create());
+            elapsed = runShmAllocThreads(allocator.get(), nthreads, seconds, frameSize, inFlight, ops, failures);
+        }
+        std::cout << std::setw(8) << c.name << ": " << std::fixed << std::setprecision(0)
+            << ops / elapsed << " alloc+free/s, " << std::setprecision(1)
+            << elapsed * 1e9 * nthreads / std::max<uint64_t>(ops, 1) << " ns/op per thread, "
+            << failures << " failed" << std::endl;
+    }
+    boost::interprocess::shared_memory_object::remove(("viinex_shm_" + segmentName).c_str());
+    return 0;
+}
+
+// counts data TLB read misses of the calling thread, if perf events are accessible
+class CTlbMissCounter {
+public:
+    CTlbMissCounter() {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~CTlbMissCounter() {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+    bool Available() const { return m_fd >= 0; }
+    void Start() {
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    uint64_t Stop() {
+        uint64_t count = 0;
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof count) != sizeof count)
+                count = 0;
+        }
+        return count;
+    }
+private:
+    int m_fd;
+};
+
+volatile uint64_t g_sink;
+
+static uint64_t anonHugePagesKB() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(smaps, line)) {
+        if (line.compare(0, 14, "AnonHugePages:") == 0)
+            return strtoull(line.c_str() + 14, nullptr, 10);
+    }
+    return 0;
+}
+
+// hugepages [width] [height] [frames] [passes]
+// Copies I420 frames (sequential access), and walks them column-wise, as vertical
+// filters and rotations do, which touches a new page on every row.
+static int benchHugePages(int argc, char** argv) {
+    const int width = intArg(argc, argv, 0, 3840);
+    const int height = intArg(argc, argv, 1, 2160);
+    const int nframes = intArg(argc, argv, 2, 8);
+    const int passes = intArg(argc, argv, 3, 10);
+
+    std::cout << "frame memory, " << nframes << " I420 frames " << width << "x" << height << ", " << passes << " passes" << std::endl;
+    CTlbMissCounter tlb;
+    if (!tlb.Available())
+        std::cout << "dTLB miss counter is not available (perf_event_open: " << strerror(errno) << ")" << std::endl;
+
+    const SFrameMemoryMode initialMode = GetFrameMemoryMode();
+    for (int huge = 0; huge < 2; ++huge) {
+        SFrameMemoryMode mode = initialMode;
+        mode.hugePages = huge != 0;
+        SetFrameMemoryMode(mode);
+
+        const uint64_t hugeBefore = anonHugePagesKB();
+        std::vector<std::shared_ptr<CRawSample>> frames;
+        for (int k = 0; k < nframes; ++k) {
+            // private allocator rather than the pool, so that every mode gets fresh memory
+            frames.emplace_back(new CRawSample(EMF_I420, width, height, g_privateAllocator));
+            int strides[4];
+            uint8_t* planes[4];
+            frames.back()->GetData(strides, planes);
+            memset(planes[0], k, CRawSample::AllocationSize(EMF_I420, width, height) - 2048);
+        }
+        const uint64_t hugeKB = anonHugePagesKB() - hugeBefore;
+
+        const double frameBytes = double(width) * height * 3 / 2;
+        tlb.Start();
+        auto start = std::chrono::steady_clock::now();
+        for (int p = 0; p < passes; ++p) {
+            for (int k = 0; k < nframes; ++k) {
+                int ss[4], ds[4];
+                uint8_t *sp[4], *dp[4];
+                frames[k]->GetData(ss, sp);
+                frames[(k + 1) % nframes]->GetData(ds, dp);
+                CRawSample::CopyRawToI420(width, height, EMF_I420, sp, ss, dp, ds);
+            }
+        }
+        double copyTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const uint64_t copyMisses = tlb.Stop();
+
+        tlb.Start();
+        start = std::chrono::steady_clock::now();
+        uint64_t sum = 0;
+        for (int p = 0; p < passes; ++p) {
+            for (int k = 0; k < nframes; ++k) {
+                int strides[4];
+                uint8_t* planes[4];
+                frames[k]->GetData(strides, planes);
+                for (int x = 0; x < width; x += 64)
+                    for (int y = 0; y < height; ++y)
+                        sum += planes[0][y * strides[0] + x];
+            }
+        }
+        double walkTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const uint64_t walkMisses = tlb.Stop();
+
+        const double bytes = frameBytes * nframes * passes;
+        std::cout << std::setw(10) << (huge ? "hugepages" : "default") << ": "
+            << hugeKB / 1024 << " MB in huge pages; copy " << std::fixed << std::setprecision(2)
+            << bytes / copyTime / 1e9 << " GB/s";
+        if (tlb.Available())
+            std::cout << ", " << std::setprecision(1) << copyMisses / (bytes / 1048576) << " dTLB misses/MB";
+        std::cout << "; column walk " << std::setprecision(1)
+            << double(height) * (width / 64) * nframes * passes / walkTime / 1e6 << " Mreads/s";
+        if (tlb.Available())
+            std::cout << ", " << std::setprecision(3) << double(walkMisses) / (double(height) * (width / 64) * nframes * passes) << " dTLB misses/read";
+        std::cout << std::endl;
+        g_sink = sum;
+    }
+    SetFrameMemoryMode(initialMode);
+    return 0;
+}
+
+static uint64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t cpuTimeNs() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleepUntilNs(uint64_t ns) {
+    const uint64_t now = steadyNowNs();
+    if (ns > now)
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ns - now));
+}
+
+// Frames received by one local transport client. Frame timestamps are steady clock readings,
+// which are the same in all processes, so that clients in other processes can measure latency
+// and count frames published within the measurement window.
+struct SLocalClientResult {
+    uint64_t frames;
+    uint64_t cpuNs; // taken by the client process over the window, for out of process clients
+    std::vector<uint32_t> latencies; // microseconds
+    SLocalClientResult() : frames(0), cpuNs(0) {}
+};
+
+static VnxVideo::IVideoSource* createMeasuringClient(const std::string& name, SLocalClientResult* result,
+    uint64_t startNs, uint64_t endNs) {
+    VnxVideo::IVideoSource* client = VnxVideo::CreateLocalVideoClient(name.c_str());
+    client->Subscribe([](ERawMediaFormat, int, int) {},
+        [result, startNs, endNs](VnxVideo::IRawSample*, uint64_t timestamp) {
+        if (timestamp < startNs || timestamp >= endNs)
+            return;
+        ++result->frames;
+        result->latencies.push_back((uint32_t)((steadyNowNs() - timestamp) / 1000));
+    });
+    client->Run();
+    return client;
+}
+
+// localtransport-client <name> <start ns> <end ns> <fd>: runs in a process spawned by localtransport,
+// writes frame count, cpu time and latencies to fd
+static int benchLocalTransportClient(int argc, char** argv) {
+    if (argc < 4)
+        return 1;
+    const uint64_t startNs = strtoull(argv[1], nullptr, 10);
+    const uint64_t endNs = strtoull(argv[2], nullptr, 10);
+    const int fd = atoi(argv[3]);
+    SLocalClientResult result;
+    std::unique_ptr<VnxVideo::IVideoSource> client(createMeasuringClient(argv[0], &result, startNs, endNs));
+    sleepUntilNs(startNs);
+    const uint64_t cpu0 = cpuTimeNs();
+    sleepUntilNs(endNs);
+    result.cpuNs = cpuTimeNs() - cpu0;
+    sleepUntilNs(endNs + 300000000); // frames in flight
+    client->Stop();
+    client.reset();
+
+    std::vector<uint64_t> header = { result.frames, result.cpuNs, result.latencies.size() };
+    std::string out(reinterpret_cast<const char*>(header.data()), header.size() * sizeof(uint64_t));
+    out.append(reinterpret_cast<const char*>(result.latencies.data()), result.latencies.size() * sizeof(uint32_t));
+    for (size_t written = 0; written < out.size();) {
+        ssize_t n = write(fd, out.data() + written, out.size() - written);
+        if (n <= 0)
+            return 1;
+        written += n;
+    }
+    close(fd);
+    return 0;
+}
+
+// spawns a local transport client process; returns its pid and the read end of its result pipe
+static pid_t spawnLocalTransportClient(const std::string& name, uint64_t startNs, uint64_t endNs, int& resultFd) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        throw std::runtime_error("pipe() failed");
+    const pid_t pid = fork();
+    if (pid < 0)
+        throw std::runtime_error("fork() failed");
+    if (0 == pid) {
+        close(fds[0]);
+        const std::string start(std::to_string(startNs)), end(std::to_string(endNs)), fd(std::to_string(fds[1]));
+        execl("/proc/self/exe", "vnxbench", "localtransport-client", name.c_str(), start.c_str(), end.c_str(), fd.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    close(fds[1]);
+    resultFd = fds[0];
+    return pid;
+}
+
+static bool readLocalTransportClient(int fd, SLocalClientResult& result) {
+    std::string in;
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof buf)) > 0)
+        in.append(buf, n);
+    close(fd);
+    if (in.size() < 3 * sizeof(uint64_t))
+        return false;
+    const uint64_t* header = reinterpret_cast<const uint64_t*>(in.data());
+    if (in.size() != 3 * sizeof(uint64_t) + header[2] * sizeof(uint32_t))
+        return false;
+    result.frames = header[0];
+    result.cpuNs = header[1];
+    const uint32_t* latencies = reinterpret_cast<const uint32_t*>(header + 3);
+    result.latencies.assign(latencies, latencies + header[2]);
+    return true;
+}
+
+// One provider publishing I420 frames from shared memory to nlocal clients in this process
+// and nremote clients in processes of their own.
+static void runLocalTransport(const char* mode, int nlocal, int nremote, int seconds, int width, int height, int fps) {
+    setenv("VNX_LOCAL_TRANSPORT", std::string("ring") == mode ? "ring" : "socket", 1);
+    setenv("VNX_LOCAL_CREDITS", std::string("credits") == mode ? "8" : "0", 1);
+    const std::string name("vnxbench_lt_" + std::to_string(getpid()));
+    const int segmentMB = 256;
+
+    // let the clients start and connect before the measurement
+    const uint64_t startNs = steadyNowNs() + (nremote > 0 ? 1000000000ull : 500000000ull);
+    const uint64_t endNs = startNs + seconds * 1000000000ull;
+    std::vector<SLocalClientResult> results(nlocal + nremote);
+    uint64_t published = 0;
+    uint64_t cpuNs = 0;
+    int failed = 0;
+    {
+        PShmAllocator allocator(CreateShmAllocator(name.c_str(), segmentMB));
+        std::unique_ptr<VnxVideo::IRawProc> provider;
+        WithPreferredShmAllocator(allocator.get(), [&]() {
+            provider.reset(VnxVideo::CreateLocalVideoProvider(name.c_str(), segmentMB));
+        });
+        provider->SetFormat(EMF_I420, width, height);
+
+        std::vector<std::pair<pid_t, int> > processes;
+        for (int k = 0; k < nremote; ++k) {
+            int fd;
+            pid_t pid = spawnLocalTransportClient(name, startNs, endNs, fd);
+            processes.push_back(std::make_pair(pid, fd));
+        }
+        std::vector<std::unique_ptr<VnxVideo::IVideoSource>> clients;
+        for (int k = 0; k < nlocal; ++k)
+            clients.emplace_back(createMeasuringClient(name, &results[k], startNs, endNs));
+
+        auto publish = [&]() {
+            std::unique_ptr<CRawSample> sample;
+            WithPreferredShmAllocator(allocator.get(), [&]() {
+                sample.reset(new CRawSample(EMF_I420, width, height));
+            });
+            const uint64_t timestamp = steadyNowNs();
+            provider->Process(sample.get(), timestamp);
+            return timestamp;
+        };
+        while (steadyNowNs() < startNs) {
+            publish();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        const uint64_t cpu0 = cpuTimeNs();
+        uint64_t next = startNs;
+        for (;;) {
+            const uint64_t timestamp = publish();
+            if (timestamp >= endNs)
+                break;
+            ++published;
+            if (fps > 0) {
+                next += 1000000000ull / fps;
+                sleepUntilNs(next);
+            }
+        }
+        cpuNs = cpuTimeNs() - cpu0;
+        sleepUntilNs(endNs + 300000000); // frames in flight
+
+        for (int k = 0; k < nremote; ++k) {
+            if (!readLocalTransportClient(processes[k].second, results[nlocal + k]))
+                ++failed;
+            waitpid(processes[k].first, nullptr, 0);
+        }
+        for (auto& c : clients)
+            c->Stop();
+        clients.clear();
+        provider.reset();
+    }
+    boost::interprocess::shared_memory_object::remove(("viinex_shm_" + name).c_str());
+
+    const int nclients = nlocal + nremote;
+    uint64_t frames = 0;
+    std::vector<uint32_t> latencies;
+    for (auto& r : results) {
+        frames += r.frames;
+        cpuNs += r.cpuNs;
+        latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+    }
+    const uint64_t expected = published * nclients;
+    const uint64_t drops = expected > frames ? expected - frames : 0;
+    auto percentile = [&](double p) -> uint32_t {
+        if (latencies.empty())
+            return 0;
+        auto nth = latencies.begin() + (size_t)(p * (latencies.size() - 1));
+        std::nth_element(latencies.begin(), nth, latencies.end());
+        return *nth;
+    };
+    std::cout << std::setw(8) << mode << std::setw(4) << nlocal << "+" << nremote << " clients: " << std::fixed << std::setprecision(0)
+        << frames / (double)seconds << " fps total, " << frames / (double)seconds / nclients << " per client, drops "
+        << drops << " (" << std::setprecision(1) << (expected ? 100.0 * drops / expected : 0.0) << "%), cpu "
+        << std::setprecision(2) << (frames ? cpuNs / 1000.0 / frames : 0.0) << " us/frame; latency us p50 "
+        << percentile(0.5) << " p99 " << percentile(0.99) << " p999 " << percentile(0.999) << std::endl;
+    if (failed > 0)
+        std::cout << "    " << failed << " client processes did not report" << std::endl;
+}
+
+// localtransport [seconds] [width] [height] [fps] [clients] [processes]
+// fps 0 publishes as fast as possible; clients 0 runs 1, 8 and 64 clients in this process;
+// processes is the number of additional clients, each in a process of its own.
+// Drops are frames published within the measurement window and not delivered to a client,
+// cpu is the time taken by all the processes involved per delivered frame.
+static int benchLocalTransport(int argc, char** argv) {
+    const int seconds = std::max(1, intArg(argc, argv, 0, 3));
+    const int width = intArg(argc, argv, 1, 640);
+    const int height = intArg(argc, argv, 2, 360);
+    const int fps = intArg(argc, argv, 3, 0);
+    const int nclients = intArg(argc, argv, 4, 0);
+    const int nprocesses = std::max(0, intArg(argc, argv, 5, 0));
+
+    std::cout << "local transport, I420 " << width << "x" << height << ", "
+        << (fps > 0 ? std::to_string(fps) + " fps" : std::string("unthrottled")) << std::endl;
+    std::vector<int> counts;
+    if (nclients > 0)
+        counts.push_back(nclients);
+    else
+        counts = { 1, 8, 64 };
+    for (const char* mode : { "socket", "credits", "ring" })
+        for (int n : counts)
+            runLocalTransport(mode, n, nprocesses, seconds, width, height, fps);
+    unsetenv("VNX_LOCAL_TRANSPORT");
+    unsetenv("VNX_LOCAL_CREDITS");
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    // the boost path is what CreateShmAllocator returns by default
+    unsetenv("VNX_SHM_ALLOCATOR");
+    vnxvideo_init(log_handler, 0, VNXLOG_WARNING);
+
+    std::map<std::string, std::function<int(int, char**)>> benchmarks = {
+        { "shmalloc", benchShmAlloc },
+        { "hugepages", benchHugePages },
+        { "localtransport", benchLocalTransport },
+    };
+
+    // clients spawned by localtransport
+    if (argc > 1 && std::string("localtransport-client") == argv[1])
+        return benchLocalTransportClient(argc - 2, argv + 2);
+
+    if (argc < 2 || benchmarks.find(argv[1]) == benchmarks.end()) {
+        std::cerr << "Usage: " << argv[0] << " <benchmark> [args...]" << std::endl << "Benchmarks:" << std::endl;
+        for (auto& b : benchmarks)
+            std::cerr << "  " << b.first << std::endl;
+        return 1;
+    }
+    try {
+        return benchmarks[argv[1]](argc - 2, argv + 2);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Caught an exception: " << e.what() << std::endl;
+        return 1;
+    }
+}